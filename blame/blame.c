@@ -0,0 +1,87 @@
+#include "blame.h"
+
+/** @brief Compares line traces by line.
+ *
+ *  @param a : address of line trace.
+ *  @param b : address of line trace.
+ *  @return -1, 0 or 1.
+ */
+static int compare_line_trace(const void *a, const void *b);
+
+void init_blame_cache(BlameCache *cache) {
+    memset(cache, 0, sizeof(BlameCache));
+    return;
+}
+
+void free_blame_cache(BlameCache *cache) {
+    if (!cache) {
+        return;
+    }
+
+    for (size_t i = 0; i < BLAME_CACHE_ENTRIES; ++i) {
+        free(cache->maps[i].origins);
+    }
+    init_blame_cache(cache);
+    return;
+}
+
+LineOrigin *get_blame_map(BlameCache *cache, size_t commit, const char *path,
+                          size_t *n_lines) {
+    for (size_t i = 0; i < BLAME_CACHE_ENTRIES; ++i) {
+        BlameMap *m = &cache->maps[i];
+        if (m->path && m->commit == commit && !strcmp(m->path, path)) {
+            m->used = ++cache->tick;
+            *n_lines = m->n_lines;
+            return m->origins;
+        }
+    }
+    return NULL;
+}
+
+void put_blame_map(BlameCache *cache, size_t commit, const char *path,
+                   LineOrigin *origins, size_t n_lines) {
+    // empty slot, otherwise least recently used
+    BlameMap *victim = &cache->maps[0];
+    for (size_t i = 0; i < BLAME_CACHE_ENTRIES && victim->path; ++i) {
+        if (!cache->maps[i].path || cache->maps[i].used < victim->used) {
+            victim = &cache->maps[i];
+        }
+    }
+
+    free(victim->origins);
+    victim->commit = commit;
+    victim->path = path;
+    victim->origins = safe_malloc((n_lines + 1) * sizeof(LineOrigin));
+    memcpy(victim->origins, origins, n_lines * sizeof(LineOrigin));
+    victim->n_lines = n_lines;
+    victim->used = ++cache->tick;
+    return;
+}
+
+void sort_line_traces(LineTrace *traces, size_t n_traces) {
+    qsort(traces, n_traces, sizeof(LineTrace), compare_line_trace);
+    return;
+}
+
+void trace_lines(DiffChunk *chunks, size_t n_chunks, const LineTrace *traces,
+                 size_t n_traces, size_t *from) {
+    // lines between chunks are common, offset by the lines changed before
+    size_t c = 0;
+    ptrdiff_t offset = 0;
+    for (size_t i = 0; i < n_traces; ++i) {
+        size_t line = traces[i].line;
+        while (c < n_chunks && chunks[c].b_end <= line) {
+            offset = (ptrdiff_t) chunks[c].a_end - (ptrdiff_t) chunks[c].b_end;
+            c++;
+        }
+        from[i] = c < n_chunks && chunks[c].b_start <= line ? LINE_CHANGED :
+                  (size_t) ((ptrdiff_t) line + offset);
+    }
+    return;
+}
+
+static int compare_line_trace(const void *a, const void *b) {
+    size_t la = ((const LineTrace *) a)->line;
+    size_t lb = ((const LineTrace *) b)->line;
+    return (la > lb) - (la < lb);
+}
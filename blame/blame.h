@@ -0,0 +1,97 @@
+#ifndef ASSIGNMENT_2_SVC_BLAME_H
+#define ASSIGNMENT_2_SVC_BLAME_H
+
+#include "../params.h"
+#include "../memory/memory.h"
+#include "../diff/diff.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+// line changed, not passed to the parent diffed
+#define LINE_CHANGED SIZE_MAX
+
+typedef struct LineOrigin {
+    size_t commit;  // index of commit that last changed the line
+    size_t line;    // line in the file of that commit, 0 based
+} LineOrigin;
+
+typedef struct LineTrace {
+    size_t target;  // line of the file blamed
+    size_t line;    // line with the same contents in a suspected commit
+} LineTrace;
+
+typedef struct BlameMap {
+    size_t commit;        // index of commit blamed
+    const char *path;     // interned path blamed, NULL if entry is empty
+    LineOrigin *origins;  // origin of each line of the file
+    size_t n_lines;       // number of lines
+    uint64_t used;        // tick of last use
+} BlameMap;
+
+typedef struct BlameCache {
+    BlameMap maps[BLAME_CACHE_ENTRIES];  // line maps, least recently used
+                                         // evicted first
+    uint64_t tick;                       // incremented on every use
+} BlameCache;
+
+/** @brief Initialises empty blame cache.
+ *
+ *  @param cache : address of blame cache.
+ */
+void init_blame_cache(BlameCache *cache);
+
+/** @brief Releases line maps of blame cache.
+ *
+ *  @param cache : address of blame cache.
+ */
+void free_blame_cache(BlameCache *cache);
+
+/** @brief Finds line map of file blamed at commit.
+ *
+ *  Commits never change once written, so a map stays valid for as long as
+ *  the paths it is keyed by are interned.
+ *
+ *  @param cache : address of blame cache.
+ *  @param commit : index of commit.
+ *  @param path : interned path.
+ *  @param n_lines : address for number of lines to be set.
+ *  @return origins of lines, owned by the cache, NULL if not cached.
+ */
+LineOrigin *get_blame_map(BlameCache *cache, size_t commit, const char *path,
+                          size_t *n_lines);
+
+/** @brief Caches line map of file blamed at commit.
+ *
+ *  Origins are copied. The least recently used map is evicted if the cache
+ *  is full.
+ *
+ *  @param cache : address of blame cache.
+ *  @param commit : index of commit.
+ *  @param path : interned path.
+ *  @param origins : origin of each line of the file.
+ *  @param n_lines : number of lines.
+ */
+void put_blame_map(BlameCache *cache, size_t commit, const char *path,
+                   LineOrigin *origins, size_t n_lines);
+
+/** @brief Sorts traces by line.
+ *
+ *  @param traces : line traces.
+ *  @param n_traces : number of traces.
+ */
+void sort_line_traces(LineTrace *traces, size_t n_traces);
+
+/** @brief Finds lines of text b that were copied unchanged from text a.
+ *
+ *  @param chunks : chunks turning a into b, as returned by diff_texts.
+ *  @param n_chunks : number of chunks.
+ *  @param traces : traces to lines of b, sorted by line.
+ *  @param n_traces : number of traces.
+ *  @param from : address for the line of a of each trace to be set,
+ *                LINE_CHANGED if the line is not in a.
+ */
+void trace_lines(DiffChunk *chunks, size_t n_chunks, const LineTrace *traces,
+                 size_t n_traces, size_t *from);
+
+#endif //ASSIGNMENT_2_SVC_BLAME_H
@@ -1,20 +1,91 @@
 #include "branch.h"
 
+/** @brief Adds file to path index, replacing any older file with its path.
+ *
+ *  Index MUST have a free slot.
+ *
+ *  @param b : address of branch.
+ *  @param index : index of file.
+ */
+static void insert_path(Branch *b, size_t index);
+
+/** @brief Drops reference of branch to its files, releasing them if unshared.
+ *
+ *  @param b : address of branch.
+ */
+static void release_branch_files(Branch *b);
+
+/** @brief Allocates table of files owned by one branch, never saved.
+ *
+ *  @return address of table.
+ */
+static FileTable *new_file_table(void);
+
 Branch init_master_branch() {
-    Branch master_branch = {
-            .name = (char *) safe_malloc(strlen(DEFAULT_BRANCH_NAME) +
-                                         sizeof(char)),
-            .files = (FileData *) safe_malloc(INIT_STAGING_SIZE *
-                                               sizeof(FileData)),
+    Branch master_branch = init_branch(DEFAULT_BRANCH_NAME, INIT_STAGING_SIZE);
+    index_branch_files(&master_branch);
+
+    return master_branch;
+}
+
+Branch init_branch(char *name, size_t files_len) {
+    if (!files_len) {
+        files_len = 1;
+    }
+
+    Branch b = {
+            .name = copy_string(name),
+            .files = (FileData *) safe_malloc(files_len * sizeof(FileData)),
             .n_files = 0,
-            .files_len = INIT_STAGING_SIZE,
+            .files_len = files_len,
             .commit = NULL,
+            .slots = NULL,
+            .n_slots = 0,
+            .n_paths = 0,
+            .table = new_file_table(),
     };
 
-    // set branch name
-    strcpy(master_branch.name, DEFAULT_BRANCH_NAME); // master
+    return b;
+}
 
-    return master_branch;
+Branch fork_branch(Branch *b, char *name) {
+    Branch fork = *b;
+    fork.name = copy_string(name);
+    fork.table->refs++;
+    return fork;
+}
+
+void own_branch_files(Branch *b) {
+    if (!b) {
+        return;
+    }
+
+    if (b->table->refs == 1) {
+        b->table->saved = 0;
+        return;
+    }
+
+    // other branches keep the originals, still saved, indices of files are
+    // unchanged, and the new table starts unsaved
+    b->table->refs--;
+    b->files = copy_file_data(b->files, b->n_files, b->files_len);
+    PathSlot *slots = safe_malloc(b->n_slots * sizeof(PathSlot));
+    memcpy(slots, b->slots, b->n_slots * sizeof(PathSlot));
+    b->slots = slots;
+    b->table = new_file_table();
+    return;
+}
+
+void reset_branch_files(Branch *b, size_t files_len) {
+    release_branch_files(b);
+    b->files_len = files_len ? files_len : 1;
+    b->files = safe_malloc(b->files_len * sizeof(FileData));
+    b->n_files = 0;
+    b->slots = NULL;
+    b->n_slots = 0;
+    b->n_paths = 0;
+    b->table = new_file_table();
+    return;
 }
 
 void clean_branch_files(Branch *b) {
@@ -27,20 +98,145 @@ void clean_branch_files(Branch *b) {
     size_t n_cleaned = 0;
 
     for (size_t i = 0; i < b->n_files; ++i) {
-        if (b->files[i].state == Deleted) {
-            // delete file, free name memory
-            free(b->files[i].file_path);
-        } else {
+        // drop deleted files, names are interned
+        if (b->files[i].state != Deleted) {
             files_cleaned[n_cleaned] = b->files[i];
             n_cleaned++;
         }
     }
 
-    free(b->files);
-
-    // update branch files to cleaned array
+    // update branch files to cleaned array, owned by this branch alone
+    size_t files_len = b->files_len;
+    release_branch_files(b);
     b->files = files_cleaned;
     b->n_files = n_cleaned;
+    b->files_len = files_len;
+    b->slots = NULL;
+    b->table = new_file_table();
+    index_branch_files(b);
+    return;
+}
+
+void index_branch_files(Branch *b) {
+    if (!b) {
+        return;
+    }
+    own_branch_files(b);
+
+    // table at most half full
+    free(b->slots);
+    b->n_slots = INIT_PATH_INDEX_SIZE;
+    while (b->n_slots < b->n_files * 2) {
+        b->n_slots *= 2;
+    }
+    b->slots = safe_calloc(b->n_slots, sizeof(PathSlot));
+    b->n_paths = 0;
+    for (size_t i = 0; i < b->n_files; ++i) {
+        insert_path(b, i);
+    }
+    return;
+}
+
+int64_t find_branch_file(Branch *b, const char *file_path) {
+    if (!b || !file_path) {
+        return -1;
+    }
+
+    // paths never interned are not known to any branch
+    char *interned = find_interned_path(file_path);
+    if (!interned) {
+        return -1;
+    }
+
+    uint32_t hash = (uint32_t) interned_path_hash(interned);
+    size_t mask = b->n_slots - 1;
+    for (size_t i = hash & mask; b->slots[i].file; i = (i + 1) & mask) {
+        size_t file = b->slots[i].file - 1;
+        if (b->files[file].file_path == interned) {
+            return (int64_t) file;
+        }
+    }
+
+    return -1;
+}
+
+int is_unknown_file(Branch *b, const char *file_path) {
+    int64_t i = find_branch_file(b, file_path);
+    return i < 0 || b->files[i].state == Deleted;
+}
+
+void add_branch_file(Branch *b, FileData fd) {
+    own_branch_files(b);
+
+    // add space if required
+    if (b->n_files == b->files_len) {
+        b->files = (FileData *) safe_realloc(b->files, b->files_len *
+                                             ARRAY_GROWTH_RATE *
+                                             sizeof(FileData));
+        b->files_len *= ARRAY_GROWTH_RATE;
+    }
+    b->files[b->n_files] = fd;
+    b->n_files++;
+
+    // resize index if necessary, rehashing each path
+    if ((b->n_paths + 1) * 2 > b->n_slots) {
+        PathSlot *old = b->slots;
+        size_t n_old = b->n_slots;
+        b->n_slots *= ARRAY_GROWTH_RATE;
+        b->slots = safe_calloc(b->n_slots, sizeof(PathSlot));
+        size_t mask = b->n_slots - 1;
+        for (size_t i = 0; i < n_old; ++i) {
+            if (!old[i].file) {
+                continue;
+            }
+            size_t j = old[i].hash & mask;
+            while (b->slots[j].file) {
+                j = (j + 1) & mask;
+            }
+            b->slots[j] = old[i];
+        }
+        free(old);
+    }
+    insert_path(b, b->n_files - 1);
+    return;
+}
+
+void remove_branch_file(Branch *b, size_t index) {
+    own_branch_files(b);
+    size_t mask = b->n_slots - 1;
+    size_t i = interned_path_hash(b->files[index].file_path) & mask;
+    while (b->slots[i].file && b->slots[i].file != index + 1) {
+        i = (i + 1) & mask;
+    }
+
+    // shift later slots of the probe run back over the removed slot
+    if (b->slots[i].file) {
+        size_t j = i;
+        while (1) {
+            j = (j + 1) & mask;
+            if (!b->slots[j].file) {
+                break;
+            }
+            size_t k = b->slots[j].hash & mask;
+            if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) {
+                continue;
+            }
+            b->slots[i] = b->slots[j];
+            i = j;
+        }
+        b->slots[i].file = 0;
+        b->n_paths--;
+    }
+
+    memmove(b->files + index, b->files + (index + 1),
+            (b->n_files - index - 1) * sizeof(FileData));
+    b->n_files--;
+
+    // files after index moved down, branch free so the loop vectorises
+    uint32_t removed = (uint32_t) index + 1;
+    for (size_t s = 0; s < b->n_slots; ++s) {
+        b->slots[s].file -= b->slots[s].file > removed;
+    }
     return;
 }
 
@@ -68,12 +264,46 @@ int is_valid_branch_name(char *name) {
 void free_branch(Branch b) {
     free(b.name);
 
-    // free all file data (staged files)
-    for (size_t j = 0; j < b.n_files; ++j) {
-        free(b.files[j].file_path);
+    // file paths are interned, only the arrays are freed
+    release_branch_files(&b);
+
+    return;
+}
+
+static void insert_path(Branch *b, size_t index) {
+    const char *file_path = b->files[index].file_path;
+    uint32_t hash = (uint32_t) interned_path_hash(file_path);
+    size_t mask = b->n_slots - 1;
+    size_t i = hash & mask;
+    while (b->slots[i].file) {
+        if (b->files[b->slots[i].file - 1].file_path == file_path) {
+            // same path, newer file replaces it
+            b->slots[i].file = (uint32_t) index + 1;
+            return;
+        }
+        i = (i + 1) & mask;
     }
 
-    free(b.files);
+    b->slots[i].hash = hash;
+    b->slots[i].file = (uint32_t) index + 1;
+    b->n_paths++;
+    return;
+}
 
+static void release_branch_files(Branch *b) {
+    if (--b->table->refs) {
+        return;
+    }
+
+    free(b->files);
+    free(b->slots);
+    free(b->table);
     return;
 }
+
+static FileTable *new_file_table(void) {
+    FileTable *table = safe_malloc(sizeof(FileTable));
+    table->refs = 1;
+    table->saved = 0;
+    return table;
+}
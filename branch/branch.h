@@ -5,15 +5,30 @@
 #include "../commit/commit.h"
 #include "../file_data/file_data.h"
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <regex.h>
 
+typedef struct PathSlot {
+    uint32_t hash;  // low bits of hash of path
+    uint32_t file;  // index of file + 1, 0 if slot is empty
+} PathSlot;
+
+typedef struct FileTable {
+    size_t refs;  // number of branches sharing files and path index
+    Hash saved;   // hash of saved table, 0 if changed since saved
+} FileTable;
+
 typedef struct Branch {
-    char *name;        // branch name
-    Commit *commit;    // last commit
-    FileData *files;   // files known to vc
-    size_t n_files;    // number of files known to vc
-    size_t files_len;  // files allocated length
+    char *name;         // branch name
+    Commit *commit;     // last commit
+    FileData *files;    // files known to vc
+    size_t n_files;     // number of files known to vc
+    size_t files_len;   // files allocated length
+    PathSlot *slots;    // open addressed table, newest file of each path
+    size_t n_slots;     // number of slots, power of two
+    size_t n_paths;     // number of paths in slots
+    FileTable *table;   // shared by branches with the same files and slots
 } Branch;
 
 /** @brief Creates master branch.
@@ -25,15 +40,116 @@ typedef struct Branch {
  */
 Branch init_master_branch();
 
+/** @brief Creates branch without files.
+ *
+ *  name is copied, files allocated to files_len, at least one, and owned by
+ *  the branch alone. Commit is initialised to NULL. Files MUST be indexed
+ *  once set, see index_branch_files.
+ *
+ *  @param name : null terminated branch name.
+ *  @param files_len : allocated length of files.
+ *  @return Branch.
+ */
+Branch init_branch(char *name, size_t files_len);
+
+/** @brief Creates branch sharing the files of another.
+ *
+ *  Files and path index are not copied, both branches refer to them until
+ *  either changes them, see own_branch_files, so it takes constant time
+ *  whatever the number of files. name is copied.
+ *
+ *  @param b : address of branch files are shared with.
+ *  @param name : null terminated branch name.
+ *  @return Branch sharing files of b, with the same last commit.
+ */
+Branch fork_branch(Branch *b, char *name);
+
+/** @brief Takes exclusive ownership of branch files before they change.
+ *
+ *  If files are shared with other branches, files and path index are copied,
+ *  and the other branches keep the originals. Indices of files are kept. The
+ *  table is marked as changed since saved. MUST be called before branch files
+ *  are written, other than through the functions of this module. If branch
+ *  is NULL, nothing is done.
+ *
+ *  @param b : address of branch.
+ */
+void own_branch_files(Branch *b);
+
+/** @brief Replaces branch files with an empty array.
+ *
+ *  Files are released, or left to the branches sharing them, and an array
+ *  of files_len files allocated, owned by the branch alone. Files MUST be
+ *  indexed once set, see index_branch_files.
+ *
+ *  @param b : address of branch.
+ *  @param files_len : allocated length of files.
+ */
+void reset_branch_files(Branch *b, size_t files_len);
+
 /** @brief Updates branch files.
  *
- *  Removes all deleted files. Remaining files are set to Tracked state. If
- *  branch is NULL, nothing is done.
+ *  Removes all deleted files. Remaining files are set to Tracked state, and
+ *  the path index rebuilt. Files shared with other branches are left to them.
+ *  If branch is NULL, nothing is done.
  *
  *  @param Address of branch.
  */
 void clean_branch_files(Branch *b);
 
+/** @brief Rebuilds path index of branch files.
+ *
+ *  Each path is mapped to its newest file, the file with the greatest index.
+ *  MUST be called after files are changed other than through add_branch_file
+ *  and remove_branch_file. If branch is NULL, nothing is done.
+ *
+ *  @param b : address of branch.
+ */
+void index_branch_files(Branch *b);
+
+/** @brief Finds newest branch file with path.
+ *
+ *  Path is looked up in the path index, in constant time, by the address of
+ *  its interned copy. Deleted files are found as any other file, callers
+ *  check the file state.
+ *
+ *  @param b : address of branch.
+ *  @param file_path : null terminated path.
+ *  @return index of file, -1 if not found.
+ */
+int64_t find_branch_file(Branch *b, const char *file_path);
+
+/** @brief Checks if file_path is known to branch.
+ *
+ *  If branch is NULL, or file_path is not a branch file or only a deleted
+ *  one, 1 is returned. Otherwise, 0 is returned.
+ *
+ *  @param b : address of branch.
+ *  @param file_path : null terminated path.
+ *  @return 1 if unknown, 0 if known.
+ */
+int is_unknown_file(Branch *b, const char *file_path);
+
+/** @brief Appends file to branch files.
+ *
+ *  Files are grown if necessary, and file path indexed, replacing any older
+ *  file with the same path in the index.
+ *
+ *  @param b : address of branch.
+ *  @param fd : file data, with interned path.
+ */
+void add_branch_file(Branch *b, FileData fd);
+
+/** @brief Removes file from branch files.
+ *
+ *  Path is removed from the index. Later files are moved down, keeping the
+ *  order files were added in, and their index entries updated.
+ *
+ *  @param b : address of branch.
+ *  @param index : index of file.
+ */
+void remove_branch_file(Branch *b, size_t index);
+
 /** @brief Checks if name is valid.
  *
  *  Determines if the name is a valid branch name. Validity is determined
@@ -49,8 +165,9 @@ int is_valid_branch_name(char *name);
 
 /** @brief Releases unique branch memory.
  *
- *  Frees all allocated memory that is UNIQUE to the branch: Name and Files.
- *  Commit is NOT released!
+ *  Frees all allocated memory that is UNIQUE to the branch: Name, and files
+ *  and path index unless shared with another branch. Commit and interned
+ *  file paths are NOT released!
  *
  *  @param Branch value.
  */
@@ -0,0 +1,93 @@
+#include "chunk.h"
+
+// mask bits above and below the average chunk size
+#define CHUNK_MASK_S (~0ULL << (64 - CHUNK_AVG_BITS - 2))
+#define CHUNK_MASK_L (~0ULL << (64 - CHUNK_AVG_BITS + 2))
+
+// gear table, random value per byte
+static uint64_t gear[256];
+static pthread_once_t gear_once = PTHREAD_ONCE_INIT;
+
+/** @brief Fills gear table from a fixed seed.
+ *
+ *  The seed is fixed so chunk boundaries, and so stored chunks, are the same
+ *  in every process.
+ */
+static void init_gear(void);
+
+void init_chunker(Chunker *ch, chunk_fn emit, void *ctx) {
+    pthread_once(&gear_once, init_gear);
+    ch->fp = 0;
+    ch->buf = safe_malloc(CHUNK_MAX_SIZE);
+    ch->len = 0;
+    ch->emit = emit;
+    ch->ctx = ctx;
+    return;
+}
+
+void chunker_update(Chunker *ch, const char *data, size_t len) {
+    const unsigned char *p = (const unsigned char *) data;
+    while (len) {
+        size_t n = ch->len;
+        uint64_t fp = ch->fp;
+        size_t i = 0;
+        int cut = 0;
+
+        // bytes below the minimum size can not be a boundary, skip hashing
+        if (n < CHUNK_MIN_SIZE) {
+            i = CHUNK_MIN_SIZE - n < len ? CHUNK_MIN_SIZE - n : len;
+            n += i;
+        }
+        while (i < len) {
+            fp = (fp << 1) + gear[p[i++]];
+            ++n;
+            if (!(fp & (n <= (1 << CHUNK_AVG_BITS) ? CHUNK_MASK_S :
+                        CHUNK_MASK_L)) || n == CHUNK_MAX_SIZE) {
+                cut = 1;
+                break;
+            }
+        }
+
+        if (cut && !ch->len) {
+            // whole chunk in data, no copy required
+            ch->emit(ch->ctx, (const char *) p, i);
+        } else {
+            memcpy(ch->buf + ch->len, p, i);
+            ch->len = n;
+            ch->fp = fp;
+            if (cut) {
+                ch->emit(ch->ctx, ch->buf, ch->len);
+            }
+        }
+        if (cut) {
+            ch->len = 0;
+            ch->fp = 0;
+        }
+        p += i;
+        len -= i;
+    }
+    return;
+}
+
+void chunker_final(Chunker *ch) {
+    if (ch->len) {
+        ch->emit(ch->ctx, ch->buf, ch->len);
+    }
+    free(ch->buf);
+    ch->buf = NULL;
+    ch->len = 0;
+    return;
+}
+
+static void init_gear(void) {
+    // splitmix64
+    uint64_t x = 0x5643534348554e4bULL;
+    for (size_t i = 0; i < 256; ++i) {
+        x += 0x9e3779b97f4a7c15ULL;
+        uint64_t z = x;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        gear[i] = z ^ (z >> 31);
+    }
+    return;
+}
@@ -0,0 +1,62 @@
+#ifndef ASSIGNMENT_2_SVC_CHUNK_H
+#define ASSIGNMENT_2_SVC_CHUNK_H
+
+#include "../params.h"
+#include "../memory/memory.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+/** @brief Receives a chunk cut by the chunker.
+ *
+ *  Chunk bytes are only valid for the duration of the call.
+ *
+ *  @param ctx : caller context.
+ *  @param chunk : chunk bytes.
+ *  @param len : length of chunk.
+ */
+typedef void (*chunk_fn)(void *ctx, const char *chunk, size_t len);
+
+typedef struct Chunker {
+    uint64_t fp;    // gear fingerprint of current chunk
+    char *buf;      // bytes of current chunk, CHUNK_MAX_SIZE capacity
+    size_t len;     // number of bytes in current chunk
+    chunk_fn emit;  // called for each chunk cut
+    void *ctx;      // context passed to emit
+} Chunker;
+
+/** @brief Initialises content defined chunker.
+ *
+ *  Chunk boundaries are cut where a gear rolling hash of the last 64 bytes
+ *  matches a mask, so boundaries move with the content, and an edit only
+ *  changes the chunks around it. Chunks are between CHUNK_MIN_SIZE and
+ *  CHUNK_MAX_SIZE bytes (params.h). As in FastCDC, bytes below the minimum
+ *  are not hashed, and a stricter mask is used below the average size of
+ *  2^CHUNK_AVG_BITS bytes than above it, narrowing the size distribution.
+ *
+ *  Chunker MUST be finished with chunker_final.
+ *
+ *  @param ch : address of chunker.
+ *  @param emit : called for each chunk, in order.
+ *  @param ctx : context passed to emit.
+ */
+void init_chunker(Chunker *ch, chunk_fn emit, void *ctx);
+
+/** @brief Adds bytes to chunker.
+ *
+ *  Complete chunks are passed to emit as they are cut.
+ *
+ *  @param ch : address of chunker.
+ *  @param data : bytes to be chunked.
+ *  @param len : number of bytes.
+ */
+void chunker_update(Chunker *ch, const char *data, size_t len);
+
+/** @brief Emits remaining bytes as the last chunk, and releases chunker.
+ *
+ *  @param ch : address of chunker.
+ */
+void chunker_final(Chunker *ch);
+
+#endif //ASSIGNMENT_2_SVC_CHUNK_H
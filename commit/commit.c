@@ -1,20 +1,43 @@
 #include "commit.h"
 
-Commit *init_commit(char *message, size_t commit_record_len, size_t branch_id) {
+/** @brief Compares snapshot pairs by path.
+ *
+ *  @param a : address of snapshot pair.
+ *  @param b : address of snapshot pair.
+ *  @return strcmp of paths.
+ */
+static int compare_change_path(const void *a, const void *b);
+
+Commit *init_commit(char *message, size_t commit_record_len, size_t branch_id,
+                    Snapshot *base) {
     if (!message) {
         return NULL;
     }
 
-    Commit *commit = (Commit *) safe_malloc(sizeof(Commit));
+    if (!commit_record_len) {
+        commit_record_len = 1;
+    }
+
+    // commit lives in its own arena, with room for its records, and
+    // alignment of each of the three allocations
+    Arena arena;
+    init_arena(&arena, sizeof(Commit) + strlen(message) + 1 +
+                       commit_record_len * sizeof(CommitRecord) +
+                       3 * alignof(max_align_t));
+    Commit *commit = (Commit *) arena_alloc(&arena, sizeof(Commit));
+    commit->arena = arena;
     commit->id = NULL;
-    commit->message = copy_string(message);
+    commit->index = 0;
+    commit->message = arena_copy_string(&commit->arena, message);
     commit->branch_id = branch_id;
-    commit->commit_record = safe_malloc(commit_record_len * sizeof(CommitRecord));
+    commit->commit_record = arena_alloc(&commit->arena, commit_record_len *
+                                        sizeof(CommitRecord));
     commit->record_len = commit_record_len;
     commit->n_record = 0;
     commit->parent_commits = NULL;
     commit->n_parent_commits = 0;
-    commit->snapshot = init_snapshot();
+    commit->snapshot = init_snapshot(base);
+    commit->tree = 0;
 
     return commit;
 }
@@ -47,7 +70,7 @@ char *generate_commit_id(Commit *commit) {
     }
 
     // char array, max size
-    char *id_hex = safe_malloc((16) * sizeof(char));
+    char *id_hex = arena_alloc(&commit->arena, (16) * sizeof(char));
     snprintf(id_hex, 16, "%06llx", id);
 
     return id_hex;
@@ -61,67 +84,60 @@ int commit_deleted_file(Commit *commit, char *file_path) {
     if (!commit || !file_path) {
         return -1;
     }
+    remove_file_snapshot(&commit->snapshot, file_path);
+
     // resize
     resize_commit_record(commit);
-    commit->commit_record[commit->n_record].file_name = copy_string(file_path);
+    commit->commit_record[commit->n_record].file_name = file_path;
     commit->commit_record[commit->n_record].change_type = Remove;
     commit->n_record++;
     return 0;
 }
 
-int commit_staged_file(Commit *commit, char *file_path) {
+int commit_staged_file(Commit *commit, char *file_path, Hash hash) {
     if (!commit || !file_path) {
         return -1;
     }
 
-    // hash and copy file contents
-    char *file_cpy = NULL;
-    size_t file_cpy_len = 0;
-    int hash = hash_and_copy_file(file_path, &file_cpy, &file_cpy_len);
+    // create snapshot of files
+    if (new_file_snapshot(&commit->snapshot, file_path, hash) == -1) {
+        return -1;
+    }
 
     // resize
     resize_commit_record(commit);
 
     // initialise commit record
-    commit->commit_record[commit->n_record].file_name = copy_string(file_path);
+    commit->commit_record[commit->n_record].file_name = file_path;
     commit->commit_record[commit->n_record].change_type = Add;
     commit->commit_record[commit->n_record].hash_change.new_hash = hash;
     commit->n_record++;
-
-    // create snapshot of files
-    new_file_snapshot(&commit->snapshot, file_path, hash, file_cpy, file_cpy_len);
-
-    // release file copy
-    free(file_cpy);
-
-    return hash;
+    return 0;
 }
 
 
-int commit_tracked_file(Commit *commit, char *file_path, int old_hash) {
+int commit_tracked_file(Commit *commit, char *file_path, Hash old_hash,
+                        Hash new_hash) {
     if (!commit || !file_path) {
         return -1;
     }
 
-    // hash file contents and copy into array
-    char *file_cpy = NULL;
-    size_t file_cpy_len = 0;
-    int hash = hash_and_copy_file(file_path, &file_cpy, &file_cpy_len);
+    if (new_file_snapshot(&commit->snapshot, file_path, new_hash) == -1) {
+        return -1;
+    }
 
-    if (hash != old_hash) {
+    if (new_hash != old_hash) {
         // resize
         resize_commit_record(commit);
         // record change
-        commit->commit_record[commit->n_record].file_name = copy_string(file_path);
+        commit->commit_record[commit->n_record].file_name = file_path;
         commit->commit_record[commit->n_record].change_type = Change;
         commit->commit_record[commit->n_record].hash_change.old_hash = old_hash;
-        commit->commit_record[commit->n_record].hash_change.new_hash = hash;
+        commit->commit_record[commit->n_record].hash_change.new_hash = new_hash;
         commit->n_record++;
     }
 
-    new_file_snapshot(&commit->snapshot, file_path, hash, file_cpy, file_cpy_len);
-    free(file_cpy);
-    return hash;
+    return 0;
 }
 
 int compare_commit_record_name(const void *a, const void *b) {
@@ -141,37 +157,78 @@ int compare_commit_record_name(const void *a, const void *b) {
 void resize_commit_record(Commit *commit) {
     // resize only if necessary
     if (commit->n_record == commit->record_len) {
-        commit->commit_record = safe_realloc(commit->commit_record,
-                                        commit->record_len *
-                                              ARRAY_GROWTH_RATE *
-                                              sizeof(char *));
+        commit->commit_record = arena_grow(&commit->arena,
+                                           commit->commit_record,
+                                           commit->record_len *
+                                           sizeof(CommitRecord),
+                                           commit->record_len *
+                                           ARRAY_GROWTH_RATE *
+                                           sizeof(CommitRecord));
         commit->record_len *= ARRAY_GROWTH_RATE;
     }
 
     return;
 }
 
+int write_commit_tree(Commit *commit, Commit *parent) {
+    if (!commit) {
+        return -1;
+    }
+
+    size_t n_changes = 0;
+    SnapshotPair *changes = NULL;
+    if (parent && !parent->tree) {
+        // parent predates trees, whole snapshot is written once
+        changes = pair_snapshots(NULL, &commit->snapshot, &n_changes);
+    } else {
+        // records name every path changed since parent
+        changes = safe_malloc((commit->n_record + 1) * sizeof(SnapshotPair));
+        for (size_t i = 0; i < commit->n_record; ++i) {
+            char *name = commit->commit_record[i].file_name;
+            SnapshotPair p = {
+                    parent ? find_file_snapshot(&parent->snapshot, name) : NULL,
+                    find_file_snapshot(&commit->snapshot, name)
+            };
+            if ((p.from || p.to) &&
+                (!p.from || !p.to || p.from->hash != p.to->hash)) {
+                changes[n_changes++] = p;
+            }
+        }
+        qsort(changes, n_changes, sizeof(SnapshotPair), compare_change_path);
+
+        // a path removed then added again has a record for each, one change
+        size_t n_unique = 0;
+        for (size_t i = 0; i < n_changes; ++i) {
+            if (!n_unique || compare_change_path(&changes[n_unique - 1],
+                                                 &changes[i]) != 0) {
+                changes[n_unique++] = changes[i];
+            }
+        }
+        n_changes = n_unique;
+    }
+
+    int ret = write_tree(parent ? parent->tree : 0, changes, n_changes,
+                         &commit->tree);
+    free(changes);
+    return ret;
+}
+
 void free_commit(Commit *c) {
     if (!c) {
         return;
     }
 
-    free(c->id);
-    free(c->message);
-    free(c->parent_commits);
+    free_snapshot(&c->snapshot);
 
-    // free commit records
-    for (size_t j = 0; j < c->n_record; ++j) {
-        free(c->commit_record[j].file_name);
-    }
-    free(c->commit_record);
-
-    // free snapshot
-    for (size_t j = 0; j < c->snapshot.n_files; ++j) {
-        free(c->snapshot.file_snapshots[j].name);
-    }
-    free(c->snapshot.file_snapshots);
-    free(c);
+    // commit is in its own arena, release from a copy
+    Arena arena = c->arena;
+    free_arena(&arena);
 
     return;
-}
\ No newline at end of file
+}
+static int compare_change_path(const void *a, const void *b) {
+    const SnapshotPair *pa = (const SnapshotPair *) a;
+    const SnapshotPair *pb = (const SnapshotPair *) b;
+    return strcmp(pa->to ? pa->to->name : pa->from->name,
+                  pb->to ? pb->to->name : pb->from->name);
+}
@@ -2,6 +2,7 @@
 #define ASSIGNMENT_2_SVC_COMMIT_H
 
 #include "../snapshot/snapshot.h"
+#include "../tree/tree.h"
 #include "../file_data/file_data.h"
 #include <stdio.h>
 #include <string.h>
@@ -9,47 +10,59 @@
 enum CommitChangeType {Add = 0, Remove = 1, Change = 2};
 
 typedef struct HashChange {
-    int old_hash; // snapshot of previous version
-    int new_hash; // snapshot of revision
+    Hash old_hash; // snapshot of previous version
+    Hash new_hash; // snapshot of revision
 } HashChange;
 
 typedef struct CommitRecord {
-    char *file_name;                   // file name, null terminated
+    char *file_name;                   // interned file name, do NOT free
     enum CommitChangeType change_type; // type of change committed
     HashChange hash_change;            // only used for changed files
 } CommitRecord;
 
 typedef struct Commit {
     char *id;                        // null terminated commit id (hex)
+    size_t index;                    // position in order of creation
     size_t branch_id;                // id of branch
     char *message;                   // null terminated message
     CommitRecord *commit_record;     // record of all file changes committed
     size_t n_record;                 // number of commit records
     size_t record_len;               // allocated length of commit_record
-    struct Commit **parent_commits;  // address of parent commits
+    size_t *parent_commits;          // indices of parent commits
     size_t n_parent_commits;         // number of parent commits
     Snapshot snapshot;               // snapshot of current state of tracked files
+    Hash tree;                       // hash of root tree, 0 if not written
+    Arena arena;                     // commit, and memory it refers to
 } Commit;
 
 /** @brief Initialises commit instance.
  *
  *  Initialises commit instance. Parameters located in params.h. id and
  *  parent_commit fields initialised to NULL. message is copied. Allocates
- *  commit_record_len sized commit record. Allocates snapshot of size to
- *  INIT_SNAPSHOT_SIZE. All number fields set to 0.
+ *  commit_record_len sized commit record. Snapshot starts as a copy of base,
+ *  sharing its tree, see init_snapshot. All number fields, and the tree hash,
+ *  set to 0.
+ *
+ *  The commit, and everything it refers to but its snapshot, is allocated
+ *  from one arena, sized for commit_record_len records. Id and parents of
+ *  the commit MUST be allocated from its arena, so the whole commit is
+ *  released at once. File names are interned, see intern_path, and shared
+ *  with every other commit and branch.
  *
  *  @param message : null terminated commit message.
  *  @param commit_record_len : initialised size of commit_record.
  *  @param branch_id : id of branch commit is associated with.
+ *  @param base : address of snapshot of parent commit, may be NULL.
  *  @return Commit address.
  */
-Commit *init_commit(char *message, size_t commit_record_len, size_t branch_id);
+Commit *init_commit(char *message, size_t commit_record_len, size_t branch_id,
+                    Snapshot *base);
 
 /** @brief Generates commit hex id.
  *
  *  If commit or message are NULL, NULL is returned. Id is calculated and
  *  returned as 6 or greater character null terminated hex string, allocated
- *  dynamically.
+ *  from the commit arena, and released with the commit.
  *
  *  @param commit : commit address.
  *  @return Null terminated commit id (hex) string.
@@ -80,11 +93,12 @@ int compare_commit_record_name(const void *a, const void *b);
  *
  *  If commit or file_path are NULL, nothing is done. Commit record field
  *  is re-allocated if necessary. New record with name file_path and change
- *  type Remove is added to next available index. file_path is copied, and must
- *  be released. n_records is incremented.
+ *  type Remove is added to next available index, and file_path removed from
+ *  the snapshot. file_path is referenced, not copied. n_records is
+ *  incremented.
  *
  *  @param commit : address of commit instance
- *  @param file_path : Null terminated file path
+ *  @param file_path : Null terminated file path, interned
  *  @return 0 if successful, -1 otherwise.
  */
 int commit_deleted_file(Commit *commit, char *file_path);
@@ -93,39 +107,60 @@ int commit_deleted_file(Commit *commit, char *file_path);
  *
  *  If commit or file path are NULL, nothing is done and -1 is returned. Commit
  *  record field is resized if necessary. New record with file_path is added to
- *  next available index, with change set to Add. Snapshot of file is taken.
+ *  next available index, with change set to Add. Snapshot of file is taken,
+ *  replacing any snapshot of file_path inherited from the parent commit.
+ *  File is not read, contents must already be stored with store_file_snapshot.
  *
  *  @param commit : address of commit instance
- *  @param file_path : Null terminated file path
- *  @return hash of file if successful, -1 otherwise.
+ *  @param file_path : Null terminated file path, interned
+ *  @param hash : hash of stored file.
+ *  @return 0 if successful, -1 otherwise.
  */
-int commit_staged_file(Commit *commit, char *file_path);
+int commit_staged_file(Commit *commit, char *file_path, Hash hash);
 
 /** @brief Commits tracked file.
  *
  *  If commit or file path are NULL, nothing is done and -1 is returned. Commit
- *  record field is resized if necessary. Hash is recalculated, and commit record
- *  with Change type is created if different to last known hash. Snapshot is taken
- *  regardless.
+ *  record field is resized if necessary. Commit record with Change type is
+ *  created if new hash is different to last known hash. Snapshot is taken
+ *  regardless. File is not read, contents must already be stored with
+ *  store_file_snapshot.
  *
  *  @param commit : address of commit instance
- *  @param file_path : Null terminated file path
- *  @return hash of file if successful, -1 otherwise.
+ *  @param file_path : Null terminated file path, interned
+ *  @param old_hash : last known hash of file.
+ *  @param new_hash : hash of stored file.
+ *  @return 0 if successful, -1 otherwise.
  */
-int commit_tracked_file(Commit *commit, char *file_path, int old_hash);
+int commit_tracked_file(Commit *commit, char *file_path, Hash old_hash,
+                        Hash new_hash);
 
 /** @brief Resizes commit record if full.
  *
  *  If commit record is full, size is increased by factor ARRAY_GROWTH_RATE,
- *  specified in params.h.
+ *  specified in params.h, in the commit arena.
  *
  *  @param commit : address of commit instance
  */
 void resize_commit_record(Commit *commit);
 
+/** @brief Writes root tree of commit, see write_tree.
+ *
+ *  Only directories holding files recorded by the commit are written, on top
+ *  of the tree of parent, so the cost depends on the files changed. If parent
+ *  has no tree, the whole snapshot is written. Records and snapshot MUST be
+ *  complete. Sets the tree field of commit.
+ *
+ *  @param commit : address of commit instance.
+ *  @param parent : address of commit the snapshot was based on, may be NULL.
+ *  @return 0 if successful, -1 otherwise.
+ */
+int write_commit_tree(Commit *commit, Commit *parent);
+
 /** @brief Releases memory associated with commit.
  *
- *  Frees all memory associated with commit, and commit itself.
+ *  Frees all memory associated with commit, and commit itself, by releasing
+ *  the commit snapshot and arena. If commit is NULL, nothing is done.
  *
  *  @param commit : address of commit instance
  */
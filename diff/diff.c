@@ -0,0 +1,608 @@
+#include "diff.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define DIFF_X86 1
+#endif
+
+#define LINE_PRIME_1 0x9E3779B185EBCA87ULL
+#define LINE_PRIME_2 0xC2B2AE3D27D4EB4FULL
+
+typedef struct LineSlot {
+    uint32_t hash;  // hash of line
+    uint32_t id;    // id given to the contents, 0 if slot is empty
+} LineSlot;
+
+typedef struct LineRef {
+    const char *line;  // first line seen with the contents
+    size_t len;        // length of line
+} LineRef;
+
+typedef struct DiffState {
+    const uint32_t *a;   // ids of lines of a
+    const uint32_t *b;   // ids of lines of b
+    ptrdiff_t *forward;  // furthest x of each diagonal, searching forward
+    ptrdiff_t *reverse;  // furthest x of each diagonal, searching backward
+    DiffChunk *chunks;   // chunks found, in line order
+    size_t n_chunks;     // number of chunks
+    size_t len_chunks;   // capacity of chunks
+} DiffState;
+
+/** @brief Finds newlines in a 64 byte block.
+ *
+ *  @param p : address of block.
+ *  @return mask with bit i set if byte i is '\n'.
+ */
+static inline uint64_t find_newlines(const char *p);
+
+/** @brief Hashes line, for numbering lines only.
+ *
+ *  @param p : address of line.
+ *  @param len : length of line.
+ *  @return 32 bit hash.
+ */
+static inline uint32_t hash_line(const char *p, size_t len);
+
+/** @brief Diffs lines a_start to a_end of a with b_start to b_end of b.
+ *
+ *  @param d : address of diff state.
+ *  @param a_start : first line of a.
+ *  @param a_end : line of a after the last.
+ *  @param b_start : first line of b.
+ *  @param b_end : line of b after the last.
+ */
+static void diff_range(DiffState *d, size_t a_start, size_t a_end,
+                       size_t b_start, size_t b_end);
+
+/** @brief Finds the middle snake of the shortest edit between two ranges.
+ *
+ *  Ranges MUST differ in their first and last lines.
+ *
+ *  @param d : address of diff state.
+ *  @param a_start : first line of a.
+ *  @param n : number of lines of a.
+ *  @param b_start : first line of b.
+ *  @param m : number of lines of b.
+ *  @param x : address for line of a starting the snake to be set, from a_start.
+ *  @param y : address for line of b starting the snake to be set, from b_start.
+ */
+static void find_middle_snake(DiffState *d, size_t a_start, size_t n,
+                              size_t b_start, size_t m, size_t *x, size_t *y);
+
+/** @brief Appends chunk, joining it to the last chunk if adjacent.
+ *
+ *  @param d : address of diff state.
+ *  @param chunk : chunk.
+ */
+static void add_chunk(DiffState *d, DiffChunk chunk);
+
+/** @brief Appends lines of text to text buffer.
+ *
+ *  @param b : address of text buffer.
+ *  @param t : address of text.
+ *  @param start : first line.
+ *  @param end : line after the last.
+ */
+static void put_lines(TextBuffer *b, Text *t, size_t start, size_t end);
+
+/** @brief Appends lines of text to text buffer, each after a prefix.
+ *
+ *  @param b : address of text buffer.
+ *  @param prefix : character put before each line.
+ *  @param t : address of text.
+ *  @param start : first line.
+ *  @param end : line after the last.
+ */
+static void put_prefixed_lines(TextBuffer *b, char prefix, Text *t,
+                               size_t start, size_t end);
+
+/** @brief Checks if line ranges of two texts are equal.
+ *
+ *  @param a : address of text.
+ *  @param a_start : first line of a.
+ *  @param a_end : line of a after the last.
+ *  @param b : address of text.
+ *  @param b_start : first line of b.
+ *  @param b_end : line of b after the last.
+ *  @return 1 if equal, 0 otherwise.
+ */
+static int equal_lines(Text *a, size_t a_start, size_t a_end, Text *b,
+                       size_t b_start, size_t b_end);
+
+void init_text(Text *t, const char *data, size_t len) {
+    t->data = data;
+    t->len = len;
+
+    // count lines, a last line without a newline included
+    size_t n_blocks = len / 64;
+    size_t n_lines = 0;
+    for (size_t i = 0; i < n_blocks; ++i) {
+        n_lines += (size_t) __builtin_popcountll(find_newlines(data + 64 * i));
+    }
+    for (size_t i = n_blocks * 64; i < len; ++i) {
+        n_lines += data[i] == '\n';
+    }
+    n_lines += len && data[len - 1] != '\n';
+
+    t->n_lines = n_lines;
+    t->lines = safe_malloc((n_lines + 1) * sizeof(size_t));
+    t->hashes = safe_malloc((n_lines + 1) * sizeof(uint32_t));
+    t->ids = safe_calloc(n_lines + 1, sizeof(uint32_t));
+    size_t n = 0;
+    size_t start = 0;
+    for (size_t i = 0; i < n_blocks; ++i) {
+        uint64_t mask = find_newlines(data + 64 * i);
+        for (; mask; mask &= mask - 1) {
+            size_t end = 64 * i + (size_t) __builtin_ctzll(mask) + 1;
+            t->lines[n] = start;
+            t->hashes[n++] = hash_line(data + start, end - start);
+            start = end;
+        }
+    }
+    for (size_t i = n_blocks * 64; i < len; ++i) {
+        if (data[i] == '\n') {
+            t->lines[n] = start;
+            t->hashes[n++] = hash_line(data + start, i + 1 - start);
+            start = i + 1;
+        }
+    }
+    if (start < len) {
+        t->lines[n] = start;
+        t->hashes[n++] = hash_line(data + start, len - start);
+    }
+    t->lines[n_lines] = len;
+    t->hashes[n_lines] = 0;
+    return;
+}
+
+void free_text(Text *t) {
+    if (!t) {
+        return;
+    }
+
+    free(t->lines);
+    free(t->hashes);
+    free(t->ids);
+    t->lines = NULL;
+    t->hashes = NULL;
+    t->ids = NULL;
+    t->n_lines = 0;
+    return;
+}
+
+void number_lines(Text **texts, size_t n_texts) {
+    size_t n_lines = 0;
+    for (size_t i = 0; i < n_texts; ++i) {
+        n_lines += texts[i]->n_lines;
+    }
+
+    // table at most half full, ids start at 1
+    size_t n_slots = INIT_PATH_INDEX_SIZE;
+    while (n_slots < n_lines * 2) {
+        n_slots *= 2;
+    }
+
+    // slots kept small so the table stays in cache, lines are kept by id
+    LineSlot *slots = safe_calloc(n_slots, sizeof(LineSlot));
+    LineRef *refs = safe_malloc((n_lines + 1) * sizeof(LineRef));
+    size_t mask = n_slots - 1;
+    uint32_t next_id = 1;
+    for (size_t i = 0; i < n_texts; ++i) {
+        Text *t = texts[i];
+        for (size_t j = 0; j < t->n_lines; ++j) {
+            const char *line = t->data + t->lines[j];
+            size_t len = t->lines[j + 1] - t->lines[j];
+            uint32_t hash = t->hashes[j];
+            size_t s = hash & mask;
+            while (slots[s].id && (slots[s].hash != hash ||
+                   refs[slots[s].id].len != len ||
+                   memcmp(refs[slots[s].id].line, line, len))) {
+                s = (s + 1) & mask;
+            }
+            if (!slots[s].id) {
+                refs[next_id] = (LineRef) {line, len};
+                slots[s] = (LineSlot) {hash, next_id++};
+            }
+            t->ids[j] = slots[s].id;
+        }
+    }
+
+    free(refs);
+    free(slots);
+    return;
+}
+
+DiffChunk *diff_texts(Text *a, Text *b, size_t *n_chunks) {
+    if (!a || !b || !n_chunks) {
+        return NULL;
+    }
+
+    // diagonals of the largest range, offset so the least is at index 1
+    size_t n_diagonals = 2 * (a->n_lines + b->n_lines) + 3;
+    DiffState d = {
+            .a = a->ids,
+            .b = b->ids,
+            .forward = safe_malloc(n_diagonals * sizeof(ptrdiff_t)),
+            .reverse = safe_malloc(n_diagonals * sizeof(ptrdiff_t)),
+            .chunks = NULL,
+            .n_chunks = 0,
+            .len_chunks = 0,
+    };
+    diff_range(&d, 0, a->n_lines, 0, b->n_lines);
+
+    free(d.forward);
+    free(d.reverse);
+    *n_chunks = d.n_chunks;
+    return d.chunks;
+}
+
+DiffHunk *group_hunks(Text *a, DiffChunk *chunks, size_t n_chunks,
+                      size_t context, size_t *n_hunks) {
+    if (!a || !n_hunks) {
+        return NULL;
+    }
+    *n_hunks = 0;
+    if (!chunks || !n_chunks) {
+        return NULL;
+    }
+
+    DiffHunk *hunks = safe_malloc(n_chunks * sizeof(DiffHunk));
+    for (size_t i = 0; i < n_chunks; ) {
+        size_t first = i++;
+        while (i < n_chunks &&
+               chunks[i].a_start - chunks[i - 1].a_end <= 2 * context) {
+            i++;
+        }
+
+        // common lines around chunks are as many in a as in b
+        DiffChunk *head = &chunks[first];
+        DiffChunk *tail = &chunks[i - 1];
+        size_t before = head->a_start < context ? head->a_start : context;
+        size_t after = a->n_lines - tail->a_end < context ?
+                       a->n_lines - tail->a_end : context;
+        hunks[(*n_hunks)++] = (DiffHunk) {
+                head->a_start - before, tail->a_end + after,
+                head->b_start - before, tail->b_end + after, first, i
+        };
+    }
+    return hunks;
+}
+
+void put_text(TextBuffer *buf, const char *data, size_t len) {
+    if (buf->len + len > buf->cap) {
+        buf->cap = (buf->len + len) * ARRAY_GROWTH_RATE;
+        buf->data = safe_realloc(buf->data, buf->cap);
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    return;
+}
+
+void put_unified_diff(TextBuffer *buf, Text *a, Text *b, DiffChunk *chunks,
+                      size_t n_chunks, size_t context) {
+    size_t n_hunks = 0;
+    DiffHunk *hunks = group_hunks(a, chunks, n_chunks, context, &n_hunks);
+    for (size_t h = 0; h < n_hunks; ++h) {
+        // empty ranges are numbered from the line before them
+        DiffHunk *hunk = &hunks[h];
+        size_t a_len = hunk->a_end - hunk->a_start;
+        size_t b_len = hunk->b_end - hunk->b_start;
+        char header[96];
+        int len = snprintf(header, sizeof(header),
+                           "@@ -%zu,%zu +%zu,%zu @@\n",
+                           hunk->a_start + (a_len != 0), a_len,
+                           hunk->b_start + (b_len != 0), b_len);
+        put_text(buf, header, (size_t) len);
+
+        size_t pos = hunk->a_start;
+        for (size_t i = hunk->chunk_start; i < hunk->chunk_end; ++i) {
+            put_prefixed_lines(buf, ' ', a, pos, chunks[i].a_start);
+            put_prefixed_lines(buf, '-', a, chunks[i].a_start,
+                               chunks[i].a_end);
+            put_prefixed_lines(buf, '+', b, chunks[i].b_start,
+                               chunks[i].b_end);
+            pos = chunks[i].a_end;
+        }
+        put_prefixed_lines(buf, ' ', a, pos, hunk->a_end);
+    }
+
+    free(hunks);
+    return;
+}
+
+int merge_texts(Text *base, Text *ours, Text *theirs, char **merged,
+                size_t *merged_len, MergeHunk **conflicts,
+                size_t *n_conflicts) {
+    size_t n_a = 0;
+    size_t n_b = 0;
+    DiffChunk *a = diff_texts(base, ours, &n_a);
+    DiffChunk *b = diff_texts(base, theirs, &n_b);
+
+    TextBuffer out = {NULL, 0, 0};
+    size_t len_conflicts = 0;
+    *conflicts = NULL;
+    *n_conflicts = 0;
+
+    // lines outside chunks match base, offset by the lines changed before
+    ptrdiff_t a_offset = 0;
+    ptrdiff_t b_offset = 0;
+    size_t pos = 0;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < n_a || j < n_b) {
+        // group chunks of either side touching the base range
+        size_t a_first = i;
+        size_t b_first = j;
+        int from_a = j == n_b || (i < n_a && a[i].a_start <= b[j].a_start);
+        size_t start = from_a ? a[i].a_start : b[j].a_start;
+        size_t end = start;
+        int grown = 1;
+        while (grown) {
+            grown = 0;
+            for (; i < n_a && a[i].a_start <= end; ++i, grown = 1) {
+                end = a[i].a_end > end ? a[i].a_end : end;
+            }
+            for (; j < n_b && b[j].a_start <= end; ++j, grown = 1) {
+                end = b[j].a_end > end ? b[j].a_end : end;
+            }
+        }
+        put_lines(&out, base, pos, start);
+        pos = end;
+
+        // range of each side replacing base lines start to end
+        size_t a_start = (size_t) ((ptrdiff_t) start + a_offset);
+        size_t a_end = (size_t) ((ptrdiff_t) end + a_offset);
+        if (i > a_first) {
+            a_start = a[a_first].b_start - (a[a_first].a_start - start);
+            a_end = a[i - 1].b_end + (end - a[i - 1].a_end);
+            a_offset = (ptrdiff_t) a[i - 1].b_end - (ptrdiff_t) a[i - 1].a_end;
+        }
+        size_t b_start = (size_t) ((ptrdiff_t) start + b_offset);
+        size_t b_end = (size_t) ((ptrdiff_t) end + b_offset);
+        if (j > b_first) {
+            b_start = b[b_first].b_start - (b[b_first].a_start - start);
+            b_end = b[j - 1].b_end + (end - b[j - 1].a_end);
+            b_offset = (ptrdiff_t) b[j - 1].b_end - (ptrdiff_t) b[j - 1].a_end;
+        }
+
+        if (j == b_first || equal_lines(ours, a_start, a_end, theirs, b_start,
+                                        b_end)) {
+            put_lines(&out, ours, a_start, a_end);
+        } else if (i == a_first) {
+            put_lines(&out, theirs, b_start, b_end);
+        } else {
+            // both sides changed the range differently
+            if (*n_conflicts == len_conflicts) {
+                len_conflicts = len_conflicts ? len_conflicts *
+                                                ARRAY_GROWTH_RATE : 4;
+                *conflicts = safe_realloc(*conflicts, len_conflicts *
+                                                      sizeof(MergeHunk));
+            }
+            (*conflicts)[(*n_conflicts)++] = (MergeHunk) {
+                    start, end, a_start, a_end, b_start, b_end
+            };
+        }
+    }
+    put_lines(&out, base, pos, base->n_lines);
+    free(a);
+    free(b);
+
+    if (*n_conflicts) {
+        free(out.data);
+        *merged = NULL;
+        *merged_len = 0;
+        return 1;
+    }
+    *merged = out.data ? out.data : safe_malloc(1);
+    *merged_len = out.len;
+    return 0;
+}
+
+static void diff_range(DiffState *d, size_t a_start, size_t a_end,
+                       size_t b_start, size_t b_end) {
+    // common lines at either end are never part of an edit
+    while (a_start < a_end && b_start < b_end &&
+           d->a[a_start] == d->b[b_start]) {
+        a_start++;
+        b_start++;
+    }
+    while (a_start < a_end && b_start < b_end &&
+           d->a[a_end - 1] == d->b[b_end - 1]) {
+        a_end--;
+        b_end--;
+    }
+
+    if (a_start == a_end || b_start == b_end) {
+        if (a_start != a_end || b_start != b_end) {
+            add_chunk(d, (DiffChunk) {a_start, a_end, b_start, b_end});
+        }
+        return;
+    }
+
+    // both halves are shorter edits, refined in line order
+    size_t x = 0;
+    size_t y = 0;
+    find_middle_snake(d, a_start, a_end - a_start, b_start, b_end - b_start,
+                      &x, &y);
+    diff_range(d, a_start, a_start + x, b_start, b_start + y);
+    diff_range(d, a_start + x, a_end, b_start + y, b_end);
+    return;
+}
+
+static void find_middle_snake(DiffState *d, size_t a_start, size_t n,
+                              size_t b_start, size_t m, size_t *x, size_t *y) {
+    const uint32_t *a = d->a + a_start;
+    const uint32_t *b = d->b + b_start;
+    ptrdiff_t N = (ptrdiff_t) n;
+    ptrdiff_t M = (ptrdiff_t) m;
+    ptrdiff_t delta = N - M;
+    int odd = (int) (delta & 1);
+    ptrdiff_t max = (N + M + 1) / 2;
+
+    // searches give up at about the square root of the lines
+    ptrdiff_t max_cost = 1;
+    for (ptrdiff_t v = N + M; v >>= 2; ) {
+        max_cost <<= 1;
+    }
+    if (max_cost < DIFF_MAX_COST_MIN) {
+        max_cost = DIFF_MAX_COST_MIN;
+    }
+
+    // diagonal k of either search is at index k + max + 1
+    ptrdiff_t *fwd = d->forward + max + 1;
+    ptrdiff_t *rev = d->reverse + max + 1;
+    fwd[1] = 0;
+    rev[1] = 0;
+    for (ptrdiff_t e = 0; e <= max; ++e) {
+        for (ptrdiff_t k = -e; k <= e; k += 2) {
+            ptrdiff_t i = k == -e || (k != e && fwd[k - 1] < fwd[k + 1]) ?
+                          fwd[k + 1] : fwd[k - 1] + 1;
+            ptrdiff_t j = i - k;
+            ptrdiff_t i0 = i;
+            ptrdiff_t j0 = j;
+            while (i < N && j < M && a[i] == b[j]) {
+                i++;
+                j++;
+            }
+            fwd[k] = i;
+
+            // reverse diagonal delta - k reached at e - 1
+            ptrdiff_t r = delta - k;
+            if (odd && r >= -(e - 1) && r <= e - 1 && i + rev[r] >= N) {
+                *x = (size_t) i0;
+                *y = (size_t) j0;
+                return;
+            }
+        }
+
+        // reverse search counts lines from the end of both ranges
+        for (ptrdiff_t k = -e; k <= e; k += 2) {
+            ptrdiff_t i = k == -e || (k != e && rev[k - 1] < rev[k + 1]) ?
+                          rev[k + 1] : rev[k - 1] + 1;
+            ptrdiff_t j = i - k;
+            while (i < N && j < M && a[N - 1 - i] == b[M - 1 - j]) {
+                i++;
+                j++;
+            }
+            rev[k] = i;
+
+            ptrdiff_t f = delta - k;
+            if (!odd && f >= -e && f <= e && i + fwd[f] >= N) {
+                *x = (size_t) (N - i);
+                *y = (size_t) (M - j);
+                return;
+            }
+        }
+
+        if (e < max_cost) {
+            continue;
+        }
+
+        // too costly, split at the furthest point reached inside both ranges
+        ptrdiff_t best = 0;
+        for (ptrdiff_t k = -e; k <= e; k += 2) {
+            ptrdiff_t i = fwd[k];
+            ptrdiff_t j = i - k;
+            if (i <= N && j >= 0 && j <= M && i + j > best && i + j < N + M) {
+                best = i + j;
+                *x = (size_t) i;
+                *y = (size_t) j;
+            }
+        }
+        if (best) {
+            return;
+        }
+    }
+
+    // unreachable, an edit of at most N + M always overlaps
+    *x = n;
+    *y = m;
+    return;
+}
+
+static void add_chunk(DiffState *d, DiffChunk chunk) {
+    if (d->n_chunks) {
+        DiffChunk *last = &d->chunks[d->n_chunks - 1];
+        if (last->a_end == chunk.a_start && last->b_end == chunk.b_start) {
+            last->a_end = chunk.a_end;
+            last->b_end = chunk.b_end;
+            return;
+        }
+    }
+
+    if (d->n_chunks == d->len_chunks) {
+        d->len_chunks = d->len_chunks ? d->len_chunks * ARRAY_GROWTH_RATE :
+                        INIT_DIFF_CHUNKS;
+        d->chunks = safe_realloc(d->chunks, d->len_chunks * sizeof(DiffChunk));
+    }
+    d->chunks[d->n_chunks++] = chunk;
+    return;
+}
+
+static void put_lines(TextBuffer *b, Text *t, size_t start, size_t end) {
+    if (start < end) {
+        put_text(b, t->data + t->lines[start],
+                 t->lines[end] - t->lines[start]);
+    }
+    return;
+}
+
+static void put_prefixed_lines(TextBuffer *b, char prefix, Text *t,
+                               size_t start, size_t end) {
+    for (size_t i = start; i < end; ++i) {
+        size_t len = t->lines[i + 1] - t->lines[i];
+        put_text(b, &prefix, 1);
+        put_text(b, t->data + t->lines[i], len);
+        if (t->data[t->lines[i] + len - 1] != '\n') {
+            const char *note = "\n\\ No newline at end of file\n";
+            put_text(b, note, strlen(note));
+        }
+    }
+    return;
+}
+
+static int equal_lines(Text *a, size_t a_start, size_t a_end, Text *b,
+                       size_t b_start, size_t b_end) {
+    return a_end - a_start == b_end - b_start &&
+           !memcmp(a->ids + a_start, b->ids + b_start,
+                   (a_end - a_start) * sizeof(uint32_t));
+}
+
+static inline uint64_t find_newlines(const char *p) {
+    uint64_t mask = 0;
+#ifdef DIFF_X86
+    // sse2 is part of the x86-64 baseline
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (size_t j = 0; j < 4; ++j) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (p + 16 * j));
+        uint32_t bits = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        mask |= (uint64_t) bits << (16 * j);
+    }
+#else
+    for (size_t j = 0; j < 64; ++j) {
+        mask |= (uint64_t) (p[j] == '\n') << j;
+    }
+#endif
+    return mask;
+}
+
+static inline uint32_t hash_line(const char *p, size_t len) {
+    uint64_t h = len * LINE_PRIME_1;
+    uint64_t w = 0;
+    for (; len >= 8; p += 8, len -= 8) {
+        memcpy(&w, p, 8);
+        h = (h ^ w) * LINE_PRIME_2;
+        h ^= h >> 29;
+    }
+    if (len) {
+        w = 0;
+        memcpy(&w, p, len);
+        h = (h ^ w) * LINE_PRIME_2;
+    }
+
+    // avalanche, ids are placed by the low bits
+    h ^= h >> 32;
+    h *= LINE_PRIME_1;
+    h ^= h >> 29;
+    return (uint32_t) h;
+}
@@ -0,0 +1,164 @@
+#ifndef ASSIGNMENT_2_SVC_DIFF_H
+#define ASSIGNMENT_2_SVC_DIFF_H
+
+#include "../params.h"
+#include "../memory/memory.h"
+#include "../hash/hash.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef struct Text {
+    const char *data;  // contents, not null terminated, NOT owned
+    size_t len;        // length of contents
+    size_t *lines;     // offset of each line, then len, n_lines + 1 entries
+    uint32_t *hashes;  // hash of each line
+    uint32_t *ids;     // id of each line, see number_lines
+    size_t n_lines;    // number of lines
+} Text;
+
+typedef struct DiffChunk {
+    size_t a_start;  // first line of a replaced
+    size_t a_end;    // line of a after the last replaced
+    size_t b_start;  // first line of b replacing them
+    size_t b_end;    // line of b after the last replacing them
+} DiffChunk;
+
+typedef struct DiffHunk {
+    size_t a_start;      // first line of a shown, context included
+    size_t a_end;        // line of a after the last shown
+    size_t b_start;      // first line of b shown
+    size_t b_end;        // line of b after the last shown
+    size_t chunk_start;  // first chunk of the hunk
+    size_t chunk_end;    // chunk after the last of the hunk
+} DiffHunk;
+
+typedef struct TextBuffer {
+    char *data;  // contents, not null terminated
+    size_t len;  // number of bytes
+    size_t cap;  // capacity of data
+} TextBuffer;
+
+typedef struct MergeHunk {
+    size_t base_start;    // first line of base, 0 based
+    size_t base_end;      // line of base after the range
+    size_t ours_start;    // first line of ours
+    size_t ours_end;      // line of ours after the range
+    size_t theirs_start;  // first line of theirs
+    size_t theirs_end;    // line of theirs after the range
+} MergeHunk;
+
+/** @brief Splits contents into lines.
+ *
+ *  Lines end after each '\n', and a last line without one is still a line,
+ *  so the lines of a text always join back to its contents. data is referred
+ *  to, not copied, and MUST outlive the text. Newlines are found 64 bytes at
+ *  a time with vector compares where available, and each line is hashed as
+ *  soon as its end is found, while still in cache. Lines are numbered by
+ *  number_lines. MUST be released with free_text.
+ *
+ *  @param t : address of text to be set.
+ *  @param data : contents, may be NULL if len is 0.
+ *  @param len : length of contents.
+ */
+void init_text(Text *t, const char *data, size_t len);
+
+/** @brief Releases lines of text, not its contents.
+ *
+ *  @param t : address of text.
+ */
+void free_text(Text *t);
+
+/** @brief Numbers lines of texts compared together.
+ *
+ *  Lines with the same contents, in any of the texts, are given the same id,
+ *  and different lines different ids, so lines are compared as integers. A
+ *  text may be numbered again with other texts, replacing its ids.
+ *
+ *  @param texts : array of text addresses.
+ *  @param n_texts : number of texts.
+ */
+void number_lines(Text **texts, size_t n_texts);
+
+/** @brief Finds the shortest edit turning text a into text b.
+ *
+ *  Lines common to the start and end of both texts are trimmed, then the
+ *  remaining lines diffed with Myers' algorithm in linear space, refining
+ *  each side of the middle snake in turn. Searches for a middle snake give
+ *  up after about the square root of the lines of the range, at least
+ *  DIFF_MAX_COST_MIN (params.h), splitting at the furthest point reached,
+ *  so texts with few common lines diff in near linear time, at the cost of
+ *  a longer edit. Chunks are in line order, and separated by at least one
+ *  common line. Lines MUST be numbered together, see number_lines.
+ *
+ *  @param a : address of text.
+ *  @param b : address of text.
+ *  @param n_chunks : address for number of chunks to be set.
+ *  @return address of chunks, MUST be released, NULL if texts are equal.
+ */
+DiffChunk *diff_texts(Text *a, Text *b, size_t *n_chunks);
+
+/** @brief Groups chunks into hunks with lines of context.
+ *
+ *  Chunks separated by at most twice the context lines share a hunk, so no
+ *  line is shown twice.
+ *
+ *  @param a : address of text the chunks apply to.
+ *  @param chunks : chunks turning a into b, as returned by diff_texts.
+ *  @param n_chunks : number of chunks.
+ *  @param context : number of common lines shown around each chunk.
+ *  @param n_hunks : address for number of hunks to be set.
+ *  @return address of hunks, MUST be released, NULL if there are no chunks.
+ */
+DiffHunk *group_hunks(Text *a, DiffChunk *chunks, size_t n_chunks,
+                      size_t context, size_t *n_hunks);
+
+/** @brief Appends bytes to text buffer.
+ *
+ *  @param buf : address of text buffer, zeroed when empty.
+ *  @param data : bytes.
+ *  @param len : number of bytes.
+ */
+void put_text(TextBuffer *buf, const char *data, size_t len);
+
+/** @brief Appends hunks of a unified diff turning text a into text b.
+ *
+ *  Each hunk starts with "@@ -<a line>,<a count> +<b line>,<b count> @@",
+ *  lines counted from 1, then its lines prefixed by ' ' if common, '-' if
+ *  only in a and '+' if only in b. A last line without a newline is followed
+ *  by "\ No newline at end of file". File headers are left to the caller.
+ *
+ *  @param buf : address of text buffer.
+ *  @param a : address of text.
+ *  @param b : address of text.
+ *  @param chunks : chunks turning a into b, as returned by diff_texts.
+ *  @param n_chunks : number of chunks.
+ *  @param context : number of common lines shown around each chunk.
+ */
+void put_unified_diff(TextBuffer *buf, Text *a, Text *b, DiffChunk *chunks,
+                      size_t n_chunks, size_t context);
+
+/** @brief Merges changes of two texts from a common base.
+ *
+ *  Lines changed on one side only are taken from that side, and lines
+ *  changed the same way on both sides taken once. Changes of both sides to
+ *  overlapping or adjacent base lines conflict, unless they are equal.
+ *  Lines MUST be numbered together, see number_lines.
+ *
+ *  @param base : address of text both sides started from.
+ *  @param ours : address of text.
+ *  @param theirs : address of text.
+ *  @param merged : address for merged contents to be set, MUST be released,
+ *                  NULL if there are conflicts.
+ *  @param merged_len : address for length of merged contents to be set.
+ *  @param conflicts : address for conflicting ranges to be set, MUST be
+ *                     released, NULL if there are none.
+ *  @param n_conflicts : address for number of conflicts to be set.
+ *  @return 0 if merged, 1 if there are conflicts.
+ */
+int merge_texts(Text *base, Text *ours, Text *theirs, char **merged,
+                size_t *merged_len, MergeHunk **conflicts,
+                size_t *n_conflicts);
+
+#endif //ASSIGNMENT_2_SVC_DIFF_H
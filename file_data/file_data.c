@@ -1,4 +1,11 @@
+#define _GNU_SOURCE
 #include "file_data.h"
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+
+// file updates completed by each backend, indexed by enum CopyBackend
+static size_t copy_counts[N_COPY_BACKENDS];
 
 /** @brief Removes file from file system.
  *
@@ -14,40 +21,205 @@
 static int remove_file(const char *file_path, const struct stat *sb, int typeflag,
         struct FTW *ftwbuf);
 
-int hash_and_copy_file(char *file_path, char **file_copy, size_t *file_size) {
-    FILE *f = fopen(file_path, "r");
-    if (!f) {
+/** @brief Converts stat to file stat.
+ *
+ *  @param sb : address of stat.
+ *  @param checked_ns : wall clock time, taken before the stat.
+ *  @param st : address of file stat to be set.
+ */
+static void set_file_stat(struct stat *sb, int64_t checked_ns, FileStat *st);
+
+/** @brief Wall clock time in ns.
+ *
+ *  Same clock used for file timestamps.
+ *
+ *  @return current time (ns).
+ */
+static int64_t wall_clock_ns();
+
+/** @brief Copies file contents with a single backend.
+ *
+ *  Destination must be empty and positioned at its start. On failure, the
+ *  destination may be partially written.
+ *
+ *  @param backend : copy backend to use.
+ *  @param src : descriptor of file being copied.
+ *  @param src_offset : offset of first byte copied.
+ *  @param len : number of bytes copied.
+ *  @param whole : 1 if the range is the whole of src.
+ *  @param dst : descriptor of file being written.
+ *  @return 0 if successful, -1 otherwise.
+ */
+static int copy_with_backend(enum CopyBackend backend, int src,
+                             off_t src_offset, uint64_t len, int whole,
+                             int dst);
+
+int hash_and_copy_file(char *file_path, char **file_copy, size_t *file_size,
+                       Hash *hash, FileStat *st) {
+    int fd = open(file_path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+
+    // size the copy from the inode, no seek round trip required
+    int64_t checked_ns = wall_clock_ns();
+    struct stat sb;
+    if (fstat(fd, &sb) == -1) {
+        close(fd);
         return -1;
     }
 
-    if (file_copy && file_size) {
-        // move file position to end
-        fseek(f, 0, SEEK_END);
-        // current offset (in bytes)
-        *file_size = ftell(f);
-        // reset file position to start of stream
-        fseek(f, 0, SEEK_SET);
-        // allocate space for file content copy
-        *file_copy = (char *) safe_malloc(*file_size * sizeof(char));
-    }
-
-    // basic hash, copy file only file_cpy and file_size are non NULL
-    int hash = 0;
-    for (size_t i = 0; i < strlen(file_path); ++i) {
-        hash = (hash + file_path[i]) % 1000;
-    }
-    int c = 0;
-    int i = 0;
-    while ((c = fgetc(f)) != EOF) {
-        if (file_copy && file_size) {
-            (*file_copy)[i] = c;
-            i++;
+    int copy = file_copy && file_size;
+    size_t buf_len = HASH_BLOCK_SIZE;
+    char *buf = NULL;
+    if (copy) {
+        // read straight into the copy, hashing each block as it lands, one
+        // spare byte so the read finding EOF does not fill the copy
+        buf_len = sb.st_size > 0 ? (size_t) sb.st_size + 1 : HASH_BLOCK_SIZE;
+    }
+    buf = (char *) safe_malloc(buf_len * sizeof(char));
+
+    HashState hs;
+    hash_init(&hs);
+    uint64_t total = 0;
+    for (;;) {
+        if (copy && total == buf_len) {
+            // file grew since fstat, extend copy
+            buf_len *= ARRAY_GROWTH_RATE;
+            buf = safe_realloc(buf, buf_len * sizeof(char));
+        }
+
+        char *block = copy ? buf + total : buf;
+        size_t block_len = copy ? buf_len - total : buf_len;
+        if (block_len > HASH_BLOCK_SIZE) {
+            block_len = HASH_BLOCK_SIZE;
+        }
+
+        ssize_t n = read(fd, block, block_len);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            int err = errno;
+            free(buf);
+            close(fd);
+            errno = err;
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        hash_update(&hs, block, (size_t) n);
+        total += (uint64_t) n;
+    }
+    close(fd);
+
+    if (copy) {
+        *file_copy = buf;
+        *file_size = (size_t) total;
+    } else {
+        free(buf);
+    }
+
+    *hash = hash_final(&hs);
+    if (st) {
+        set_file_stat(&sb, checked_ns, st);
+    }
+    return 0;
+}
+
+int hash_and_stream_file(char *file_path, file_block_fn fn, void *ctx,
+                         Hash *hash, FileStat *st) {
+    if (!file_path || !fn || !hash) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    int fd = open(file_path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+
+    int64_t checked_ns = wall_clock_ns();
+    struct stat sb;
+    if (fstat(fd, &sb) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    char *buf = (char *) safe_malloc(HASH_BLOCK_SIZE * sizeof(char));
+    HashState hs;
+    hash_init(&hs);
+    for (;;) {
+        ssize_t n = read(fd, buf, HASH_BLOCK_SIZE);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            int err = errno;
+            free(buf);
+            close(fd);
+            errno = err;
+            return -1;
         }
-        hash = (hash + c) % 2000000000;
+        if (n == 0) {
+            break;
+        }
+
+        hash_update(&hs, buf, (size_t) n);
+        fn(ctx, buf, (size_t) n);
+    }
+    free(buf);
+    close(fd);
+
+    *hash = hash_final(&hs);
+    if (st) {
+        set_file_stat(&sb, checked_ns, st);
+    }
+    return 0;
+}
+
+int is_file_unchanged(FileData *fd) {
+    if (!fd || !fd->stat.checked_ns) {
+        return 0;
+    }
+
+    // racy, modified within the same tick as the stat was taken
+    int64_t changed_ns = fd->stat.mtime_ns > fd->stat.ctime_ns ?
+                         fd->stat.mtime_ns : fd->stat.ctime_ns;
+    if (changed_ns + STAT_RACY_WINDOW_NS >= fd->stat.checked_ns) {
+        return 0;
+    }
+
+    struct stat sb;
+    if (stat(fd->file_path, &sb) == -1) {
+        return 0;
     }
-    fclose(f);
 
-    return hash;
+    FileStat cur;
+    set_file_stat(&sb, fd->stat.checked_ns, &cur);
+    return cur.size == fd->stat.size && cur.mtime_ns == fd->stat.mtime_ns &&
+           cur.ctime_ns == fd->stat.ctime_ns && cur.ino == fd->stat.ino &&
+           cur.dev == fd->stat.dev;
+}
+
+static void set_file_stat(struct stat *sb, int64_t checked_ns, FileStat *st) {
+    st->size = (uint64_t) sb->st_size;
+    st->mtime_ns = (int64_t) sb->st_mtim.tv_sec * 1000000000LL +
+                   sb->st_mtim.tv_nsec;
+    st->ctime_ns = (int64_t) sb->st_ctim.tv_sec * 1000000000LL +
+                   sb->st_ctim.tv_nsec;
+    st->ino = (uint64_t) sb->st_ino;
+    st->dev = (uint64_t) sb->st_dev;
+    st->checked_ns = checked_ns;
+    return;
+}
+
+static int64_t wall_clock_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
 }
 
 FileData *copy_file_data(FileData *fd, size_t n_file_data, size_t file_data_len) {
@@ -55,12 +227,9 @@ FileData *copy_file_data(FileData *fd, size_t n_file_data, size_t file_data_len)
         return NULL;
     }
 
-    // deep copy name, shallow copy remaining struct fields
+    // shallow copy, paths are interned
     FileData *fd_cpy = safe_malloc(file_data_len * sizeof(FileData));
-    for (size_t i = 0; i < n_file_data; ++i) {
-        fd_cpy[i] = fd[i];
-        fd_cpy[i].file_path = copy_string(fd_cpy[i].file_path);
-    }
+    memcpy(fd_cpy, fd, n_file_data * sizeof(FileData));
 
     return fd_cpy;
 }
@@ -70,38 +239,154 @@ void update_file(char *old_file_path, char *new_file_path) {
         return;
     }
 
-    FILE *f_old = fopen(old_file_path, "w+");
-    FILE *f_new = fopen(new_file_path, "r");
-    if (!f_old || !f_new) {
+    int src = open(new_file_path, O_RDONLY);
+    int dst = open(old_file_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (src == -1 || dst == -1) {
         perror("unable to open files in file update");
         exit(2);
     }
 
     // write new file data to old file
-    int c;
-    while(( c = fgetc(f_new) ) != EOF ) {
-        fputc(c, f_old);
+    struct stat sb;
+    if (fstat(src, &sb) == -1 ||
+        copy_file_contents(src, 0, (uint64_t) sb.st_size, dst) == -1) {
+        perror("unable to copy files in file update");
+        exit(2);
     }
 
-    fclose(f_old);
-    fclose(f_new);
+    close(dst);
+    close(src);
 
     return;
 }
 
-int is_unknown(FileData *files, size_t n_files, char *file_path) {
-    if (!files) {
-        return 1;
+int copy_file_contents(int src, off_t src_offset, uint64_t len, int dst) {
+    struct stat sb;
+    if (fstat(src, &sb) == -1) {
+        return -1;
     }
+    int whole = !src_offset && len == (uint64_t) sb.st_size;
 
-    // linear search for file name
-    for (size_t i = 0; i < n_files; ++i) {
-        if (!strcmp(files[i].file_path, file_path) && files[i].state != Deleted) {
+    // cheapest backend first
+    for (enum CopyBackend b = CopyReflink; b < N_COPY_BACKENDS; ++b) {
+        if (ftruncate(dst, 0) == -1 || lseek(dst, 0, SEEK_SET) == -1) {
+            return -1;
+        }
+        if (copy_with_backend(b, src, src_offset, len, whole, dst) == 0) {
+            __atomic_fetch_add(&copy_counts[b], 1, __ATOMIC_RELAXED);
             return 0;
         }
     }
 
-    return 1;
+    return -1;
+}
+
+static int copy_with_backend(enum CopyBackend backend, int src,
+                             off_t src_offset, uint64_t len, int whole,
+                             int dst) {
+    off_t offset = src_offset;
+    uint64_t remaining = len;
+    switch (backend) {
+        case CopyReflink:
+            // share extents, no data copied
+            if (whole) {
+                return ioctl(dst, FICLONE, src) == -1 ? -1 : 0;
+            } else {
+                struct file_clone_range range = {
+                        .src_fd = src,
+                        .src_offset = (uint64_t) src_offset,
+                        .src_length = len,
+                        .dest_offset = 0,
+                };
+                return ioctl(dst, FICLONERANGE, &range) == -1 ? -1 : 0;
+            }
+        case CopyFileRange:
+            while (remaining) {
+                ssize_t n = copy_file_range(src, &offset, dst, NULL,
+                        remaining < COPY_BLOCK_SIZE ? remaining : COPY_BLOCK_SIZE,
+                        0);
+                if (n == -1) {
+                    return -1;
+                }
+                if (n == 0) {
+                    // source ended before len bytes were copied
+                    errno = EIO;
+                    return -1;
+                }
+                remaining -= (uint64_t) n;
+            }
+            return 0;
+        case CopySendfile:
+            while (remaining) {
+                ssize_t n = sendfile(dst, src, &offset,
+                        remaining < COPY_BLOCK_SIZE ? remaining : COPY_BLOCK_SIZE);
+                if (n == -1) {
+                    return -1;
+                }
+                if (n == 0) {
+                    // source ended before len bytes were copied
+                    errno = EIO;
+                    return -1;
+                }
+                remaining -= (uint64_t) n;
+            }
+            return 0;
+        case CopyBuffered:
+            break;
+    }
+
+    char *buf = safe_malloc(COPY_BLOCK_SIZE);
+    while (remaining) {
+        ssize_t n = pread(src, buf,
+                remaining < COPY_BLOCK_SIZE ? remaining : COPY_BLOCK_SIZE, offset);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            free(buf);
+            errno = n ? errno : EIO;
+            return -1;
+        }
+        offset += n;
+        remaining -= (uint64_t) n;
+        // write whole block, retrying short writes
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t w = write(dst, buf + done, n - done);
+            if (w == -1 && errno != EINTR) {
+                free(buf);
+                return -1;
+            }
+            done += w == -1 ? 0 : w;
+        }
+    }
+    free(buf);
+    return 0;
+}
+
+void get_copy_stats(size_t *counts) {
+    if (!counts) {
+        return;
+    }
+
+    for (size_t i = 0; i < N_COPY_BACKENDS; ++i) {
+        counts[i] = __atomic_load_n(&copy_counts[i], __ATOMIC_RELAXED);
+    }
+
+    return;
+}
+
+const char *copy_backend_name(enum CopyBackend backend) {
+    switch (backend) {
+        case CopyReflink:
+            return "reflink";
+        case CopyFileRange:
+            return "copy_file_range";
+        case CopySendfile:
+            return "sendfile";
+        case CopyBuffered:
+            return "buffered";
+    }
+    return "unknown";
 }
 
 int remove_file(const char *file_path, const struct stat *sb, int typeflag,
@@ -3,7 +3,14 @@
 
 #include "../params.h"
 #include "../memory/memory.h"
+#include "../hash/hash.h"
+#include "../intern/intern.h"
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
 #define __USE_XOPEN_EXTENDED 1
 #include <ftw.h>
 #include <string.h>
@@ -11,32 +18,96 @@
 
 enum FileState {Tracked = 0, Staged = 2, Deleted = 3};
 
+enum CopyBackend {CopyReflink = 0, CopyFileRange = 1, CopySendfile = 2,
+                  CopyBuffered = 3};
+#define N_COPY_BACKENDS 4
+
+typedef struct FileStat {
+    uint64_t size;        // file size in bytes
+    int64_t mtime_ns;     // last modification time (ns)
+    int64_t ctime_ns;     // last inode change time (ns)
+    uint64_t ino;         // inode number
+    uint64_t dev;         // device id
+    int64_t checked_ns;   // wall clock time stat was taken (ns), 0 if unset
+} FileStat;
+
 typedef struct FileData {
-    char *file_path;      // null terminated file path
+    char *file_path;      // interned file path, do NOT free
     enum FileState state; // current state of the file
-    size_t previous_hash; // previous known hash, only set when state is
+    Hash previous_hash;   // previous known hash, only set when state is
                           // Tracked or Deleted
+    FileStat stat;        // stat of file when previous_hash was calculated
 } FileData;
 
-/** @brief Copies file content and returns hash.
+/** @brief Receives a block of file contents.
+ *
+ *  @param ctx : caller context.
+ *  @param block : bytes read, only valid for the duration of the call.
+ *  @param len : number of bytes.
+ */
+typedef void (*file_block_fn)(void *ctx, const char *block, size_t len);
+
+/** @brief Copies file content and calculates hash.
  *
  *  If file is not available, -1 is returned and errno is set. If file_copy and
  *  file_size are NOT NULL, file is copied, with address stored in file_copy, and
  *  file_size set accordingly. If file is copied, address stored at file_copy
- *  needs to be released. Hash is always calculated if file access is successful.
+ *  needs to be released. Hash of the file contents is always set if file access
+ *  is successful. The file path is not part of the hash.
+ *
+ *  File is read once, in blocks of HASH_BLOCK_SIZE (params.h), hashing each
+ *  block as it is read. When copying, blocks are read directly into the copy.
+ *
+ *  If st is NOT NULL, it is set to the stat of the file taken before reading,
+ *  so any later change to the file is visible as a stat change.
  *
  *  @param file_path : path of file to be hashed.
  *  @param file_copy : address for file_copy address to be set.
  *  @param file_size : address for file size to be set.
- *  @return hash of file.
+ *  @param hash : address for hash to be set.
+ *  @param st : address for file stat to be set.
+ *  @return 0 if successful, -1 otherwise.
  */
-int hash_and_copy_file( char *file_path, char **file_copy, size_t *file_size);
+int hash_and_copy_file(char *file_path, char **file_copy, size_t *file_size,
+                       Hash *hash, FileStat *st);
 
-/** @brief Deep copy file data array.
+/** @brief Streams file content and calculates hash.
+ *
+ *  Behaves as hash_and_copy_file, but each block of HASH_BLOCK_SIZE (params.h)
+ *  bytes is passed to fn as it is read, instead of being copied, so memory use
+ *  does not grow with the file size.
+ *
+ *  @param file_path : path of file to be hashed.
+ *  @param fn : called for each block read, in order.
+ *  @param ctx : context passed to fn.
+ *  @param hash : address for hash to be set.
+ *  @param st : address for file stat to be set, may be NULL.
+ *  @return 0 if successful, -1 otherwise.
+ */
+int hash_and_stream_file(char *file_path, file_block_fn fn, void *ctx,
+                         Hash *hash, FileStat *st);
+
+/** @brief Checks if file is unchanged since its hash was calculated.
+ *
+ *  File is stat'ed and compared with the stat recorded alongside the previous
+ *  hash. If fd is NULL, no stat was recorded, the file cannot be stat'ed, or
+ *  any of size, mtime, ctime, inode or device differ, 0 is returned.
+ *
+ *  A recorded stat is racy if the file was modified within STAT_RACY_WINDOW_NS
+ *  (params.h) of the stat being taken, as a further change inside the same
+ *  timestamp tick would leave the stat unchanged. Racy stats always return 0,
+ *  so the file is rehashed.
+ *
+ *  @param fd : address of file data.
+ *  @return 1 if file is unchanged, 0 if file must be rehashed.
+ */
+int is_file_unchanged(FileData *fd);
+
+/** @brief Copies file data array.
  *
  *  If file data array is NULL, NULL is returned. Else, file data array is copied and
- *  address returned. Every file path is also copied. Copied file data and names
- *  MUST be released.
+ *  address returned. File paths are interned, and shared with the copy.
+ *  Copied file data MUST be released.
  *
  *  @param fd : address of file data array.
  *  @param n_file_data : number of files stored.
@@ -53,22 +124,46 @@ FileData *copy_file_data(FileData *fd, size_t n_file_data, size_t file_data_len)
  *
  *  If new file path doesnt lead to an existing file, it is created.
  *
+ *  Copy backends are tried in order, each falling back to the next if it is
+ *  not supported by the file systems involved: reflink (FICLONE), in kernel
+ *  copy (copy_file_range), sendfile, and finally a COPY_BLOCK_SIZE (params.h)
+ *  buffered copy. The backend used is counted, see get_copy_stats.
+ *
  *  @param old_file_path : path of file contents being copied.
  *  @param new_file_path : address for file for contents to be copied to.
  */
 void update_file(char *old_file_path, char *new_file_path);
 
-/** @brief Checks if file_path exists in file_data array.
+/** @brief Copies file contents between file descriptors.
+ *
+ *  len bytes of src, from src_offset, replace the contents of dst. Copying
+ *  stops early if src ends. Backends are tried in the same order as
+ *  update_file, and the backend used is counted. Reflinks of part of a file
+ *  only succeed if the range is aligned to the file system block size, or
+ *  ends at the end of src.
+ *
+ *  @param src : descriptor of file being copied.
+ *  @param src_offset : offset of first byte copied.
+ *  @param len : number of bytes copied.
+ *  @param dst : descriptor of file being written, opened for writing.
+ *  @return 0 if successful, -1 otherwise.
+ */
+int copy_file_contents(int src, off_t src_offset, uint64_t len, int dst);
+
+/** @brief Reads number of file updates completed by each copy backend.
  *
- *  If files is NULL or file_path is not an entry in files, 1 is returned.
- *  Otherwise, file contains file_path and 0 is returned.
+ *  Counts are process wide, and indexed by enum CopyBackend.
+ *
+ *  @param counts : array of N_COPY_BACKENDS counts to be set.
+ */
+void get_copy_stats(size_t *counts);
+
+/** @brief Name of copy backend.
  *
- *  @param files : array of file data.
- *  @param n_files : number of file_data instances in files.
- *  @param file_path : file path to be located.
- *  @return 1 if unknown, 0 if known.
+ *  @param backend : copy backend.
+ *  @return null terminated static name.
  */
-int is_unknown(FileData *files, size_t n_files, char *file_path);
+const char *copy_backend_name(enum CopyBackend backend);
 
 /** @brief Removes svc directory and all files within it.
  *
@@ -0,0 +1,383 @@
+#include "graph.h"
+
+#define FROM_A 1
+#define FROM_B 2
+
+/** @brief Returns generation of commit.
+ *
+ *  @param g : address of commit graph.
+ *  @param index : index of commit, in the graph.
+ *  @return generation number.
+ */
+static uint64_t get_generation(CommitGraph *g, size_t index);
+
+/** @brief Checks if key a orders after key b.
+ *
+ *  @param a : address of key.
+ *  @param b : address of key.
+ *  @return 1 if a has greater generation, or equal generation and greater
+ *          index, 0 otherwise.
+ */
+static inline int key_after(const GraphKey *a, const GraphKey *b);
+
+/** @brief Pushes commit onto queue.
+ *
+ *  @param q : address of queue.
+ *  @param generation : generation of commit.
+ *  @param index : index of commit.
+ */
+static void queue_push(GraphQueue *q, uint64_t generation, size_t index);
+
+/** @brief Pops commit of greatest generation, then greatest index.
+ *
+ *  @param q : address of non empty queue.
+ *  @return index of commit.
+ */
+static size_t queue_pop(GraphQueue *q);
+
+int open_commit_graph(CommitGraph *g, size_t max_commits) {
+    if (!g) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    g->map = NULL;
+    g->map_size = 0;
+    g->n_mapped = 0;
+    g->appended = NULL;
+    g->len_appended = 0;
+    g->n_commits = 0;
+    uint64_t size = 0;
+    g->fd = open_state_file(SVC_COMMIT_GRAPH_PATH, COMMIT_GRAPH_MAGIC,
+                            COMMIT_GRAPH_HEADER_SIZE, &size);
+    if (g->fd == -1) {
+        return -1;
+    }
+
+    size_t n_entries = (size - COMMIT_GRAPH_HEADER_SIZE) /
+                       COMMIT_GRAPH_ENTRY_SIZE;
+    if (n_entries > max_commits) {
+        n_entries = max_commits;
+    }
+    if (!n_entries) {
+        return 0;
+    }
+    g->map_size = COMMIT_GRAPH_HEADER_SIZE +
+                  n_entries * COMMIT_GRAPH_ENTRY_SIZE;
+    void *map = mmap(NULL, g->map_size, PROT_READ, MAP_SHARED, g->fd, 0);
+    if (map == MAP_FAILED) {
+        g->map_size = 0;
+        close_commit_graph(g);
+        return -1;
+    }
+    g->map = (unsigned char *) map;
+    g->n_mapped = n_entries;
+    g->n_commits = n_entries;
+    return 0;
+}
+
+void close_commit_graph(CommitGraph *g) {
+    if (!g) {
+        return;
+    }
+
+    if (g->map) {
+        munmap(g->map, g->map_size);
+        g->map = NULL;
+        g->map_size = 0;
+    }
+    if (g->fd != -1) {
+        close(g->fd);
+        g->fd = -1;
+    }
+    free(g->appended);
+    g->appended = NULL;
+    g->len_appended = 0;
+    g->n_mapped = 0;
+    g->n_commits = 0;
+    return;
+}
+
+int append_graph_commit(CommitGraph *g, const size_t *parents,
+                        size_t n_parents) {
+    if (!g || g->fd == -1 || (n_parents && !parents) ||
+        n_parents > MAX_GRAPH_PARENTS) {
+        return -1;
+    }
+
+    GraphEntry entry = {{NO_COMMIT, NO_COMMIT}, 1};
+    for (size_t i = 0; i < n_parents; ++i) {
+        if (parents[i] >= g->n_commits) {
+            return -1;
+        }
+        entry.parents[i] = parents[i];
+        uint64_t generation = get_generation(g, parents[i]) + 1;
+        if (generation > entry.generation) {
+            entry.generation = generation;
+        }
+    }
+
+    unsigned char buf[COMMIT_GRAPH_ENTRY_SIZE];
+    put_le64(buf, entry.parents[0]);
+    put_le64(buf + 8, entry.parents[1]);
+    put_le64(buf + 16, entry.generation);
+    if (write_all(g->fd, buf, COMMIT_GRAPH_ENTRY_SIZE,
+                  COMMIT_GRAPH_HEADER_SIZE +
+                  g->n_commits * COMMIT_GRAPH_ENTRY_SIZE) == -1) {
+        return -1;
+    }
+
+    // resize if necessary
+    size_t i = g->n_commits - g->n_mapped;
+    if (i == g->len_appended) {
+        g->len_appended = g->len_appended ?
+                          g->len_appended * ARRAY_GROWTH_RATE :
+                          INIT_COMMIT_SIZE;
+        g->appended = safe_realloc(g->appended,
+                                   g->len_appended * sizeof(GraphEntry));
+    }
+    g->appended[i] = entry;
+    g->n_commits++;
+    return 0;
+}
+
+int get_graph_entry(CommitGraph *g, size_t index, GraphEntry *entry) {
+    if (!g || !entry || index >= g->n_commits) {
+        return -1;
+    }
+
+    if (index >= g->n_mapped) {
+        *entry = g->appended[index - g->n_mapped];
+        return 0;
+    }
+
+    const unsigned char *p = g->map + COMMIT_GRAPH_HEADER_SIZE +
+                             index * COMMIT_GRAPH_ENTRY_SIZE;
+    entry->parents[0] = get_le64(p);
+    entry->parents[1] = get_le64(p + 8);
+    entry->generation = get_le64(p + 16);
+    return 0;
+}
+
+int is_graph_ancestor(CommitGraph *g, size_t ancestor, size_t commit) {
+    if (!g || ancestor >= g->n_commits || commit >= g->n_commits) {
+        return -1;
+    }
+
+    if (ancestor == commit) {
+        return 1;
+    }
+    uint64_t min_generation = get_generation(g, ancestor);
+    if (commit < ancestor || get_generation(g, commit) <= min_generation) {
+        return 0;
+    }
+
+    // depth first, only through commits that could still reach ancestor
+    unsigned char *seen = safe_calloc(g->n_commits / 8 + 1, 1);
+    size_t len_stack = INIT_COMMIT_SIZE;
+    size_t n_stack = 0;
+    size_t *stack = safe_malloc(len_stack * sizeof(size_t));
+    stack[n_stack++] = commit;
+    int found = 0;
+    while (n_stack && !found) {
+        GraphEntry entry;
+        get_graph_entry(g, stack[--n_stack], &entry);
+        for (size_t i = 0; i < MAX_GRAPH_PARENTS; ++i) {
+            uint64_t p = entry.parents[i];
+            if (p == ancestor) {
+                found = 1;
+                break;
+            }
+            if (p == NO_COMMIT || p < ancestor ||
+                (seen[p / 8] >> (p % 8)) & 1 ||
+                get_generation(g, p) <= min_generation) {
+                continue;
+            }
+            seen[p / 8] |= (unsigned char) (1 << (p % 8));
+
+            // resize if necessary
+            if (n_stack == len_stack) {
+                len_stack *= ARRAY_GROWTH_RATE;
+                stack = safe_realloc(stack, len_stack * sizeof(size_t));
+            }
+            stack[n_stack++] = p;
+        }
+    }
+
+    free(stack);
+    free(seen);
+    return found;
+}
+
+int64_t find_graph_merge_base(CommitGraph *g, size_t a, size_t b) {
+    if (!g || a >= g->n_commits || b >= g->n_commits) {
+        return -2;
+    }
+
+    if (a == b) {
+        return (int64_t) a;
+    }
+
+    // commits queued have a non zero mark, and are only queued once
+    unsigned char *marks = safe_calloc(g->n_commits, 1);
+    GraphQueue q = {safe_malloc(INIT_COMMIT_SIZE * sizeof(GraphKey)), 0,
+                    INIT_COMMIT_SIZE};
+    marks[a] = FROM_A;
+    marks[b] = FROM_B;
+    queue_push(&q, get_generation(g, a), a);
+    queue_push(&q, get_generation(g, b), b);
+
+    // every child is popped before its parents, so marks are complete on pop
+    int64_t base = -1;
+    while (q.n) {
+        size_t x = queue_pop(&q);
+        if (marks[x] == (FROM_A | FROM_B)) {
+            base = (int64_t) x;
+            break;
+        }
+
+        GraphEntry entry;
+        get_graph_entry(g, x, &entry);
+        for (size_t i = 0; i < MAX_GRAPH_PARENTS; ++i) {
+            uint64_t p = entry.parents[i];
+            if (p == NO_COMMIT || (marks[p] | marks[x]) == marks[p]) {
+                continue;
+            }
+            if (!marks[p]) {
+                queue_push(&q, get_generation(g, p), p);
+            }
+            marks[p] |= marks[x];
+        }
+    }
+
+    free(q.keys);
+    free(marks);
+    return base;
+}
+
+int init_graph_walk(GraphWalk *w, CommitGraph *g, size_t start,
+                    enum WalkOrder order, int first_parent) {
+    if (!w || !g || start >= g->n_commits) {
+        return -1;
+    }
+
+    // ancestors have lower indices, so start is the last bit needed
+    w->g = g;
+    w->order = order;
+    w->first_parent = first_parent;
+    w->seen = safe_calloc(start / 64 + 1, sizeof(uint64_t));
+    w->seen[start / 64] |= (uint64_t) 1 << (start % 64);
+    w->cursor = start + 1;
+    w->queue = (GraphQueue) {NULL, 0, 0};
+    if (order == WalkGeneration) {
+        w->queue.keys = safe_malloc(INIT_COMMIT_SIZE * sizeof(GraphKey));
+        w->queue.len = INIT_COMMIT_SIZE;
+        queue_push(&w->queue, get_generation(g, start), start);
+    }
+    return 0;
+}
+
+int64_t next_graph_commit(GraphWalk *w) {
+    size_t x = 0;
+    if (w->order == WalkGeneration) {
+        if (!w->queue.n) {
+            return -1;
+        }
+        x = queue_pop(&w->queue);
+    } else {
+        // highest commit reached below the cursor, parents are always below
+        uint64_t word = 0;
+        size_t i = w->cursor;
+        while (i) {
+            word = w->seen[(i - 1) / 64] & (UINT64_MAX >> (63 - (i - 1) % 64));
+            if (word) {
+                break;
+            }
+            i = (i - 1) / 64 * 64;
+        }
+        if (!i) {
+            w->cursor = 0;
+            return -1;
+        }
+        x = (i - 1) / 64 * 64 + 63 - (size_t) __builtin_clzll(word);
+        w->cursor = x;
+    }
+
+    GraphEntry entry;
+    get_graph_entry(w->g, x, &entry);
+    size_t n_parents = w->first_parent ? 1 : MAX_GRAPH_PARENTS;
+    for (size_t i = 0; i < n_parents; ++i) {
+        uint64_t p = entry.parents[i];
+        if (p == NO_COMMIT || (w->seen[p / 64] >> (p % 64) & 1)) {
+            continue;
+        }
+        w->seen[p / 64] |= (uint64_t) 1 << (p % 64);
+        if (w->order == WalkGeneration) {
+            queue_push(&w->queue, get_generation(w->g, p), p);
+        }
+    }
+    return (int64_t) x;
+}
+
+void free_graph_walk(GraphWalk *w) {
+    if (!w) {
+        return;
+    }
+
+    free(w->seen);
+    free(w->queue.keys);
+    w->seen = NULL;
+    w->queue = (GraphQueue) {NULL, 0, 0};
+    return;
+}
+
+static uint64_t get_generation(CommitGraph *g, size_t index) {
+    if (index >= g->n_mapped) {
+        return g->appended[index - g->n_mapped].generation;
+    }
+
+    return get_le64(g->map + COMMIT_GRAPH_HEADER_SIZE +
+                    index * COMMIT_GRAPH_ENTRY_SIZE + 16);
+}
+
+static inline int key_after(const GraphKey *a, const GraphKey *b) {
+    return a->generation > b->generation ||
+           (a->generation == b->generation && a->index > b->index);
+}
+
+static void queue_push(GraphQueue *q, uint64_t generation, size_t index) {
+    // resize if necessary
+    if (q->n == q->len) {
+        q->len *= ARRAY_GROWTH_RATE;
+        q->keys = safe_realloc(q->keys, q->len * sizeof(GraphKey));
+    }
+
+    GraphKey key = {generation, index};
+    size_t i = q->n++;
+    while (i && key_after(&key, &q->keys[(i - 1) / 2])) {
+        q->keys[i] = q->keys[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    q->keys[i] = key;
+    return;
+}
+
+static size_t queue_pop(GraphQueue *q) {
+    size_t top = q->keys[0].index;
+    GraphKey last = q->keys[--q->n];
+    size_t i = 0;
+    while (2 * i + 1 < q->n) {
+        size_t child = 2 * i + 1;
+        if (child + 1 < q->n &&
+            key_after(&q->keys[child + 1], &q->keys[child])) {
+            child++;
+        }
+        if (!key_after(&q->keys[child], &last)) {
+            break;
+        }
+        q->keys[i] = q->keys[child];
+        i = child;
+    }
+    q->keys[i] = last;
+    return top;
+}
@@ -0,0 +1,169 @@
+#ifndef ASSIGNMENT_2_SVC_GRAPH_H
+#define ASSIGNMENT_2_SVC_GRAPH_H
+
+#include "../params.h"
+#include "../memory/memory.h"
+#include "../state/state.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#define COMMIT_GRAPH_MAGIC "SVCG"
+#define COMMIT_GRAPH_HEADER_SIZE 8
+#define COMMIT_GRAPH_ENTRY_SIZE 24
+#define MAX_GRAPH_PARENTS 2
+
+typedef struct GraphEntry {
+    uint64_t parents[MAX_GRAPH_PARENTS];  // parent indices, NO_COMMIT if none
+    uint64_t generation;                  // 1 if root, else 1 + max of parents
+} GraphEntry;
+
+typedef struct CommitGraph {
+    int fd;                  // descriptor of graph file, -1 if closed
+    unsigned char *map;      // mapped entries, NULL if none when opened
+    size_t map_size;         // size of mapping
+    size_t n_mapped;         // number of entries mapped
+    GraphEntry *appended;    // entries of commits appended since opened
+    size_t len_appended;     // capacity of appended
+    size_t n_commits;        // number of commits in graph
+} CommitGraph;
+
+typedef struct GraphKey {
+    uint64_t generation;  // generation of commit
+    size_t index;         // index of commit
+} GraphKey;
+
+typedef struct GraphQueue {
+    GraphKey *keys;  // max heap, by generation then index
+    size_t n;        // number of keys
+    size_t len;      // capacity of keys
+} GraphQueue;
+
+enum WalkOrder {WalkCreation = 0, WalkGeneration = 1};
+
+typedef struct GraphWalk {
+    CommitGraph *g;         // graph walked
+    enum WalkOrder order;   // order commits are returned in
+    int first_parent;       // 1 if only first parents are followed
+    uint64_t *seen;         // bit per commit, set once reached
+    size_t cursor;          // creation order, commits below are not returned
+    GraphQueue queue;       // generation order, commits reached not returned
+} GraphWalk;
+
+/** @brief Opens commit graph of the svc directory.
+ *
+ *  Commits are identified by their index, in order of creation, so parents
+ *  always have lower indices than their children. Each commit has a fixed
+ *  size entry in SVC_COMMIT_GRAPH_PATH (params.h) holding its parent indices
+ *  and generation number, the length of the longest path to a root commit.
+ *  The file is created if missing, and mapped, nothing else is read. Entries
+ *  past max_commits, left by commits missing from the commit log, are ignored
+ *  and overwritten by the next commit appended.
+ *
+ *  @param g : address of commit graph to be set.
+ *  @param max_commits : number of commits in the commit log.
+ *  @return 0 if successful, -1 otherwise, with errno set.
+ */
+int open_commit_graph(CommitGraph *g, size_t max_commits);
+
+/** @brief Closes commit graph.
+ *
+ *  Unmaps entries and closes descriptor. If g is NULL or closed, nothing is
+ *  done.
+ *
+ *  @param g : address of commit graph.
+ */
+void close_commit_graph(CommitGraph *g);
+
+/** @brief Appends commit to commit graph.
+ *
+ *  Commit is given the next index, and its generation number is derived from
+ *  its parents. If a parent is not in the graph, or there are more than
+ *  MAX_GRAPH_PARENTS parents, nothing is done and -1 is returned.
+ *
+ *  @param g : address of commit graph.
+ *  @param parents : parent indices.
+ *  @param n_parents : number of parents.
+ *  @return 0 if successful, -1 otherwise.
+ */
+int append_graph_commit(CommitGraph *g, const size_t *parents,
+                        size_t n_parents);
+
+/** @brief Reads graph entry of commit.
+ *
+ *  @param g : address of commit graph.
+ *  @param index : index of commit.
+ *  @param entry : address of entry to be set.
+ *  @return 0 if successful, -1 if commit is not in the graph.
+ */
+int get_graph_entry(CommitGraph *g, size_t index, GraphEntry *entry);
+
+/** @brief Checks if a commit is reachable from another through parents.
+ *
+ *  Walks parents of commit, skipping any commit whose generation or index is
+ *  not greater than those of ancestor, as ancestor cannot be reached from
+ *  them. A commit is its own ancestor.
+ *
+ *  @param g : address of commit graph.
+ *  @param ancestor : index of possible ancestor.
+ *  @param commit : index of commit.
+ *  @return 1 if ancestor, 0 if not, -1 if either commit is not in the graph.
+ */
+int is_graph_ancestor(CommitGraph *g, size_t ancestor, size_t commit);
+
+/** @brief Finds best common ancestor of two commits.
+ *
+ *  Parents of both commits are walked in order of decreasing generation,
+ *  marking which of the two each is reachable from. The first commit reached
+ *  from both has the greatest generation of any common ancestor, so it is not
+ *  an ancestor of another, and the walk ends there. Ties are broken by the
+ *  greater index. If a is an ancestor of b, a is returned.
+ *
+ *  @param g : address of commit graph.
+ *  @param a : index of commit.
+ *  @param b : index of commit.
+ *  @return index of merge base, -1 if there is none, -2 if either commit is
+ *          not in the graph.
+ */
+int64_t find_graph_merge_base(CommitGraph *g, size_t a, size_t b);
+
+/** @brief Starts walk of the ancestors of a commit.
+ *
+ *  Every commit reachable from start through parents, start included, is
+ *  returned once by next_graph_commit, always before its parents. In
+ *  creation order commits are returned by decreasing index, newest first,
+ *  found by scanning the bitmap of commits reached downwards from the last
+ *  returned, 64 commits at a time. The bitmap is the only allocation. In
+ *  generation order commits are returned by decreasing generation, then
+ *  index, from a heap of the commits reached but not yet returned, which
+ *  grows by doubling. If first_parent is set, only the first parent of each
+ *  commit is followed, so merged branches are not walked. MUST be released
+ *  with free_graph_walk.
+ *
+ *  @param w : address of walk to be set.
+ *  @param g : address of commit graph, MUST outlive the walk.
+ *  @param start : index of commit.
+ *  @param order : order commits are returned in.
+ *  @param first_parent : 1 if only first parents are followed, 0 otherwise.
+ *  @return 0 if successful, -1 if start is not in the graph.
+ */
+int init_graph_walk(GraphWalk *w, CommitGraph *g, size_t start,
+                    enum WalkOrder order, int first_parent);
+
+/** @brief Returns next commit of walk.
+ *
+ *  @param w : address of walk.
+ *  @return index of commit, -1 if every commit has been returned.
+ */
+int64_t next_graph_commit(GraphWalk *w);
+
+/** @brief Releases walk. If w is NULL, nothing is done.
+ *
+ *  @param w : address of walk.
+ */
+void free_graph_walk(GraphWalk *w);
+
+#endif //ASSIGNMENT_2_SVC_GRAPH_H
@@ -0,0 +1,321 @@
+#include "hash.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HASH_X86 1
+#endif
+
+#define PRIME32_1 0x9E3779B1U
+#define PRIME32_2 0x85EBCA77U
+#define PRIME32_3 0xC2B2AE3DU
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+// stripe n of a block is keyed by secret + n, scrambling uses the final lanes
+#define SECRET_LEN 24
+#define SCRAMBLE_KEY (SECRET_LEN - HASH_LANES)
+
+static const uint64_t secret[SECRET_LEN] = {
+        0x8c9ff21eb4943e94ULL, 0x529bcfd80991254cULL, 0x12b8eb6d931b5e6eULL,
+        0xcec50c5d0c1fcc21ULL, 0x31f5796e26ef1ca1ULL, 0x6fad0e5ad91dff82ULL,
+        0x061c22c6f5405433ULL, 0xacebed3be37886a1ULL, 0x0d81e8485a2713a6ULL,
+        0xa3e600f8f1fd238cULL, 0xef1382c779e55f8eULL, 0xfe2c41ff60885d40ULL,
+        0x94cbb826dac34bb2ULL, 0xb502428724a731f6ULL, 0xd0bec29520b72715ULL,
+        0x81335f7cacfebd80ULL, 0xe34be0aababd1d08ULL, 0x25c86b4d7ef8431aULL,
+        0x889c2b2a461ffb7eULL, 0x6a810fe6190b977eULL, 0xa24c7ba4f2058340ULL,
+        0xba5c108702350f86ULL, 0x73b2efd68e1c6856ULL, 0xc539d9c263ee450aULL,
+};
+
+/** @brief Accumulates consecutive stripes.
+ *
+ *  Stripe i is keyed by secret + first_key + i. Every kernel implements the
+ *  same arithmetic, lane by lane: acc[i ^ 1] += d, acc[i] += lo(d ^ k) *
+ *  hi(d ^ k).
+ *
+ *  @param acc : stripe accumulators.
+ *  @param data : address of first stripe.
+ *  @param first_key : key offset of first stripe.
+ *  @param n_stripes : number of stripes.
+ */
+typedef void (*accumulate_fn)(uint64_t *acc, const unsigned char *data,
+                              size_t first_key, size_t n_stripes);
+
+/** @brief Scrambles accumulators at the end of a block.
+ *
+ *  @param acc : stripe accumulators.
+ */
+typedef void (*scramble_fn)(uint64_t *acc);
+
+/** @brief Selects fastest kernels supported by the cpu.
+ *
+ *  @param accumulate : address for accumulate kernel to be set.
+ *  @param scramble : address for scramble kernel to be set.
+ */
+static void select_kernels(accumulate_fn *accumulate, scramble_fn *scramble);
+
+static inline uint64_t read_le64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static void accumulate_scalar(uint64_t *acc, const unsigned char *data,
+                              size_t first_key, size_t n_stripes) {
+    for (size_t s = 0; s < n_stripes; ++s) {
+        const unsigned char *stripe = data + s * HASH_STRIPE_LEN;
+        const uint64_t *key = secret + first_key + s;
+        for (size_t i = 0; i < HASH_LANES; ++i) {
+            uint64_t d = read_le64(stripe + i * sizeof(uint64_t));
+            uint64_t dk = d ^ key[i];
+            acc[i ^ 1] += d;
+            acc[i] += (dk & 0xffffffffULL) * (dk >> 32);
+        }
+    }
+}
+
+__attribute__((unused))
+static void scramble_scalar(uint64_t *acc) {
+    const uint64_t *key = secret + SCRAMBLE_KEY;
+    for (size_t i = 0; i < HASH_LANES; ++i) {
+        uint64_t a = acc[i];
+        a ^= a >> 47;
+        a ^= key[i];
+        acc[i] = a * PRIME32_1;
+    }
+}
+
+#ifdef HASH_X86
+static void accumulate_sse2(uint64_t *acc, const unsigned char *data,
+                            size_t first_key, size_t n_stripes) {
+    __m128i a[4];
+    for (size_t j = 0; j < 4; ++j) {
+        a[j] = _mm_loadu_si128((const __m128i *) (acc + 2 * j));
+    }
+
+    for (size_t s = 0; s < n_stripes; ++s) {
+        const unsigned char *stripe = data + s * HASH_STRIPE_LEN;
+        const uint64_t *key = secret + first_key + s;
+        for (size_t j = 0; j < 4; ++j) {
+            __m128i d = _mm_loadu_si128((const __m128i *) (stripe + 16 * j));
+            __m128i k = _mm_loadu_si128((const __m128i *) (key + 2 * j));
+            __m128i dk = _mm_xor_si128(d, k);
+            // lo(dk) * hi(dk) per 64 bit lane
+            __m128i dk_hi = _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1));
+            __m128i product = _mm_mul_epu32(dk, dk_hi);
+            // swap 64 bit lanes, acc[i ^ 1] += d
+            __m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+            a[j] = _mm_add_epi64(a[j], _mm_add_epi64(product, swapped));
+        }
+    }
+
+    for (size_t j = 0; j < 4; ++j) {
+        _mm_storeu_si128((__m128i *) (acc + 2 * j), a[j]);
+    }
+}
+
+static void scramble_sse2(uint64_t *acc) {
+    const __m128i prime = _mm_set1_epi32((int) PRIME32_1);
+    const uint64_t *key = secret + SCRAMBLE_KEY;
+    for (size_t j = 0; j < 4; ++j) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (acc + 2 * j));
+        __m128i k = _mm_loadu_si128((const __m128i *) (key + 2 * j));
+        a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+        a = _mm_xor_si128(a, k);
+        // 64 x 32 bit multiply from two 32 x 32 products
+        __m128i lo = _mm_mul_epu32(a, prime);
+        __m128i hi = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+        a = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+        _mm_storeu_si128((__m128i *) (acc + 2 * j), a);
+    }
+}
+
+__attribute__((target("avx2")))
+static void accumulate_avx2(uint64_t *acc, const unsigned char *data,
+                            size_t first_key, size_t n_stripes) {
+    __m256i a0 = _mm256_loadu_si256((const __m256i *) acc);
+    __m256i a1 = _mm256_loadu_si256((const __m256i *) (acc + 4));
+
+    for (size_t s = 0; s < n_stripes; ++s) {
+        const unsigned char *stripe = data + s * HASH_STRIPE_LEN;
+        const uint64_t *key = secret + first_key + s;
+
+        __m256i d0 = _mm256_loadu_si256((const __m256i *) stripe);
+        __m256i d1 = _mm256_loadu_si256((const __m256i *) (stripe + 32));
+        __m256i dk0 = _mm256_xor_si256(d0,
+                _mm256_loadu_si256((const __m256i *) key));
+        __m256i dk1 = _mm256_xor_si256(d1,
+                _mm256_loadu_si256((const __m256i *) (key + 4)));
+
+        __m256i p0 = _mm256_mul_epu32(dk0,
+                _mm256_shuffle_epi32(dk0, _MM_SHUFFLE(0, 3, 0, 1)));
+        __m256i p1 = _mm256_mul_epu32(dk1,
+                _mm256_shuffle_epi32(dk1, _MM_SHUFFLE(0, 3, 0, 1)));
+
+        // shuffle is per 128 bit half, so i ^ 1 pairs stay together
+        a0 = _mm256_add_epi64(a0, _mm256_add_epi64(p0,
+                _mm256_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2))));
+        a1 = _mm256_add_epi64(a1, _mm256_add_epi64(p1,
+                _mm256_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2))));
+    }
+
+    _mm256_storeu_si256((__m256i *) acc, a0);
+    _mm256_storeu_si256((__m256i *) (acc + 4), a1);
+}
+
+__attribute__((target("avx2")))
+static void scramble_avx2(uint64_t *acc) {
+    const __m256i prime = _mm256_set1_epi32((int) PRIME32_1);
+    const uint64_t *key = secret + SCRAMBLE_KEY;
+    for (size_t j = 0; j < 2; ++j) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (acc + 4 * j));
+        __m256i k = _mm256_loadu_si256((const __m256i *) (key + 4 * j));
+        a = _mm256_xor_si256(a, _mm256_srli_epi64(a, 47));
+        a = _mm256_xor_si256(a, k);
+        __m256i lo = _mm256_mul_epu32(a, prime);
+        __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), prime);
+        a = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+        _mm256_storeu_si256((__m256i *) (acc + 4 * j), a);
+    }
+}
+#endif
+
+static void select_kernels(accumulate_fn *accumulate, scramble_fn *scramble) {
+#ifdef HASH_X86
+    // sse2 is part of the x86-64 baseline
+    if (__builtin_cpu_supports("avx2")) {
+        *accumulate = accumulate_avx2;
+        *scramble = scramble_avx2;
+    } else {
+        *accumulate = accumulate_sse2;
+        *scramble = scramble_sse2;
+    }
+#else
+    *accumulate = accumulate_scalar;
+    *scramble = scramble_scalar;
+#endif
+    return;
+}
+
+/** @brief Mixes two lanes with a folded 128 bit product.
+ *
+ *  @param a : first lane.
+ *  @param b : second lane.
+ *  @return high and low halves of a * b, xor folded.
+ */
+static inline uint64_t mul_fold64(uint64_t a, uint64_t b) {
+    __uint128_t product = (__uint128_t) a * b;
+    return (uint64_t) product ^ (uint64_t) (product >> 64);
+}
+
+void hash_init(HashState *hs) {
+    hs->acc[0] = PRIME32_3;
+    hs->acc[1] = PRIME64_1;
+    hs->acc[2] = PRIME64_2;
+    hs->acc[3] = PRIME64_3;
+    hs->acc[4] = PRIME64_4;
+    hs->acc[5] = PRIME32_2;
+    hs->acc[6] = PRIME64_5;
+    hs->acc[7] = PRIME32_1;
+    hs->n_stripes = 0;
+    hs->total_len = 0;
+    hs->buf_len = 0;
+    return;
+}
+
+void hash_update(HashState *hs, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *) data;
+    accumulate_fn accumulate;
+    scramble_fn scramble;
+    select_kernels(&accumulate, &scramble);
+
+    hs->total_len += len;
+
+    // complete carried partial stripe
+    if (hs->buf_len) {
+        size_t fill = HASH_STRIPE_LEN - hs->buf_len;
+        if (fill > len) {
+            fill = len;
+        }
+        memcpy(hs->buf + hs->buf_len, p, fill);
+        hs->buf_len += fill;
+        p += fill;
+        len -= fill;
+        if (hs->buf_len < HASH_STRIPE_LEN) {
+            return;
+        }
+        accumulate(hs->acc, hs->buf, hs->n_stripes, 1);
+        hs->buf_len = 0;
+        if (++hs->n_stripes == HASH_STRIPES_PER_BLOCK) {
+            scramble(hs->acc);
+            hs->n_stripes = 0;
+        }
+    }
+
+    // finish current block stripe by stripe
+    while (hs->n_stripes && len >= HASH_STRIPE_LEN) {
+        accumulate(hs->acc, p, hs->n_stripes, 1);
+        p += HASH_STRIPE_LEN;
+        len -= HASH_STRIPE_LEN;
+        if (++hs->n_stripes == HASH_STRIPES_PER_BLOCK) {
+            scramble(hs->acc);
+            hs->n_stripes = 0;
+        }
+    }
+
+    // whole blocks
+    const size_t block_len = HASH_STRIPE_LEN * HASH_STRIPES_PER_BLOCK;
+    while (!hs->n_stripes && len >= block_len) {
+        accumulate(hs->acc, p, 0, HASH_STRIPES_PER_BLOCK);
+        scramble(hs->acc);
+        p += block_len;
+        len -= block_len;
+    }
+
+    // remaining whole stripes, block stays open
+    size_t n_stripes = len / HASH_STRIPE_LEN;
+    if (n_stripes) {
+        accumulate(hs->acc, p, hs->n_stripes, n_stripes);
+        hs->n_stripes += n_stripes;
+        p += n_stripes * HASH_STRIPE_LEN;
+        len -= n_stripes * HASH_STRIPE_LEN;
+    }
+
+    // carry partial stripe
+    memcpy(hs->buf, p, len);
+    hs->buf_len = len;
+    return;
+}
+
+Hash hash_final(HashState *hs) {
+    // zero padded final stripe, length is mixed in below
+    if (hs->buf_len) {
+        memset(hs->buf + hs->buf_len, 0, HASH_STRIPE_LEN - hs->buf_len);
+        accumulate_scalar(hs->acc, hs->buf, hs->n_stripes, 1);
+    }
+
+    uint64_t h = hs->total_len * PRIME64_1;
+    for (size_t i = 0; i < HASH_LANES; i += 2) {
+        h += mul_fold64(hs->acc[i] ^ secret[i + 1],
+                        hs->acc[i + 1] ^ secret[i + 2]);
+    }
+
+    // avalanche
+    h ^= h >> 37;
+    h *= 0x165667919E3779F9ULL;
+    h ^= h >> 32;
+
+    return h & HASH_MASK;
+}
+
+Hash hash_bytes(const void *data, size_t len) {
+    HashState hs;
+    hash_init(&hs);
+    hash_update(&hs, data, len);
+    return hash_final(&hs);
+}
@@ -0,0 +1,60 @@
+#ifndef ASSIGNMENT_2_SVC_HASH_H
+#define ASSIGNMENT_2_SVC_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HASH_LANES 8
+#define HASH_STRIPE_LEN 64
+#define HASH_STRIPES_PER_BLOCK 16
+#define HASH_MASK 0x7fffffffffffffffULL
+
+// 63 bit content hash, top bit is always clear so hashes never collide with
+// the negative error codes returned by the public svc api
+typedef uint64_t Hash;
+
+typedef struct HashState {
+    uint64_t acc[HASH_LANES];            // stripe accumulators
+    size_t n_stripes;                    // stripes accumulated in current block
+    uint64_t total_len;                  // total number of bytes hashed
+    unsigned char buf[HASH_STRIPE_LEN];  // partial stripe carried between updates
+    size_t buf_len;                      // number of bytes in buf
+} HashState;
+
+/** @brief Initialises streaming hash state.
+ *
+ *  @param hs : address of hash state.
+ */
+void hash_init(HashState *hs);
+
+/** @brief Adds bytes to streaming hash.
+ *
+ *  Bytes are consumed in 64 byte stripes, 16 stripes to a block. Full blocks
+ *  are processed by a vectorised kernel (AVX2 or SSE2) when the cpu supports
+ *  it, otherwise by the scalar kernel. All kernels produce identical hashes.
+ *
+ *  @param hs : address of hash state.
+ *  @param data : bytes to be hashed.
+ *  @param len : number of bytes.
+ */
+void hash_update(HashState *hs, const void *data, size_t len);
+
+/** @brief Finalises streaming hash.
+ *
+ *  Hash state must not be updated after finalising.
+ *
+ *  @param hs : address of hash state.
+ *  @return hash of all bytes added to the state.
+ */
+Hash hash_final(HashState *hs);
+
+/** @brief Hashes byte array in one call.
+ *
+ *  @param data : bytes to be hashed.
+ *  @param len : number of bytes.
+ *  @return hash of bytes.
+ */
+Hash hash_bytes(const void *data, size_t len);
+
+#endif //ASSIGNMENT_2_SVC_HASH_H
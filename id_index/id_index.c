@@ -0,0 +1,209 @@
+#include "id_index.h"
+
+typedef struct IdPair {
+    const char *id;  // id of entry
+    size_t index;    // index of entry
+} IdPair;
+
+/** @brief Returns id of entry, empty if unavailable.
+ *
+ *  @param ix : address of id index.
+ *  @param index : index of entry.
+ *  @return null terminated id.
+ */
+static const char *entry_id(IdIndex *ix, size_t index);
+
+/** @brief Adds entry to hash table, replacing any older entry with its id.
+ *
+ *  @param ix : address of id index.
+ *  @param index : index of entry.
+ */
+static void insert_slot(IdIndex *ix, size_t index);
+
+/** @brief Compares id pairs by id, then index.
+ *
+ *  @param a : address of id pair.
+ *  @param b : address of id pair.
+ *  @return negative, 0 or positive, as a orders before, with, or after b.
+ */
+static int compare_id_pair(const void *a, const void *b);
+
+void init_id_index(IdIndex *ix, id_fn get_id, void *ctx, size_t n_entries) {
+    ix->get_id = get_id;
+    ix->ctx = ctx;
+
+    // table at most half full
+    ix->n_slots = INIT_ID_INDEX_SIZE;
+    while (ix->n_slots < n_entries * 2) {
+        ix->n_slots *= 2;
+    }
+    ix->slots = safe_calloc(ix->n_slots, sizeof(IdSlot));
+    ix->n_ids = 0;
+    for (size_t i = 0; i < n_entries; ++i) {
+        insert_slot(ix, i);
+    }
+
+    // sort all entries at once, ids read once each
+    ix->len_sorted = n_entries > INIT_COMMIT_SIZE ? n_entries :
+                     INIT_COMMIT_SIZE;
+    ix->sorted = safe_malloc(ix->len_sorted * sizeof(size_t));
+    ix->n_sorted = n_entries;
+    IdPair *pairs = safe_malloc((n_entries + 1) * sizeof(IdPair));
+    for (size_t i = 0; i < n_entries; ++i) {
+        pairs[i].id = entry_id(ix, i);
+        pairs[i].index = i;
+    }
+    qsort(pairs, n_entries, sizeof(IdPair), compare_id_pair);
+    for (size_t i = 0; i < n_entries; ++i) {
+        ix->sorted[i] = pairs[i].index;
+    }
+    free(pairs);
+    return;
+}
+
+void free_id_index(IdIndex *ix) {
+    if (!ix) {
+        return;
+    }
+
+    free(ix->slots);
+    free(ix->sorted);
+    ix->slots = NULL;
+    ix->sorted = NULL;
+    ix->n_slots = 0;
+    ix->n_ids = 0;
+    ix->n_sorted = 0;
+    ix->len_sorted = 0;
+    return;
+}
+
+void add_id(IdIndex *ix, size_t index) {
+    // resize if necessary
+    if ((ix->n_ids + 1) * 2 > ix->n_slots) {
+        IdSlot *old = ix->slots;
+        size_t n_old = ix->n_slots;
+        ix->n_slots *= ARRAY_GROWTH_RATE;
+        ix->slots = safe_calloc(ix->n_slots, sizeof(IdSlot));
+        size_t mask = ix->n_slots - 1;
+        for (size_t i = 0; i < n_old; ++i) {
+            if (!old[i].entry) {
+                continue;
+            }
+            size_t j = old[i].hash & mask;
+            while (ix->slots[j].entry) {
+                j = (j + 1) & mask;
+            }
+            ix->slots[j] = old[i];
+        }
+        free(old);
+    }
+    insert_slot(ix, index);
+
+    // newest entry, after every entry with an equal or lesser id
+    const char *id = entry_id(ix, index);
+    size_t lo = 0;
+    size_t hi = ix->n_sorted;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(entry_id(ix, ix->sorted[mid]), id) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (ix->n_sorted == ix->len_sorted) {
+        ix->len_sorted *= ARRAY_GROWTH_RATE;
+        ix->sorted = safe_realloc(ix->sorted, ix->len_sorted * sizeof(size_t));
+    }
+    memmove(ix->sorted + lo + 1, ix->sorted + lo,
+            (ix->n_sorted - lo) * sizeof(size_t));
+    ix->sorted[lo] = index;
+    ix->n_sorted++;
+    return;
+}
+
+int64_t find_id(IdIndex *ix, const char *prefix) {
+    size_t len = strlen(prefix);
+
+    // exact id
+    uint32_t hash = (uint32_t) hash_bytes(prefix, len);
+    size_t mask = ix->n_slots - 1;
+    for (size_t i = hash & mask; ix->slots[i].entry; i = (i + 1) & mask) {
+        if (ix->slots[i].hash == hash &&
+            !strcmp(entry_id(ix, ix->slots[i].entry - 1), prefix)) {
+            return (int64_t) ix->slots[i].entry - 1;
+        }
+    }
+
+    if (len < MIN_ID_PREFIX_LEN) {
+        return ID_NOT_FOUND;
+    }
+
+    // ids starting with prefix are adjacent, from the first id not before it
+    size_t lo = 0;
+    size_t hi = ix->n_sorted;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(entry_id(ix, ix->sorted[mid]), prefix) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == ix->n_sorted ||
+        strncmp(entry_id(ix, ix->sorted[lo]), prefix, len) != 0) {
+        return ID_NOT_FOUND;
+    }
+
+    // entries sharing the first matching id, newest last
+    const char *id = entry_id(ix, ix->sorted[lo]);
+    size_t last = lo;
+    for (size_t i = lo + 1; i < ix->n_sorted; ++i) {
+        const char *next = entry_id(ix, ix->sorted[i]);
+        if (strncmp(next, prefix, len) != 0) {
+            break;
+        }
+        if (strcmp(next, id) != 0) {
+            return ID_AMBIGUOUS;
+        }
+        last = i;
+    }
+
+    return (int64_t) ix->sorted[last];
+}
+
+static const char *entry_id(IdIndex *ix, size_t index) {
+    const char *id = ix->get_id(ix->ctx, index);
+    return id ? id : "";
+}
+
+static void insert_slot(IdIndex *ix, size_t index) {
+    const char *id = entry_id(ix, index);
+    uint32_t hash = (uint32_t) hash_bytes(id, strlen(id));
+    size_t mask = ix->n_slots - 1;
+    size_t i = hash & mask;
+    while (ix->slots[i].entry) {
+        if (ix->slots[i].hash == hash &&
+            !strcmp(entry_id(ix, ix->slots[i].entry - 1), id)) {
+            // same id, newer entry replaces it
+            ix->slots[i].entry = (uint32_t) index + 1;
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+
+    ix->slots[i].hash = hash;
+    ix->slots[i].entry = (uint32_t) index + 1;
+    ix->n_ids++;
+    return;
+}
+
+static int compare_id_pair(const void *a, const void *b) {
+    const IdPair *pa = (const IdPair *) a;
+    const IdPair *pb = (const IdPair *) b;
+    int cmp = strcmp(pa->id, pb->id);
+    if (cmp) {
+        return cmp;
+    }
+    return (pa->index > pb->index) - (pa->index < pb->index);
+}
@@ -0,0 +1,80 @@
+#ifndef ASSIGNMENT_2_SVC_ID_INDEX_H
+#define ASSIGNMENT_2_SVC_ID_INDEX_H
+
+#include "../params.h"
+#include "../memory/memory.h"
+#include "../hash/hash.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ID_NOT_FOUND -1
+#define ID_AMBIGUOUS -2
+
+/** @brief Returns id of entry.
+ *
+ *  @param ctx : caller context.
+ *  @param index : index of entry.
+ *  @return null terminated id, NULL if unavailable.
+ */
+typedef const char *(*id_fn)(void *ctx, size_t index);
+
+typedef struct IdSlot {
+    uint32_t hash;   // low bits of hash of id
+    uint32_t entry;  // index of entry + 1, 0 if slot is empty
+} IdSlot;
+
+typedef struct IdIndex {
+    id_fn get_id;       // returns id of entry, ids are never copied
+    void *ctx;          // context passed to get_id
+    IdSlot *slots;      // open addressed table, newest entry of each id
+    size_t n_slots;     // number of slots, power of two
+    size_t n_ids;       // number of distinct ids in slots
+    size_t *sorted;     // all entries, by id then index
+    size_t n_sorted;    // number of entries in sorted
+    size_t len_sorted;  // capacity of sorted
+} IdIndex;
+
+/** @brief Initialises id index over entries [0, n_entries).
+ *
+ *  Entries are identified by index, and their ids read through get_id, so
+ *  ids must stay valid until the index is released. Several entries may share
+ *  an id, lookups then return the newest, the one with the greatest index.
+ *  MUST be released with free_id_index.
+ *
+ *  @param ix : address of id index to be set.
+ *  @param get_id : returns id of entry.
+ *  @param ctx : context passed to get_id.
+ *  @param n_entries : number of existing entries.
+ */
+void init_id_index(IdIndex *ix, id_fn get_id, void *ctx, size_t n_entries);
+
+/** @brief Releases id index.
+ *
+ *  @param ix : address of id index.
+ */
+void free_id_index(IdIndex *ix);
+
+/** @brief Adds entry to id index.
+ *
+ *  Entry MUST have a greater index than every entry already added.
+ *
+ *  @param ix : address of id index.
+ *  @param index : index of entry.
+ */
+void add_id(IdIndex *ix, size_t index);
+
+/** @brief Finds entry by id or unique id prefix.
+ *
+ *  An exact id is found in constant time, and wins over longer ids it is a
+ *  prefix of. Otherwise, if prefix has at least MIN_ID_PREFIX_LEN (params.h)
+ *  characters, the sorted ids are binary searched for ids starting with it.
+ *
+ *  @param ix : address of id index.
+ *  @param prefix : null terminated id or prefix of id.
+ *  @return index of newest entry with matching id, ID_NOT_FOUND if no id
+ *          matches, ID_AMBIGUOUS if several distinct ids match.
+ */
+int64_t find_id(IdIndex *ix, const char *prefix);
+
+#endif //ASSIGNMENT_2_SVC_ID_INDEX_H
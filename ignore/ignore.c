@@ -0,0 +1,418 @@
+#include "ignore.h"
+
+typedef struct WalkState {
+    IgnoreList *ignore;  // ignore list, may be NULL
+    walk_fn fn;          // called for each file found
+    void *ctx;           // context passed to fn
+    char *path;          // path of entry being visited
+    size_t len_path;     // capacity of path
+    size_t n_ignored;    // number of ignored paths
+    size_t n_failed;     // number of unreadable paths
+} WalkState;
+
+typedef struct WalkEntry {
+    char *name;          // name of entry
+    unsigned char type;  // d_type of entry, DT_UNKNOWN if not given
+} WalkEntry;
+
+/** @brief Matches glob against string.
+ *
+ *  Backtracks only at stars, so each star retries the rest of the glob from
+ *  each position it could end at.
+ *
+ *  @param glob : null terminated glob.
+ *  @param s : null terminated string.
+ *  @return 1 if glob matches the whole string, 0 otherwise.
+ */
+static int match_glob(const char *glob, const char *s);
+
+/** @brief Matches one character against a bracket expression.
+ *
+ *  @param glob : address of '[' opening the expression.
+ *  @param c : character to be matched.
+ *  @param end : address for address after closing ']' to be set.
+ *  @return 1 if matched, 0 if not, -1 if glob has no closing ']'.
+ */
+static int match_class(const char *glob, char c, const char **end);
+
+/** @brief Matches compiled pattern against path.
+ *
+ *  @param p : address of pattern.
+ *  @param path : null terminated path.
+ *  @param name : last component of path.
+ *  @return 1 if matched, 0 otherwise.
+ */
+static int match_pattern(IgnorePattern *p, const char *path, const char *name);
+
+/** @brief Walks entries of open directory, then closes it.
+ *
+ *  Entries are read in full before any is visited, so only one directory is
+ *  open at a time, however deep the tree. Files are passed on, ignored
+ *  directories skipped, and other directories walked in turn.
+ *
+ *  @param w : address of walk state, path set to the directory path.
+ *  @param d : open directory.
+ *  @param len : length of directory path, 0 for the current directory.
+ */
+static void walk_dir(WalkState *w, DIR *d, size_t len);
+
+void init_ignore_list(IgnoreList *l) {
+    l->patterns = NULL;
+    l->n_patterns = 0;
+    l->len_patterns = 0;
+    return;
+}
+
+void free_ignore_list(IgnoreList *l) {
+    if (!l) {
+        return;
+    }
+
+    for (size_t i = 0; i < l->n_patterns; ++i) {
+        free(l->patterns[i].glob);
+    }
+    free(l->patterns);
+    init_ignore_list(l);
+    return;
+}
+
+void add_ignore_pattern(IgnoreList *l, const char *line) {
+    if (!l || !line) {
+        return;
+    }
+
+    IgnorePattern p = {0};
+    if (*line == '#' || *line == '\0') {
+        return;
+    }
+    if (*line == '!') {
+        p.negate = 1;
+        line++;
+    } else if (*line == '\\' && (line[1] == '#' || line[1] == '!')) {
+        line++;
+    }
+
+    // trailing spaces are dropped, unless escaped
+    size_t len = strlen(line);
+    while (len && (line[len - 1] == ' ' || line[len - 1] == '\r') &&
+           !(len > 1 && line[len - 2] == '\\')) {
+        len--;
+    }
+    if (len && line[len - 1] == '/') {
+        p.dir_only = 1;
+        len--;
+    }
+    if (len && *line == '/') {
+        p.anchored = 1;
+        line++;
+        len--;
+    }
+    if (!len) {
+        return;
+    }
+
+    p.glob = safe_malloc(len + 1);
+    memcpy(p.glob, line, len);
+    p.glob[len] = '\0';
+    if (strchr(p.glob, '/')) {
+        p.anchored = 1;
+    }
+
+    // compile, simple patterns avoid the glob matcher
+    const char *special = strpbrk(p.glob, "*?[\\");
+    if (!special) {
+        p.kind = IgnoreLiteral;
+    } else if (!p.anchored && special == p.glob && *special == '*' &&
+               !strpbrk(special + 1, "*?[\\")) {
+        p.kind = IgnoreSuffix;
+        p.suffix = p.glob + 1;
+        p.suffix_len = len - 1;
+    } else {
+        p.kind = IgnoreGlob;
+    }
+
+    // resize if necessary
+    if (l->n_patterns == l->len_patterns) {
+        l->len_patterns = l->len_patterns ?
+                          l->len_patterns * ARRAY_GROWTH_RATE :
+                          INIT_STAGING_SIZE;
+        l->patterns = safe_realloc(l->patterns,
+                                   l->len_patterns * sizeof(IgnorePattern));
+    }
+    l->patterns[l->n_patterns++] = p;
+    return;
+}
+
+int load_ignore_file(IgnoreList *l, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    char *line = NULL;
+    size_t len_line = 0;
+    ssize_t n = 0;
+    while ((n = getline(&line, &len_line, f)) != -1) {
+        if (n && line[n - 1] == '\n') {
+            line[n - 1] = '\0';
+        }
+        add_ignore_pattern(l, line);
+    }
+    int failed = ferror(f);
+    free(line);
+    fclose(f);
+    return failed ? -1 : 0;
+}
+
+int is_ignored(IgnoreList *l, const char *path, int is_dir) {
+    if (!l || !path) {
+        return 0;
+    }
+
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+
+    // last match decides
+    for (size_t i = l->n_patterns; i > 0; --i) {
+        IgnorePattern *p = &l->patterns[i - 1];
+        if ((!p->dir_only || is_dir) && match_pattern(p, path, name)) {
+            return !p->negate;
+        }
+    }
+
+    return 0;
+}
+
+int walk_tree(const char *dir_path, IgnoreList *l, walk_fn fn, void *ctx,
+              size_t *n_ignored, size_t *n_failed) {
+    if (!dir_path || !fn) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    DIR *d = opendir(dir_path);
+    if (!d) {
+        return -1;
+    }
+
+    // paths relative to the svc directory parent, as svc_add takes them
+    while (dir_path[0] == '.' && dir_path[1] == '/') {
+        dir_path += 2;
+        while (*dir_path == '/') {
+            dir_path++;
+        }
+    }
+    size_t len = strlen(dir_path);
+    if (len == 1 && *dir_path == '.') {
+        len = 0;
+    }
+    while (len > 1 && dir_path[len - 1] == '/') {
+        len--;
+    }
+
+    WalkState w = {l, fn, ctx, NULL, len + NAME_MAX + 2, 0, 0};
+    w.path = safe_malloc(w.len_path);
+    memcpy(w.path, dir_path, len);
+    w.path[len] = '\0';
+    walk_dir(&w, d, len);
+    free(w.path);
+
+    if (n_ignored) {
+        *n_ignored = w.n_ignored;
+    }
+    if (n_failed) {
+        *n_failed = w.n_failed;
+    }
+    return 0;
+}
+
+static int match_glob(const char *glob, const char *s) {
+    while (*glob) {
+        if (glob[0] == '*' && glob[1] == '*') {
+            glob += 2;
+            if (*glob == '/') {
+                // "**/" matches zero or more whole components
+                glob++;
+                while (1) {
+                    if (match_glob(glob, s)) {
+                        return 1;
+                    }
+                    s = strchr(s, '/');
+                    if (!s) {
+                        return 0;
+                    }
+                    s++;
+                }
+            }
+            for (;; ++s) {
+                if (match_glob(glob, s)) {
+                    return 1;
+                }
+                if (!*s) {
+                    return 0;
+                }
+            }
+        } else if (*glob == '*') {
+            glob++;
+            for (;; ++s) {
+                if (match_glob(glob, s)) {
+                    return 1;
+                }
+                if (!*s || *s == '/') {
+                    return 0;
+                }
+            }
+        } else if (*glob == '?') {
+            if (!*s || *s == '/') {
+                return 0;
+            }
+            glob++;
+            s++;
+        } else if (*glob == '[') {
+            const char *end = NULL;
+            int matched = *s && *s != '/' ? match_class(glob, *s, &end) : 0;
+            if (matched == -1) {
+                // no closing bracket, '[' is literal
+                if (*s != '[') {
+                    return 0;
+                }
+                glob++;
+                s++;
+                continue;
+            }
+            if (!matched) {
+                return 0;
+            }
+            glob = end;
+            s++;
+        } else {
+            if (*glob == '\\' && glob[1]) {
+                glob++;
+            }
+            if (*glob != *s) {
+                return 0;
+            }
+            glob++;
+            s++;
+        }
+    }
+
+    return *s == '\0';
+}
+
+static int match_class(const char *glob, char c, const char **end) {
+    const char *p = glob + 1;
+    int negate = 0;
+    if (*p == '!' || *p == '^') {
+        negate = 1;
+        p++;
+    }
+
+    // ']' first is a member
+    int matched = 0;
+    int first = 1;
+    for (; *p && (first || *p != ']'); ++p, first = 0) {
+        char lo = *p;
+        if (p[1] == '-' && p[2] && p[2] != ']') {
+            if (lo <= c && c <= p[2]) {
+                matched = 1;
+            }
+            p += 2;
+        } else if (lo == c) {
+            matched = 1;
+        }
+    }
+    if (*p != ']') {
+        return -1;
+    }
+
+    *end = p + 1;
+    return matched != negate;
+}
+
+static int match_pattern(IgnorePattern *p, const char *path, const char *name) {
+    const char *s = p->anchored ? path : name;
+    switch (p->kind) {
+        case IgnoreLiteral:
+            return !strcmp(p->glob, s);
+        case IgnoreSuffix: {
+            size_t len = strlen(s);
+            return len >= p->suffix_len &&
+                   !memcmp(s + len - p->suffix_len, p->suffix, p->suffix_len);
+        }
+        case IgnoreGlob:
+            return match_glob(p->glob, s);
+    }
+    return 0;
+}
+
+static void walk_dir(WalkState *w, DIR *d, size_t len) {
+    // read all entries, closing directory before descending
+    size_t len_entries = INIT_STAGING_SIZE;
+    size_t n_entries = 0;
+    WalkEntry *entries = safe_malloc(len_entries * sizeof(WalkEntry));
+    struct dirent *e = NULL;
+    while ((e = readdir(d))) {
+        if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..") ||
+            (!len && !strcmp(e->d_name, SVC_DIR_NAME))) {
+            continue;
+        }
+
+        // resize if necessary
+        if (n_entries == len_entries) {
+            len_entries *= ARRAY_GROWTH_RATE;
+            entries = safe_realloc(entries, len_entries * sizeof(WalkEntry));
+        }
+        entries[n_entries].name = copy_string(e->d_name);
+        entries[n_entries].type = e->d_type;
+        n_entries++;
+    }
+    closedir(d);
+
+    for (size_t i = 0; i < n_entries; ++i) {
+        // path of entry, in place after directory path
+        size_t name_len = strlen(entries[i].name);
+        size_t entry_len = len + (len ? 1 : 0) + name_len;
+        if (entry_len + 1 > w->len_path) {
+            w->len_path = entry_len + NAME_MAX + 2;
+            w->path = safe_realloc(w->path, w->len_path);
+        }
+        if (len) {
+            w->path[len] = '/';
+        }
+        memcpy(w->path + entry_len - name_len, entries[i].name, name_len + 1);
+        free(entries[i].name);
+
+        // file systems without d_type are stat'ed
+        unsigned char type = entries[i].type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (lstat(w->path, &st) == -1) {
+                w->n_failed++;
+                continue;
+            }
+            type = S_ISDIR(st.st_mode) ? DT_DIR :
+                   S_ISREG(st.st_mode) ? DT_REG : DT_LNK;
+        }
+        if (type != DT_DIR && type != DT_REG) {
+            continue;
+        }
+
+        if (is_ignored(w->ignore, w->path, type == DT_DIR)) {
+            w->n_ignored++;
+        } else if (type == DT_REG) {
+            w->fn(w->ctx, w->path);
+        } else {
+            DIR *sub = opendir(w->path);
+            if (sub) {
+                walk_dir(w, sub, entry_len);
+            } else {
+                w->n_failed++;
+            }
+        }
+    }
+    w->path[len] = '\0';
+
+    free(entries);
+    return;
+}
@@ -0,0 +1,110 @@
+#ifndef ASSIGNMENT_2_SVC_IGNORE_H
+#define ASSIGNMENT_2_SVC_IGNORE_H
+
+#include "../params.h"
+#include "../memory/memory.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+enum IgnoreKind {IgnoreLiteral = 0, IgnoreSuffix = 1, IgnoreGlob = 2};
+
+typedef struct IgnorePattern {
+    char *glob;             // pattern, without negation, anchor or last slash
+    enum IgnoreKind kind;   // how glob is matched, set when compiled
+    const char *suffix;     // literal after the leading star, IgnoreSuffix only
+    size_t suffix_len;      // length of suffix
+    int negate;             // 1 if matching paths are no longer ignored
+    int dir_only;           // 1 if only directories match
+    int anchored;           // 1 if matched against the whole path, else name
+} IgnorePattern;
+
+typedef struct IgnoreList {
+    IgnorePattern *patterns;  // patterns, in file order
+    size_t n_patterns;        // number of patterns
+    size_t len_patterns;      // capacity of patterns
+} IgnoreList;
+
+/** @brief Receives a file found by walk_tree.
+ *
+ *  @param ctx : caller context.
+ *  @param file_path : null terminated path, only valid for the call.
+ */
+typedef void (*walk_fn)(void *ctx, const char *file_path);
+
+/** @brief Initialises empty ignore list.
+ *
+ *  MUST be released with free_ignore_list.
+ *
+ *  @param l : address of ignore list to be set.
+ */
+void init_ignore_list(IgnoreList *l);
+
+/** @brief Releases ignore list.
+ *
+ *  @param l : address of ignore list.
+ */
+void free_ignore_list(IgnoreList *l);
+
+/** @brief Compiles pattern and adds it to ignore list.
+ *
+ *  Patterns follow .gitignore rules. Blank lines and lines starting with '#'
+ *  are skipped, and a leading backslash escapes either. A leading '!' makes
+ *  the pattern re-include paths, a trailing '/' matches directories only.
+ *  Patterns with a '/' before their end are matched against the whole path,
+ *  other patterns against the last path component at any depth. '*' and '?'
+ *  match within one component, '**' across components, and '[...]' matches
+ *  one character of a set. Literal and '*' suffix patterns skip the glob
+ *  matcher entirely.
+ *
+ *  @param l : address of ignore list.
+ *  @param line : null terminated pattern, without newline.
+ */
+void add_ignore_pattern(IgnoreList *l, const char *line);
+
+/** @brief Reads ignore patterns from file, one per line.
+ *
+ *  A missing file adds no patterns.
+ *
+ *  @param l : address of ignore list.
+ *  @param path : path of ignore file.
+ *  @return 0 if successful or missing, -1 if file cannot be read.
+ */
+int load_ignore_file(IgnoreList *l, const char *path);
+
+/** @brief Checks if path is ignored.
+ *
+ *  The last pattern matching path decides, so later negated patterns can
+ *  re-include paths of earlier patterns.
+ *
+ *  @param l : address of ignore list.
+ *  @param path : null terminated path, relative to the svc directory parent.
+ *  @param is_dir : 1 if path is a directory.
+ *  @return 1 if ignored, 0 otherwise.
+ */
+int is_ignored(IgnoreList *l, const char *path, int is_dir);
+
+/** @brief Walks regular files under directory, skipping ignored paths.
+ *
+ *  Directories are read with readdir, in getdents64 sized batches, and entry
+ *  types taken from d_type, so files are only stat'ed on file systems that do
+ *  not report it. Symbolic links are not followed. Ignored directories are
+ *  not entered, and the svc directory is always skipped. Paths passed to fn
+ *  start with dir_path, less any leading "./", and are in directory order.
+ *
+ *  @param dir_path : null terminated path of directory.
+ *  @param l : address of ignore list, may be NULL.
+ *  @param fn : called for each file found.
+ *  @param ctx : context passed to fn.
+ *  @param n_ignored : address for number of ignored paths to be set.
+ *  @param n_failed : address for number of unreadable paths to be set.
+ *  @return 0 if successful, -1 if dir_path cannot be walked, with errno set.
+ */
+int walk_tree(const char *dir_path, IgnoreList *l, walk_fn fn, void *ctx,
+              size_t *n_ignored, size_t *n_failed);
+
+#endif //ASSIGNMENT_2_SVC_IGNORE_H
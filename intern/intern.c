@@ -0,0 +1,130 @@
+#include "intern.h"
+
+typedef struct PathTable {
+    PathEntry **slots;  // open addressed table, NULL if slot is empty
+    size_t n_slots;     // number of slots, power of two, 0 if unused
+    size_t n_paths;     // number of paths in slots
+    Arena arena;        // entries, released at once
+} PathTable;
+
+static PathTable table = {NULL, 0, 0, {NULL, NULL}};
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** @brief Finds slot of path, or the empty slot it would take.
+ *
+ *  @param path : null terminated path.
+ *  @param len : length of path.
+ *  @param hash : hash of path.
+ *  @return index of slot.
+ */
+static size_t find_slot(const char *path, size_t len, Hash hash);
+
+/** @brief Doubles number of slots, rehashing from the stored hashes.
+ */
+static void grow_table(void);
+
+char *intern_path(const char *path) {
+    if (!path) {
+        return NULL;
+    }
+
+    size_t len = strlen(path);
+    Hash hash = hash_bytes(path, len);
+    pthread_mutex_lock(&table_lock);
+
+    // table is created on first use
+    if (!table.n_slots) {
+        table.n_slots = INIT_PATH_TABLE_SIZE;
+        table.slots = safe_calloc(table.n_slots, sizeof(PathEntry *));
+        table.n_paths = 0;
+        init_arena(&table.arena, PATH_TABLE_BLOCK_SIZE);
+    }
+
+    size_t i = find_slot(path, len, hash);
+    if (!table.slots[i]) {
+        // at most half full
+        if ((table.n_paths + 1) * 2 > table.n_slots) {
+            grow_table();
+            i = find_slot(path, len, hash);
+        }
+        PathEntry *e = arena_alloc(&table.arena,
+                                   sizeof(PathEntry) + len + 1);
+        e->hash = hash;
+        e->len = len;
+        memcpy(e->path, path, len + 1);
+        table.slots[i] = e;
+        table.n_paths++;
+    }
+
+    char *interned = table.slots[i]->path;
+    pthread_mutex_unlock(&table_lock);
+    return interned;
+}
+
+char *find_interned_path(const char *path) {
+    if (!path) {
+        return NULL;
+    }
+
+    size_t len = strlen(path);
+    Hash hash = hash_bytes(path, len);
+    pthread_mutex_lock(&table_lock);
+    char *interned = NULL;
+    if (table.n_slots) {
+        size_t i = find_slot(path, len, hash);
+        interned = table.slots[i] ? table.slots[i]->path : NULL;
+    }
+    pthread_mutex_unlock(&table_lock);
+    return interned;
+}
+
+size_t get_interned_path_count(void) {
+    pthread_mutex_lock(&table_lock);
+    size_t n = table.n_paths;
+    pthread_mutex_unlock(&table_lock);
+    return n;
+}
+
+void clear_path_table(void) {
+    pthread_mutex_lock(&table_lock);
+    if (table.n_slots) {
+        free(table.slots);
+        free_arena(&table.arena);
+    }
+    table.slots = NULL;
+    table.n_slots = 0;
+    table.n_paths = 0;
+    pthread_mutex_unlock(&table_lock);
+    return;
+}
+
+static size_t find_slot(const char *path, size_t len, Hash hash) {
+    size_t mask = table.n_slots - 1;
+    size_t i = hash & mask;
+    while (table.slots[i] &&
+           (table.slots[i]->hash != hash || table.slots[i]->len != len ||
+            memcmp(table.slots[i]->path, path, len) != 0)) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static void grow_table(void) {
+    PathEntry **old = table.slots;
+    size_t n_old = table.n_slots;
+    table.n_slots *= ARRAY_GROWTH_RATE;
+    table.slots = safe_calloc(table.n_slots, sizeof(PathEntry *));
+    size_t mask = table.n_slots - 1;
+    for (size_t i = 0; i < n_old; ++i) {
+        if (!old[i]) {
+            continue;
+        }
+        size_t j = old[i]->hash & mask;
+        while (table.slots[j]) {
+            j = (j + 1) & mask;
+        }
+        table.slots[j] = old[i];
+    }
+    free(old);
+    return;
+}
@@ -0,0 +1,69 @@
+#ifndef ASSIGNMENT_2_SVC_INTERN_H
+#define ASSIGNMENT_2_SVC_INTERN_H
+
+#include "../params.h"
+#include "../memory/memory.h"
+#include "../hash/hash.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+typedef struct PathEntry {
+    Hash hash;    // hash of path, from hash_bytes
+    size_t len;   // length of path, without null terminator
+    char path[];  // null terminated path, handed out by intern_path
+} PathEntry;
+
+/** @brief Interns path.
+ *
+ *  Paths are kept in one process wide table, each stored once, with its hash
+ *  and length. Equal paths are always given the same address, so interned
+ *  paths are equal exactly when their addresses are. Returned path is valid
+ *  until clear_path_table, do NOT free or modify. Safe to call from several
+ *  threads at once.
+ *
+ *  @param path : null terminated path.
+ *  @return interned path, NULL if path is NULL.
+ */
+char *intern_path(const char *path);
+
+/** @brief Finds interned path, without interning it.
+ *
+ *  @param path : null terminated path.
+ *  @return interned path, NULL if path was never interned, or is NULL.
+ */
+char *find_interned_path(const char *path);
+
+/** @brief Returns hash of interned path.
+ *
+ *  @param path : path returned by intern_path.
+ *  @return hash of path, as hash_bytes.
+ */
+static inline Hash interned_path_hash(const char *path) {
+    return ((const PathEntry *) (path - offsetof(PathEntry, path)))->hash;
+}
+
+/** @brief Returns length of interned path.
+ *
+ *  @param path : path returned by intern_path.
+ *  @return length of path, without null terminator.
+ */
+static inline size_t interned_path_len(const char *path) {
+    return ((const PathEntry *) (path - offsetof(PathEntry, path)))->len;
+}
+
+/** @brief Returns number of interned paths.
+ *
+ *  @return number of distinct paths in the table.
+ */
+size_t get_interned_path_count(void);
+
+/** @brief Releases every interned path.
+ *
+ *  MUST only be called once no branch or commit refers to interned paths, as
+ *  when the svc helper is released.
+ */
+void clear_path_table(void);
+
+#endif //ASSIGNMENT_2_SVC_INTERN_H
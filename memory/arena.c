@@ -0,0 +1,99 @@
+#include "memory.h"
+#include "../params.h"
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+/** @brief Rounds size up to the arena alignment.
+ *
+ *  @param size : number of bytes.
+ *  @return aligned number of bytes.
+ */
+static size_t align_size(size_t size);
+
+/** @brief Adds block to arena, which becomes the block allocated from.
+ *
+ *  @param a : address of arena.
+ *  @param size : number of bytes in block.
+ */
+static void add_block(Arena *a, size_t size);
+
+void init_arena(Arena *a, size_t size) {
+    a->head = NULL;
+    a->last = NULL;
+    add_block(a, align_size(size ? size : ARENA_ALIGN));
+    return;
+}
+
+void *arena_alloc(Arena *a, size_t size) {
+    size = align_size(size ? size : 1);
+
+    // new block, at least as large as the last
+    if (a->head->size - a->head->used < size) {
+        size_t block_size = a->head->size * ARRAY_GROWTH_RATE;
+        add_block(a, block_size > size ? block_size : size);
+    }
+
+    void *p = a->head->data + a->head->used;
+    a->head->used += size;
+    a->last = p;
+    return p;
+}
+
+void *arena_grow(Arena *a, void *old, size_t old_size, size_t size) {
+    if (!old) {
+        return arena_alloc(a, size);
+    }
+
+    // last allocation extends to the end of the used bytes
+    if (old == a->last) {
+        size_t start = (unsigned char *) old - a->head->data;
+        size_t aligned = align_size(size);
+        if (aligned <= a->head->size - start) {
+            a->head->used = start + aligned;
+            return old;
+        }
+    }
+
+    void *p = arena_alloc(a, size);
+    memcpy(p, old, old_size);
+    return p;
+}
+
+char *arena_copy_string(Arena *a, const char *string) {
+    if (!string) {
+        return NULL;
+    }
+
+    size_t len = strlen(string) + 1;
+    char *str_cpy = arena_alloc(a, len);
+    memcpy(str_cpy, string, len);
+    return str_cpy;
+}
+
+void free_arena(Arena *a) {
+    if (!a) {
+        return;
+    }
+
+    // block holding the arena itself may be freed, read next first
+    ArenaBlock *b = a->head;
+    while (b) {
+        ArenaBlock *next = b->next;
+        free(b);
+        b = next;
+    }
+    return;
+}
+
+static size_t align_size(size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+static void add_block(Arena *a, size_t size) {
+    ArenaBlock *b = safe_malloc(sizeof(ArenaBlock) + size);
+    b->next = a->head;
+    b->size = size;
+    b->used = 0;
+    a->head = b;
+    return;
+}
@@ -5,6 +5,19 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdalign.h>
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;  // previously filled block, NULL if first
+    size_t size;              // number of bytes in data
+    size_t used;              // number of bytes handed out
+    alignas(max_align_t) unsigned char data[];  // allocations
+} ArenaBlock;
+
+typedef struct Arena {
+    ArenaBlock *head;  // block allocations are taken from
+    void *last;        // last allocation, may be grown in place
+} Arena;
 
 /** @brief Wraps malloc, calls perror and exits on error.
  *
@@ -25,6 +38,16 @@ void *safe_malloc(size_t size);
  */
 void *safe_realloc(void *old, size_t size);
 
+/** @brief Wraps calloc, calls perror and exits on error.
+ *
+ *  If calloc returns null, perror is called and program exits with status 2.
+ *
+ *  @param n : number of elements to be allocated.
+ *  @param size : number of bytes per element.
+ *  @return address of zeroed memory.
+ */
+void *safe_calloc(size_t n, size_t size);
+
 /** @brief Copies string.
  *
  *  Copies null terminated string to new, dynamicaly allocated address.
@@ -35,4 +58,57 @@ void *safe_realloc(void *old, size_t size);
  */
 char *copy_string(char *string);
 
+/** @brief Initialises bump arena.
+ *
+ *  Allocations are taken from blocks in order, and never released on their
+ *  own, the whole arena is released at once with free_arena. The first block
+ *  holds size bytes, later blocks grow by ARRAY_GROWTH_RATE (params.h). If
+ *  allocation fails, perror is called and program exits with status 2.
+ *
+ *  @param a : address of arena to be set.
+ *  @param size : number of bytes in first block.
+ */
+void init_arena(Arena *a, size_t size);
+
+/** @brief Allocates memory from arena.
+ *
+ *  Memory is aligned for any type, and valid until the arena is released.
+ *
+ *  @param a : address of arena.
+ *  @param size : number of bytes to be allocated.
+ *  @return address of allocated memory.
+ */
+void *arena_alloc(Arena *a, size_t size);
+
+/** @brief Grows arena allocation.
+ *
+ *  The last allocation grows in place if its block has room. Otherwise new
+ *  memory is allocated, and old_size bytes copied, the old memory is only
+ *  reclaimed with the arena.
+ *
+ *  @param a : address of arena.
+ *  @param old : address of allocation, may be NULL.
+ *  @param old_size : size of allocation.
+ *  @param size : new size, at least old_size.
+ *  @return address of grown allocation.
+ */
+void *arena_grow(Arena *a, void *old, size_t old_size, size_t size);
+
+/** @brief Copies string into arena.
+ *
+ *  @param a : address of arena.
+ *  @param string : null terminated string, may be NULL.
+ *  @return copied string, NULL if string is NULL.
+ */
+char *arena_copy_string(Arena *a, const char *string);
+
+/** @brief Releases every block of arena.
+ *
+ *  All memory allocated from the arena is released, in one free per block.
+ *  If arena is NULL, nothing is done.
+ *
+ *  @param a : address of arena.
+ */
+void free_arena(Arena *a);
+
 #endif //ASSIGNMENT_2_SVC_MEMORY_H
@@ -9,6 +9,15 @@ void *safe_malloc(size_t size) {
     return p;
 }
 
+void *safe_calloc(size_t n, size_t size) {
+    void *p = calloc(n, size);
+    if (!p) {
+        perror("calloc failed\n");
+        exit(2);
+    }
+    return p;
+}
+
 void *safe_realloc(void *old, size_t size) {
     void *p = realloc(old, size);
     if (!p) {
@@ -0,0 +1,217 @@
+#include "object.h"
+
+#define DELTA_OP_INSERT 0
+#define DELTA_OP_COPY 1
+
+/** @brief Hashes a DELTA_BLOCK_SIZE byte block into the base index.
+ *
+ *  @param p : address of block.
+ *  @param shift : 64 less the number of table bits.
+ *  @return table index.
+ */
+static inline size_t delta_hash(const char *p, unsigned shift) {
+    uint64_t a, b;
+    memcpy(&a, p, sizeof(a));
+    memcpy(&b, p + 8, sizeof(b));
+    return (size_t) ((a * 0x9e3779b185ebca87ULL ^ b * 0xc2b2ae3d27d4eb4fULL)
+                     >> shift);
+}
+
+/** @brief Counts equal leading bytes, a word at a time.
+ *
+ *  @param a : bytes.
+ *  @param b : bytes.
+ *  @param max : number of bytes available in both.
+ *  @return number of equal leading bytes.
+ */
+static inline size_t match_length(const char *a, const char *b, size_t max) {
+    size_t n = 0;
+    while (n + 8 <= max) {
+        uint64_t x, y;
+        memcpy(&x, a + n, sizeof(x));
+        memcpy(&y, b + n, sizeof(y));
+        if (x != y) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            return n + (size_t) __builtin_clzll(x ^ y) / 8;
+#else
+            return n + (size_t) __builtin_ctzll(x ^ y) / 8;
+#endif
+        }
+        n += 8;
+    }
+    while (n < max && a[n] == b[n]) {
+        ++n;
+    }
+    return n;
+}
+
+/** @brief Appends variable length integer, 7 bits per byte.
+ *
+ *  @param buf : address of buffer address, grown if necessary.
+ *  @param len : address of buffer length.
+ *  @param cap : address of buffer capacity.
+ *  @param v : integer.
+ */
+static void put_varint(char **buf, size_t *len, size_t *cap, uint64_t v) {
+    if (*len + 10 > *cap) {
+        *cap = (*cap + 10) * ARRAY_GROWTH_RATE;
+        *buf = safe_realloc(*buf, *cap);
+    }
+    do {
+        unsigned char byte = v & 0x7f;
+        v >>= 7;
+        (*buf)[(*len)++] = (char) (byte | (v ? 0x80 : 0));
+    } while (v);
+    return;
+}
+
+/** @brief Reads variable length integer.
+ *
+ *  @param p : address of read position, advanced past the integer.
+ *  @param end : end of input.
+ *  @param v : address of integer to be set.
+ *  @return 0 if successful, -1 if input ends or integer is too long.
+ */
+static int get_varint(const unsigned char **p, const unsigned char *end,
+                      uint64_t *v) {
+    *v = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (*p == end) {
+            return -1;
+        }
+        unsigned char byte = *(*p)++;
+        *v |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/** @brief Appends insert op for target bytes.
+ *
+ *  @param buf : address of buffer address, grown if necessary.
+ *  @param len : address of buffer length.
+ *  @param cap : address of buffer capacity.
+ *  @param src : bytes inserted.
+ *  @param n : number of bytes, nothing is appended if 0.
+ */
+static void put_insert(char **buf, size_t *len, size_t *cap, const char *src,
+                       size_t n) {
+    if (!n) {
+        return;
+    }
+    put_varint(buf, len, cap, DELTA_OP_INSERT);
+    put_varint(buf, len, cap, n);
+    if (*len + n > *cap) {
+        *cap = (*len + n) * ARRAY_GROWTH_RATE;
+        *buf = safe_realloc(*buf, *cap);
+    }
+    memcpy(*buf + *len, src, n);
+    *len += n;
+    return;
+}
+
+size_t delta_encode(const char *base, size_t base_len, const char *target,
+                    size_t target_len, size_t limit, char **delta) {
+    *delta = NULL;
+    if (base_len < DELTA_BLOCK_SIZE || target_len < DELTA_BLOCK_SIZE) {
+        return 0;
+    }
+
+    // index base blocks, a slot per block, later blocks replace earlier
+    size_t n_blocks = base_len / DELTA_BLOCK_SIZE;
+    if (n_blocks >= UINT32_MAX) {
+        return 0;
+    }
+    unsigned bits = 4;
+    while (((size_t) 1 << bits) < n_blocks) {
+        ++bits;
+    }
+    uint32_t *table = safe_calloc((size_t) 1 << bits, sizeof(uint32_t));
+    for (size_t i = 0; i < n_blocks; ++i) {
+        // block + 1, 0 is empty
+        table[delta_hash(base + i * DELTA_BLOCK_SIZE, 64 - bits)] =
+                (uint32_t) i + 1;
+    }
+
+    size_t cap = target_len / 8 + 64;
+    size_t len = 0;
+    char *buf = safe_malloc(cap);
+    size_t pos = 0;
+    size_t pending = 0;
+    while (pos + DELTA_BLOCK_SIZE <= target_len && len < limit) {
+        size_t cand = table[delta_hash(target + pos, 64 - bits)];
+        if (!cand || memcmp(base + (cand - 1) * DELTA_BLOCK_SIZE, target + pos,
+                            DELTA_BLOCK_SIZE) != 0) {
+            ++pos;
+            continue;
+        }
+
+        // extend match backwards over pending inserts, then forwards
+        size_t b = (cand - 1) * DELTA_BLOCK_SIZE;
+        size_t t = pos;
+        while (t > pending && b > 0 && base[b - 1] == target[t - 1]) {
+            --b;
+            --t;
+        }
+        size_t n = pos - t + DELTA_BLOCK_SIZE;
+        size_t max = target_len - t < base_len - b ?
+                     target_len - t : base_len - b;
+        n += match_length(base + b + n, target + t + n, max - n);
+
+        put_insert(&buf, &len, &cap, target + pending, t - pending);
+        put_varint(&buf, &len, &cap, DELTA_OP_COPY);
+        put_varint(&buf, &len, &cap, b);
+        put_varint(&buf, &len, &cap, n);
+        pos = t + n;
+        pending = pos;
+    }
+    free(table);
+    if (len < limit) {
+        put_insert(&buf, &len, &cap, target + pending, target_len - pending);
+    }
+
+    // not worth it
+    if (len >= limit) {
+        free(buf);
+        return 0;
+    }
+
+    *delta = buf;
+    return len;
+}
+
+int delta_apply(const char *base, size_t base_len, const char *delta,
+                size_t delta_len, char *dst, size_t dst_len) {
+    const unsigned char *p = (const unsigned char *) delta;
+    const unsigned char *end = p + delta_len;
+    size_t out = 0;
+    while (p < end) {
+        uint64_t op, a, n;
+        if (get_varint(&p, end, &op) == -1) {
+            return -1;
+        }
+
+        if (op == DELTA_OP_INSERT) {
+            if (get_varint(&p, end, &n) == -1 || n > (uint64_t) (end - p) ||
+                n > dst_len - out) {
+                return -1;
+            }
+            memcpy(dst + out, p, n);
+            p += n;
+        } else if (op == DELTA_OP_COPY) {
+            if (get_varint(&p, end, &a) == -1 ||
+                get_varint(&p, end, &n) == -1 || a > base_len ||
+                n > base_len - a || n > dst_len - out) {
+                return -1;
+            }
+            memcpy(dst + out, base + a, n);
+        } else {
+            return -1;
+        }
+        out += n;
+    }
+
+    return out == dst_len ? 0 : -1;
+}
@@ -0,0 +1,225 @@
+#include "object.h"
+
+#define LZ_HASH_BITS 13
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5
+#define LZ_MATCH_LIMIT 12
+#define LZ_MAX_OFFSET 65535
+#define LZ_RUN_MASK 15
+#define LZ_SKIP_SHIFT 6
+
+/** @brief Reads 4 unaligned bytes.
+ *
+ *  @param p : address of bytes.
+ *  @return bytes as native integer.
+ */
+static inline uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/** @brief Hashes 4 bytes into the match table.
+ *
+ *  @param v : 4 bytes.
+ *  @return table index.
+ */
+static inline uint32_t lz_hash(uint32_t v) {
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+/** @brief Writes length continuation bytes.
+ *
+ *  Lengths at or above the token run mask continue as 255 valued bytes,
+ *  followed by the remainder.
+ *
+ *  @param op : address for bytes to be written.
+ *  @param len : length less the run mask.
+ *  @return address after written bytes.
+ */
+static unsigned char *write_length(unsigned char *op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (unsigned char) len;
+    return op;
+}
+
+/** @brief Reads length continuation bytes.
+ *
+ *  @param ip : address of input position, advanced past the length.
+ *  @param iend : end of input.
+ *  @param len : address of length to be extended.
+ *  @return 0 if successful, -1 if input ends.
+ */
+static int read_length(const unsigned char **ip, const unsigned char *iend,
+                       size_t *len) {
+    unsigned char b;
+    do {
+        if (*ip >= iend) {
+            return -1;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+size_t lz_bound(size_t len) {
+    return len + len / 255 + 16;
+}
+
+size_t lz_compress(const char *src, size_t src_len, char *dst, size_t dst_cap) {
+    const unsigned char *base = (const unsigned char *) src;
+    const unsigned char *ip = base;
+    const unsigned char *anchor = base;
+    const unsigned char *iend = base + src_len;
+    unsigned char *op = (unsigned char *) dst;
+    unsigned char *oend = op + dst_cap;
+
+    uint32_t *table = calloc((size_t) 1 << LZ_HASH_BITS, sizeof(uint32_t));
+    if (!table) {
+        perror("calloc failed\n");
+        exit(2);
+    }
+
+    if (src_len >= LZ_MATCH_LIMIT) {
+        const unsigned char *match_limit = iend - LZ_MATCH_LIMIT;
+        const unsigned char *extend_limit = iend - LZ_LAST_LITERALS;
+
+        while (ip < match_limit) {
+            uint32_t h = lz_hash(read32(ip));
+            const unsigned char *ref = base + table[h];
+            table[h] = (uint32_t) (ip - base);
+
+            if (ref >= ip || ip - ref > LZ_MAX_OFFSET ||
+                read32(ref) != read32(ip)) {
+                // skip faster through incompressible runs
+                ip += 1 + ((size_t) (ip - anchor) >> LZ_SKIP_SHIFT);
+                continue;
+            }
+
+            // extend match forwards
+            size_t match_len = LZ_MIN_MATCH;
+            while (ip + match_len < extend_limit &&
+                   ref[match_len] == ip[match_len]) {
+                match_len++;
+            }
+
+            // token, literals, offset, match length
+            size_t lit_len = (size_t) (ip - anchor);
+            size_t need = 1 + lit_len / 255 + 1 + lit_len + 2 +
+                          (match_len - LZ_MIN_MATCH) / 255 + 1;
+            if ((size_t) (oend - op) < need) {
+                free(table);
+                return 0;
+            }
+
+            unsigned char *token = op++;
+            *token = 0;
+            if (lit_len >= LZ_RUN_MASK) {
+                *token = LZ_RUN_MASK << 4;
+                op = write_length(op, lit_len - LZ_RUN_MASK);
+            } else {
+                *token = (unsigned char) (lit_len << 4);
+            }
+            memcpy(op, anchor, lit_len);
+            op += lit_len;
+
+            size_t offset = (size_t) (ip - ref);
+            *op++ = (unsigned char) (offset & 0xff);
+            *op++ = (unsigned char) (offset >> 8);
+
+            size_t extra = match_len - LZ_MIN_MATCH;
+            if (extra >= LZ_RUN_MASK) {
+                *token |= LZ_RUN_MASK;
+                op = write_length(op, extra - LZ_RUN_MASK);
+            } else {
+                *token |= (unsigned char) extra;
+            }
+
+            ip += match_len;
+            anchor = ip;
+        }
+    }
+
+    // final literals, sequence without a match
+    size_t lit_len = (size_t) (iend - anchor);
+    if ((size_t) (oend - op) < 1 + lit_len / 255 + 1 + lit_len) {
+        free(table);
+        return 0;
+    }
+    if (lit_len >= LZ_RUN_MASK) {
+        *op++ = LZ_RUN_MASK << 4;
+        op = write_length(op, lit_len - LZ_RUN_MASK);
+    } else {
+        *op++ = (unsigned char) (lit_len << 4);
+    }
+    memcpy(op, anchor, lit_len);
+    op += lit_len;
+
+    free(table);
+    return (size_t) (op - (unsigned char *) dst);
+}
+
+int lz_decompress(const char *src, size_t src_len, char *dst, size_t dst_len) {
+    const unsigned char *ip = (const unsigned char *) src;
+    const unsigned char *iend = ip + src_len;
+    unsigned char *op = (unsigned char *) dst;
+    unsigned char *obase = op;
+    unsigned char *oend = op + dst_len;
+
+    while (ip < iend) {
+        unsigned char token = *ip++;
+
+        // literals
+        size_t lit_len = token >> 4;
+        if (lit_len == LZ_RUN_MASK && read_length(&ip, iend, &lit_len) == -1) {
+            return -1;
+        }
+        if (lit_len > (size_t) (iend - ip) || lit_len > (size_t) (oend - op)) {
+            return -1;
+        }
+        memcpy(op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        // last sequence has no match
+        if (ip == iend) {
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return -1;
+        }
+        size_t offset = (size_t) ip[0] | ((size_t) ip[1] << 8);
+        ip += 2;
+        if (!offset || offset > (size_t) (op - obase)) {
+            return -1;
+        }
+
+        size_t match_len = token & LZ_RUN_MASK;
+        if (match_len == LZ_RUN_MASK &&
+            read_length(&ip, iend, &match_len) == -1) {
+            return -1;
+        }
+        match_len += LZ_MIN_MATCH;
+        if (match_len > (size_t) (oend - op)) {
+            return -1;
+        }
+
+        // matches may overlap their own output
+        const unsigned char *ref = op - offset;
+        if (offset >= match_len) {
+            memcpy(op, ref, match_len);
+            op += match_len;
+        } else {
+            for (size_t i = 0; i < match_len; ++i) {
+                *op++ = ref[i];
+            }
+        }
+    }
+
+    return op == oend ? 0 : -1;
+}
@@ -0,0 +1,1421 @@
+#define _GNU_SOURCE
+#include "object.h"
+
+// codec table, indexed by enum Codec, store mode has no frame codec
+static const ObjectCodec codecs[N_CODECS] = {
+        [CodecStore] = {"store", NULL, NULL, NULL},
+        [CodecLz] = {"lz", lz_bound, lz_compress, lz_decompress},
+        [CodecDelta] = {"delta", NULL, NULL, NULL},
+        [CodecChunked] = {"chunked", NULL, NULL, NULL},
+};
+
+// objects written, process wide
+static ObjectStats object_stats;
+static pthread_mutex_t object_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// pack and mapped index of the svc directory, process wide
+static struct {
+    int pack_fd;                  // descriptor of pack, -1 if closed
+    uint64_t pack_end;            // offset of next object appended
+    unsigned char *index;         // mapped index, NULL if no index
+    size_t index_size;            // size of mapping
+    uint64_t n_indexed;           // number of entries in index
+    PackEntry *pending;           // open addressed table of batch entries
+    size_t n_pending;             // number of entries in pending
+    size_t len_pending;           // number of slots, power of two
+    size_t batch_depth;           // nesting depth of batches
+} store = {.pack_fd = -1};
+static pthread_mutex_t store_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// reconstructed delta bases, least recently used evicted first
+static struct {
+    Hash hash;           // hash of cached object
+    char *contents;      // contents, NULL if slot is empty
+    size_t len;          // length of contents
+    uint64_t last_used;  // cache clock at last use
+} cache[DELTA_CACHE_ENTRIES];
+static size_t cache_bytes;
+static uint64_t cache_clock;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** @brief Appends object to the pack, unless it is already stored.
+ *
+ *  Pack space is reserved under the store lock, and written outside it. If
+ *  the object cannot be written, perror is called and exit with status 2
+ *  occurs.
+ *
+ *  @param hash : hash of object.
+ *  @param header : address of object header.
+ *  @param data : object data, written at the data offset.
+ *  @param data_len : length of data.
+ */
+static void append_object(Hash hash, ObjectHeader *header, const char *data,
+                          size_t data_len);
+
+/** @brief Reserves pack space for object, unless it is already stored.
+ *
+ *  The reservation holds a batch open, finish_object MUST be called once the
+ *  object is written.
+ *
+ *  @param hash : hash of object.
+ *  @param header : address of object header.
+ *  @param data_len : length of object data.
+ *  @param entry : address of pack entry to be set.
+ *  @param disk_len : address for pack bytes used, including padding.
+ *  @return 0 if space is reserved, 1 if object is already stored.
+ */
+static int reserve_object(Hash hash, ObjectHeader *header, uint64_t data_len,
+                          PackEntry *entry, uint64_t *disk_len);
+
+/** @brief Ends batch held by a reservation and counts object.
+ *
+ *  @param header : address of object header.
+ *  @param disk_len : pack bytes used, including padding.
+ */
+static void finish_object(ObjectHeader *header, uint64_t disk_len);
+
+/** @brief Copies file into the pack.
+ *
+ *  @param src : descriptor of file, copied from its start.
+ *  @param len : number of bytes copied.
+ *  @param offset : pack offset of first byte written.
+ *  @return 0 if successful, -1 otherwise.
+ */
+static int copy_into_pack(int src, uint64_t len, uint64_t offset);
+
+/** @brief Compresses and writes buffered frame of stream to temporary object.
+ *
+ *  @param ow : address of object writer.
+ *  @return 0 if successful, -1 otherwise.
+ */
+static int flush_frame(ObjectWriter *ow);
+
+/** @brief Finds object in index or current batch.
+ *
+ *  Store lock must be held.
+ *
+ *  @param hash : hash of object.
+ *  @param entry : address of entry to be set, may be NULL.
+ *  @return 1 if found, 0 otherwise.
+ */
+static int find_object(Hash hash, PackEntry *entry);
+
+/** @brief Adds entry to current batch, growing the table if necessary.
+ *
+ *  Store lock must be held.
+ *
+ *  @param entry : address of entry.
+ */
+static void add_pending(PackEntry *entry);
+
+/** @brief Copies cached object.
+ *
+ *  @param hash : hash of object.
+ *  @param len : address for length of contents to be set.
+ *  @return address of copy of contents, MUST be released, NULL if not cached.
+ */
+static char *cache_get(Hash hash, size_t *len);
+
+/** @brief Caches copy of object, evicting least recently used objects.
+ *
+ *  @param hash : hash of object.
+ *  @param contents : contents of object.
+ *  @param len : length of contents.
+ */
+static void cache_put(Hash hash, const char *contents, size_t len);
+
+/** @brief Reads object data, from data offset to the end of the object.
+ *
+ *  @param hash : hash of object.
+ *  @param header : address of header to be set.
+ *  @param data_len : address for length of data to be set.
+ *  @return address of data, MUST be released, NULL if object cannot be read.
+ */
+static char *read_data(Hash hash, ObjectHeader *header, size_t *data_len);
+
+/** @brief Decodes store or compressed object data.
+ *
+ *  @param header : address of object header.
+ *  @param data : object data, released by this call.
+ *  @param data_len : length of data.
+ *  @return address of contents, MUST be released, NULL if data is corrupt.
+ */
+static char *decode_data(ObjectHeader *header, char *data, size_t data_len);
+
+/** @brief Reads delta chain depth of object.
+ *
+ *  @param hash : hash of object.
+ *  @param raw_size : address for size of contents to be set.
+ *  @return number of deltas to a full object, -1 if object cannot be read.
+ */
+static int object_depth(Hash hash, uint64_t *raw_size);
+
+/** @brief Decodes compressed frames held in memory.
+ *
+ *  @param codec : address of codec.
+ *  @param data : frames.
+ *  @param data_len : length of frames.
+ *  @param dst : address for contents.
+ *  @param dst_len : exact length of contents.
+ *  @return 0 if successful, -1 if frames are corrupt.
+ */
+static int decode_frames(const ObjectCodec *codec, const char *data,
+                         size_t data_len, char *dst, size_t dst_len);
+
+/** @brief Leaves batch, indexing its entries if it is the outer batch.
+ *
+ *  Store lock must be held.
+ *
+ *  @return 0 if successful, -1 otherwise.
+ */
+static int finish_batch(void);
+
+/** @brief Maps index file, replacing any current mapping.
+ *
+ *  @return 0 if successful or the index does not exist, -1 otherwise.
+ */
+static int map_index(void);
+
+/** @brief Compares pack entries by hash.
+ *
+ *  @param a : address of pack entry.
+ *  @param b : address of pack entry.
+ *  @return -1, 0 or 1.
+ */
+static int compare_pack_entry(const void *a, const void *b);
+
+/** @brief Encodes object header.
+ *
+ *  @param header : address of header.
+ *  @param buf : address for OBJECT_HEADER_SIZE bytes to be written.
+ */
+static void encode_header(ObjectHeader *header, unsigned char *buf);
+
+/** @brief Reads and decodes object header.
+ *
+ *  @param fd : descriptor of pack.
+ *  @param offset : offset of object in pack.
+ *  @param header : address of header to be set.
+ *  @return 0 if successful, -1 if header cannot be read or is invalid.
+ */
+static int read_header(int fd, off_t offset, ObjectHeader *header);
+
+/** @brief Compresses contents into frames.
+ *
+ *  @param contents : contents of object.
+ *  @param len : length of contents.
+ *  @param codec : address of codec.
+ *  @param frames_len : address for length of frames to be set.
+ *  @return address of frames, MUST be released.
+ */
+static char *compress_frames(const char *contents, size_t len,
+                             const ObjectCodec *codec, size_t *frames_len);
+
+const ObjectCodec *get_codec(enum Codec codec) {
+    if ((unsigned) codec >= N_CODECS) {
+        return NULL;
+    }
+    return &codecs[codec];
+}
+
+int open_object_store(void) {
+    if (store.pack_fd != -1) {
+        return 0;
+    }
+
+    int fd = open(SVC_PACK_PATH, O_RDWR | O_CREAT, 0666);
+    struct stat sb;
+    if (fd == -1 || fstat(fd, &sb) == -1) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    // new pack, write header
+    unsigned char header[PACK_HEADER_SIZE] = {0};
+    if (sb.st_size == 0) {
+        memcpy(header, PACK_MAGIC, 4);
+        if (write_all(fd, header, PACK_HEADER_SIZE, 0) == -1) {
+            close(fd);
+            return -1;
+        }
+        sb.st_size = PACK_HEADER_SIZE;
+    } else if (read_all(fd, header, PACK_HEADER_SIZE, 0) == -1 ||
+               memcmp(header, PACK_MAGIC, 4) != 0) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    store.pack_fd = fd;
+    store.pack_end = (uint64_t) sb.st_size;
+    store.len_pending = INIT_PENDING_OBJECTS;
+    store.pending = safe_calloc(store.len_pending, sizeof(PackEntry));
+    store.n_pending = 0;
+    store.batch_depth = 0;
+    if (map_index() == -1) {
+        close_object_store();
+        return -1;
+    }
+
+    return 0;
+}
+
+void close_object_store(void) {
+    if (store.pack_fd == -1) {
+        return;
+    }
+
+    // index unfinished batch
+    pthread_mutex_lock(&store_lock);
+    if (store.batch_depth) {
+        store.batch_depth = 1;
+        finish_batch();
+    }
+    pthread_mutex_unlock(&store_lock);
+
+    if (store.index) {
+        munmap(store.index, store.index_size);
+    }
+    close(store.pack_fd);
+    free(store.pending);
+    clear_object_cache();
+    store.pack_fd = -1;
+    store.index = NULL;
+    store.index_size = 0;
+    store.n_indexed = 0;
+    store.pending = NULL;
+    store.n_pending = 0;
+    store.len_pending = 0;
+    return;
+}
+
+void begin_object_batch(void) {
+    pthread_mutex_lock(&store_lock);
+    store.batch_depth++;
+    pthread_mutex_unlock(&store_lock);
+    return;
+}
+
+int end_object_batch(void) {
+    pthread_mutex_lock(&store_lock);
+    int status = finish_batch();
+    pthread_mutex_unlock(&store_lock);
+    return status;
+}
+
+int has_object(Hash hash) {
+    pthread_mutex_lock(&store_lock);
+    int found = find_object(hash, NULL);
+    pthread_mutex_unlock(&store_lock);
+    return found;
+}
+
+int write_object(Hash hash, const char *contents, size_t len, enum Codec codec,
+                 const Hash *base) {
+    if (!contents && len) {
+        return -1;
+    }
+
+    if (store.pack_fd == -1 || has_object(hash)) {
+        return store.pack_fd == -1 ? -1 : 0;
+    }
+
+    // delta against base first, it is usually far smaller than compression
+    char *delta = NULL;
+    size_t delta_len = 0;
+    uint64_t base_size = 0;
+    int depth = base && *base != hash && len >= DELTA_MIN_SIZE ?
+                object_depth(*base, &base_size) : -1;
+    if (depth != -1 && depth < DELTA_MAX_CHAIN && base_size < STREAM_MIN_SIZE) {
+        size_t base_len = 0;
+        char *base_contents = read_object(*base, &base_len);
+        if (base_contents) {
+            delta_len = delta_encode(base_contents, base_len, contents, len,
+                                     len / 100 * OBJECT_COMPRESS_PCT, &delta);
+            free(base_contents);
+        }
+    }
+
+    // compress, keep only if it saves enough, small deltas skip compression
+    const ObjectCodec *c = get_codec(codec);
+    char *frames = NULL;
+    size_t frames_len = 0;
+    if (c && c->compress && len &&
+        (!delta || delta_len * 100 > (uint64_t) len * DELTA_ACCEPT_PCT)) {
+        frames = compress_frames(contents, len, c, &frames_len);
+        if (frames_len * 100 > (uint64_t) len * OBJECT_COMPRESS_PCT) {
+            free(frames);
+            frames = NULL;
+        }
+    }
+
+    ObjectHeader header = {
+            .codec = frames ? codec : CodecStore,
+            .data_offset = OBJECT_HEADER_SIZE,
+            .raw_size = len,
+    };
+    const char *data = frames ? frames : contents;
+    size_t data_len = frames ? frames_len : len;
+
+    // keep delta only if smaller than the full object
+    if (delta && DELTA_HEADER_SIZE + delta_len < data_len) {
+        char *delta_data = safe_malloc(DELTA_HEADER_SIZE + delta_len);
+        put_le64((unsigned char *) delta_data, *base);
+        put_le32((unsigned char *) delta_data + 8, (uint32_t) depth + 1);
+        put_le32((unsigned char *) delta_data + 12, 0);
+        memcpy(delta_data + DELTA_HEADER_SIZE, delta, delta_len);
+        free(frames);
+        frames = delta_data;
+        data = delta_data;
+        data_len = DELTA_HEADER_SIZE + delta_len;
+        header.codec = CodecDelta;
+    }
+    free(delta);
+    // new version is the likely base of the next one
+    if (header.codec == CodecDelta) {
+        cache_put(hash, contents, len);
+    }
+    append_object(hash, &header, data, data_len);
+    free(frames);
+    return 0;
+}
+
+int write_chunk_list(Hash hash, const ChunkRef *chunks, size_t n_chunks) {
+    if (!chunks && n_chunks) {
+        return -1;
+    }
+
+    if (store.pack_fd == -1 || has_object(hash)) {
+        return store.pack_fd == -1 ? -1 : 0;
+    }
+
+    ObjectHeader header = {
+            .codec = CodecChunked,
+            .data_offset = OBJECT_HEADER_SIZE,
+            .raw_size = 0,
+    };
+    size_t data_len = n_chunks * CHUNK_REF_SIZE;
+    unsigned char *data = safe_malloc(data_len + 1);
+    for (size_t i = 0; i < n_chunks; ++i) {
+        put_le64(data + i * CHUNK_REF_SIZE, chunks[i].hash);
+        put_le64(data + i * CHUNK_REF_SIZE + 8, chunks[i].len);
+        header.raw_size += chunks[i].len;
+    }
+
+    append_object(hash, &header, (char *) data, data_len);
+    free(data);
+    return 0;
+}
+
+int open_object_writer(ObjectWriter *ow, enum Codec codec) {
+    if (!ow || store.pack_fd == -1) {
+        return -1;
+    }
+
+    strcpy(ow->tmp_path, SVC_TMP_PATH_FMT);
+    ow->fd = mkstemp(ow->tmp_path);
+    if (ow->fd == -1 || lseek(ow->fd, OBJECT_HEADER_SIZE, SEEK_SET) == -1) {
+        if (ow->fd != -1) {
+            close(ow->fd);
+            unlink(ow->tmp_path);
+        }
+        return -1;
+    }
+
+    // without a frame codec, raw contents follow the header
+    const ObjectCodec *c = get_codec(codec);
+    ow->codec = c && c->compress ? codec : CodecStore;
+    ow->raw = ow->codec != CodecStore ? safe_malloc(OBJECT_FRAME_SIZE) : NULL;
+    ow->frame = ow->codec != CodecStore ? safe_malloc(OBJECT_FRAME_HEADER_SIZE +
+                                          c->bound(OBJECT_FRAME_SIZE)) : NULL;
+    ow->raw_len = 0;
+    ow->raw_size = 0;
+    ow->data_len = 0;
+    return 0;
+}
+
+int write_object_stream(ObjectWriter *ow, const char *data, size_t len) {
+    if (!ow || (!data && len)) {
+        return -1;
+    }
+
+    ow->raw_size += len;
+    if (ow->codec == CodecStore) {
+        ow->data_len += len;
+        return write_all(ow->fd, data, len, -1);
+    }
+
+    // fill and flush whole frames
+    while (len) {
+        size_t n = OBJECT_FRAME_SIZE - ow->raw_len < len ?
+                   OBJECT_FRAME_SIZE - ow->raw_len : len;
+        memcpy(ow->raw + ow->raw_len, data, n);
+        ow->raw_len += n;
+        data += n;
+        len -= n;
+        if (ow->raw_len == OBJECT_FRAME_SIZE && flush_frame(ow) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int close_object_writer(ObjectWriter *ow, Hash hash) {
+    if (!ow) {
+        return -1;
+    }
+
+    ObjectHeader header = {
+            .codec = ow->codec,
+            .data_offset = OBJECT_HEADER_SIZE,
+            .raw_size = ow->raw_size,
+    };
+    unsigned char header_buf[OBJECT_HEADER_SIZE];
+    encode_header(&header, header_buf);
+    if ((ow->codec != CodecStore && flush_frame(ow) == -1) ||
+        write_all(ow->fd, header_buf, OBJECT_HEADER_SIZE, 0) == -1) {
+        perror("unable to store file during commit");
+        exit(2);
+    }
+
+    // move temporary object into the pack, unless already stored
+    PackEntry entry;
+    uint64_t disk_len = 0;
+    if (!reserve_object(hash, &header, ow->data_len, &entry, &disk_len)) {
+        if (copy_into_pack(ow->fd, OBJECT_HEADER_SIZE + ow->data_len,
+                           entry.offset) == -1) {
+            perror("unable to store file during commit");
+            exit(2);
+        }
+        finish_object(&header, disk_len);
+    }
+
+    abort_object_writer(ow);
+    return 0;
+}
+
+void abort_object_writer(ObjectWriter *ow) {
+    if (!ow || ow->fd == -1) {
+        return;
+    }
+
+    close(ow->fd);
+    unlink(ow->tmp_path);
+    free(ow->raw);
+    free(ow->frame);
+    ow->fd = -1;
+    ow->raw = NULL;
+    ow->frame = NULL;
+    return;
+}
+
+void restore_object(Hash hash, char *file_path) {
+    if (!file_path) {
+        return;
+    }
+
+    pthread_mutex_lock(&store_lock);
+    PackEntry entry;
+    int found = find_object(hash, &entry);
+    pthread_mutex_unlock(&store_lock);
+
+    int src = store.pack_fd;
+    ObjectHeader header;
+    if (!found) {
+        fprintf(stderr, "missing object %016" PRIx64 "\n", hash);
+        exit(2);
+    }
+    if (read_header(src, (off_t) entry.offset, &header) == -1 ||
+        header.data_offset > entry.length ||
+        (header.codec == CodecStore &&
+         header.raw_size != entry.length - header.data_offset)) {
+        fprintf(stderr, "corrupt object %016" PRIx64 "\n", hash);
+        exit(2);
+    }
+
+    // read what can be read up front, so a bad object leaves the file intact
+    size_t len = 0;
+    char *contents = NULL;
+    if (header.codec == CodecDelta) {
+        contents = read_object(hash, &len);
+    } else if (header.codec == CodecChunked) {
+        contents = read_data(hash, &header, &len);
+    }
+    if (!contents && (header.codec == CodecDelta ||
+                      header.codec == CodecChunked)) {
+        fprintf(stderr, "corrupt object %016" PRIx64 "\n", hash);
+        exit(2);
+    }
+
+    int dst = open(file_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (dst == -1) {
+        perror("unable to open files in object restore");
+        exit(2);
+    }
+
+    pthread_mutex_lock(&object_stats_lock);
+    object_stats.n_restored[header.codec]++;
+    pthread_mutex_unlock(&object_stats_lock);
+
+    off_t offset = (off_t) (entry.offset + header.data_offset);
+    if (header.codec == CodecDelta) {
+        // reconstructed from delta chain above
+        if (write_all(dst, contents, len, -1) == -1) {
+            perror("unable to write file in object restore");
+            exit(2);
+        }
+        free(contents);
+        close(dst);
+        return;
+    } else if (header.codec == CodecChunked) {
+        // stream a chunk at a time, chunk list read above
+        for (size_t i = 0; i + CHUNK_REF_SIZE <= len; i += CHUNK_REF_SIZE) {
+            size_t chunk_len = 0;
+            char *chunk = read_object(get_le64((unsigned char *) contents + i),
+                                      &chunk_len);
+            if (!chunk ||
+                chunk_len != get_le64((unsigned char *) contents + i + 8)) {
+                fprintf(stderr, "corrupt object %016" PRIx64 "\n", hash);
+                exit(2);
+            }
+            if (write_all(dst, chunk, chunk_len, -1) == -1) {
+                perror("unable to write file in object restore");
+                exit(2);
+            }
+            free(chunk);
+        }
+        free(contents);
+        close(dst);
+        return;
+    } else if (header.codec == CodecStore) {
+        // raw contents, copied without leaving the kernel where possible
+        if (copy_file_contents(src, offset, header.raw_size, dst) == -1) {
+            perror("unable to copy object in object restore");
+            exit(2);
+        }
+        close(dst);
+        return;
+    }
+
+    // decompress a frame at a time
+    const ObjectCodec *c = get_codec(header.codec);
+    char *frame = safe_malloc(c->bound(OBJECT_FRAME_SIZE));
+    char *raw = safe_malloc(OBJECT_FRAME_SIZE);
+    uint64_t restored = 0;
+    while (restored < header.raw_size) {
+        unsigned char frame_header[OBJECT_FRAME_HEADER_SIZE];
+        if (read_all(src, frame_header, OBJECT_FRAME_HEADER_SIZE,
+                     offset) == -1) {
+            perror("unable to read object in object restore");
+            exit(2);
+        }
+        uint32_t frame_len = get_le32(frame_header) & ~OBJECT_FRAME_RAW;
+        int is_raw = (get_le32(frame_header) & OBJECT_FRAME_RAW) != 0;
+        uint32_t raw_len = get_le32(frame_header + 4);
+        if (raw_len > OBJECT_FRAME_SIZE || raw_len > header.raw_size - restored ||
+            frame_len > c->bound(OBJECT_FRAME_SIZE) ||
+            read_all(src, frame, frame_len,
+                     offset + OBJECT_FRAME_HEADER_SIZE) == -1) {
+            fprintf(stderr, "corrupt object %016" PRIx64 "\n", hash);
+            exit(2);
+        }
+        offset += OBJECT_FRAME_HEADER_SIZE + frame_len;
+
+        if (is_raw) {
+            if (frame_len != raw_len) {
+                fprintf(stderr, "corrupt object %016" PRIx64 "\n", hash);
+                exit(2);
+            }
+            memcpy(raw, frame, raw_len);
+        } else if (c->decompress(frame, frame_len, raw, raw_len) == -1) {
+            fprintf(stderr, "corrupt object %016" PRIx64 "\n", hash);
+            exit(2);
+        }
+
+        if (write_all(dst, raw, raw_len, -1) == -1) {
+            perror("unable to write file in object restore");
+            exit(2);
+        }
+        restored += raw_len;
+    }
+
+    free(frame);
+    free(raw);
+    close(dst);
+    return;
+}
+
+char *read_object(Hash hash, size_t *len) {
+    if (!len) {
+        return NULL;
+    }
+
+    // walk delta chain down to a full or cached object
+    char *chain[DELTA_MAX_CHAIN + 1];
+    size_t chain_len[DELTA_MAX_CHAIN + 1];
+    uint64_t chain_raw[DELTA_MAX_CHAIN + 1];
+    size_t n_chain = 0;
+    char *contents = NULL;
+    size_t contents_len = 0;
+    Hash h = hash;
+    while (!(contents = cache_get(h, &contents_len))) {
+        ObjectHeader header;
+        size_t data_len = 0;
+        char *data = read_data(h, &header, &data_len);
+        if (!data) {
+            break;
+        }
+
+        if (header.codec != CodecDelta) {
+            contents = decode_data(&header, data, data_len);
+            contents_len = header.raw_size;
+            break;
+        }
+        if (n_chain == DELTA_MAX_CHAIN + 1 || data_len < DELTA_HEADER_SIZE) {
+            free(data);
+            break;
+        }
+        chain[n_chain] = data;
+        chain_len[n_chain] = data_len;
+        chain_raw[n_chain] = header.raw_size;
+        n_chain++;
+        h = get_le64((unsigned char *) data);
+    }
+
+    // apply deltas from the bottom up, alternating between two buffers
+    char *spare = NULL;
+    size_t spare_cap = 0;
+    for (size_t i = n_chain; i-- > 0 && contents; ) {
+        if (i == 0) {
+            // base of the object read, likely a base of other objects too
+            cache_put(get_le64((unsigned char *) chain[0]), contents,
+                      contents_len);
+        }
+        if (spare_cap < chain_raw[i] + 1) {
+            spare = safe_realloc(spare, chain_raw[i] + 1);
+            spare_cap = chain_raw[i] + 1;
+        }
+        if (delta_apply(contents, contents_len, chain[i] + DELTA_HEADER_SIZE,
+                        chain_len[i] - DELTA_HEADER_SIZE, spare,
+                        chain_raw[i]) == -1) {
+            free(contents);
+            contents = NULL;
+            break;
+        }
+        char *tmp = contents;
+        size_t tmp_cap = contents_len + 1;
+        contents = spare;
+        contents_len = chain_raw[i];
+        spare = tmp;
+        spare_cap = tmp_cap;
+    }
+    free(spare);
+    for (size_t i = 0; i < n_chain; ++i) {
+        free(chain[i]);
+    }
+
+    *len = contents_len;
+    return contents;
+}
+
+void clear_object_cache(void) {
+    pthread_mutex_lock(&cache_lock);
+    for (size_t i = 0; i < DELTA_CACHE_ENTRIES; ++i) {
+        free(cache[i].contents);
+        cache[i].contents = NULL;
+    }
+    cache_bytes = 0;
+    pthread_mutex_unlock(&cache_lock);
+    return;
+}
+
+int map_object(Hash hash, Blob *b) {
+    if (!b) {
+        return -1;
+    }
+    *b = (Blob) {"", 0, NULL, 0, NULL};
+
+    pthread_mutex_lock(&store_lock);
+    PackEntry entry;
+    int found = find_object(hash, &entry);
+    pthread_mutex_unlock(&store_lock);
+
+    // large raw contents are mapped from the pack where they lie
+    ObjectHeader header;
+    if (found && read_header(store.pack_fd, (off_t) entry.offset,
+                             &header) == 0 &&
+        header.codec == CodecStore && header.raw_size >= BLOB_MAP_MIN_SIZE &&
+        header.data_offset <= entry.length &&
+        entry.length - header.data_offset == header.raw_size) {
+        uint64_t start = entry.offset + header.data_offset;
+        uint64_t page_offset = start % (uint64_t) sysconf(_SC_PAGESIZE);
+        size_t map_len = (size_t) (header.raw_size + page_offset);
+        void *map = mmap(NULL, map_len, PROT_READ, MAP_SHARED, store.pack_fd,
+                         (off_t) (start - page_offset));
+        if (map != MAP_FAILED) {
+            *b = (Blob) {(char *) map + page_offset, header.raw_size, map,
+                         map_len, NULL};
+            return 0;
+        }
+    }
+
+    // compressed, delta and chunked objects are decoded
+    size_t len = 0;
+    char *buf = read_object(hash, &len);
+    if (!buf) {
+        return -1;
+    }
+    *b = (Blob) {buf, len, NULL, 0, buf};
+    return 0;
+}
+
+int map_file(char *file_path, Blob *b) {
+    if (!file_path || !b) {
+        return -1;
+    }
+    *b = (Blob) {"", 0, NULL, 0, NULL};
+
+    int fd = open(file_path, O_RDONLY);
+    struct stat sb;
+    if (fd == -1 || fstat(fd, &sb) == -1) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    size_t len = (size_t) sb.st_size;
+    if (len >= BLOB_MAP_MIN_SIZE) {
+        void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            close(fd);
+            *b = (Blob) {map, len, map, len, NULL};
+            return 0;
+        }
+    }
+
+    // small files cost less to read than to map
+    char *buf = safe_malloc(len + 1);
+    if (read_all(fd, buf, len, 0) == -1) {
+        free(buf);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    *b = (Blob) {buf, len, NULL, 0, buf};
+    return 0;
+}
+
+void unmap_blob(Blob *b) {
+    if (!b) {
+        return;
+    }
+
+    if (b->map) {
+        munmap(b->map, b->map_len);
+    }
+    free(b->buf);
+    *b = (Blob) {"", 0, NULL, 0, NULL};
+    return;
+}
+
+void get_object_stats(ObjectStats *stats) {
+    if (!stats) {
+        return;
+    }
+
+    pthread_mutex_lock(&object_stats_lock);
+    *stats = object_stats;
+    pthread_mutex_unlock(&object_stats_lock);
+    return;
+}
+
+static void encode_header(ObjectHeader *header, unsigned char *buf) {
+    memset(buf, 0, OBJECT_HEADER_SIZE);
+    memcpy(buf, OBJECT_MAGIC, 4);
+    buf[4] = (unsigned char) header->codec;
+    put_le32(buf + 8, header->data_offset);
+    put_le64(buf + 16, header->raw_size);
+    return;
+}
+
+static int finish_batch(void) {
+    if (!store.batch_depth || --store.batch_depth || !store.n_pending) {
+        return 0;
+    }
+
+    // sort batch entries
+    PackEntry *batch = safe_malloc(store.n_pending * sizeof(PackEntry));
+    size_t n_batch = 0;
+    for (size_t i = 0; i < store.len_pending; ++i) {
+        if (store.pending[i].offset) {
+            batch[n_batch++] = store.pending[i];
+        }
+    }
+    qsort(batch, n_batch, sizeof(PackEntry), compare_pack_entry);
+
+    // merge with mapped entries, both are sorted and disjoint
+    uint64_t n_entries = store.n_indexed + n_batch;
+    size_t size = INDEX_HEADER_SIZE + INDEX_FANOUT * 4 +
+                  n_entries * INDEX_ENTRY_SIZE;
+    unsigned char *buf = safe_calloc(size, 1);
+    memcpy(buf, INDEX_MAGIC, 4);
+    put_le32(buf + 4, INDEX_VERSION);
+    put_le64(buf + 8, n_entries);
+
+    unsigned char *fanout = buf + INDEX_HEADER_SIZE;
+    unsigned char *out = fanout + INDEX_FANOUT * 4;
+    const unsigned char *old = store.index ?
+            store.index + INDEX_HEADER_SIZE + INDEX_FANOUT * 4 : NULL;
+    uint32_t counts[INDEX_FANOUT] = {0};
+    for (uint64_t i = 0, j = 0; i < store.n_indexed || j < n_batch; ) {
+        if (j == n_batch ||
+            (i < store.n_indexed && get_le64(old) < batch[j].hash)) {
+            memcpy(out, old, INDEX_ENTRY_SIZE);
+            old += INDEX_ENTRY_SIZE;
+            ++i;
+        } else {
+            put_le64(out, batch[j].hash);
+            put_le64(out + 8, batch[j].offset);
+            put_le64(out + 16, batch[j].length);
+            ++j;
+        }
+        counts[(get_le64(out) >> 55) & 0xff]++;
+        out += INDEX_ENTRY_SIZE;
+    }
+    uint32_t total = 0;
+    for (size_t b = 0; b < INDEX_FANOUT; ++b) {
+        total += counts[b];
+        put_le32(fanout + 4 * b, total);
+    }
+    free(batch);
+
+    // replace index, readers only ever see a complete file
+    char tmp_name[] = SVC_TMP_PATH_FMT;
+    int fd = mkstemp(tmp_name);
+    if (fd == -1 || write_all(fd, buf, size, 0) == -1 || close(fd) == -1 ||
+        rename(tmp_name, SVC_INDEX_PATH) == -1) {
+        free(buf);
+        return -1;
+    }
+    free(buf);
+
+    memset(store.pending, 0, store.len_pending * sizeof(PackEntry));
+    store.n_pending = 0;
+    return map_index();
+}
+
+static char *cache_get(Hash hash, size_t *len) {
+    char *contents = NULL;
+    pthread_mutex_lock(&cache_lock);
+    for (size_t i = 0; i < DELTA_CACHE_ENTRIES; ++i) {
+        if (cache[i].contents && cache[i].hash == hash) {
+            cache[i].last_used = ++cache_clock;
+            contents = safe_malloc(cache[i].len + 1);
+            memcpy(contents, cache[i].contents, cache[i].len);
+            *len = cache[i].len;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return contents;
+}
+
+static void cache_put(Hash hash, const char *contents, size_t len) {
+    if (len > DELTA_CACHE_SIZE) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    for (size_t i = 0; i < DELTA_CACHE_ENTRIES; ++i) {
+        if (cache[i].contents && cache[i].hash == hash) {
+            cache[i].last_used = ++cache_clock;
+            pthread_mutex_unlock(&cache_lock);
+            return;
+        }
+    }
+
+    // evict until there is a free slot and room for contents
+    size_t slot = DELTA_CACHE_ENTRIES;
+    while (slot == DELTA_CACHE_ENTRIES || cache_bytes + len > DELTA_CACHE_SIZE) {
+        size_t lru = DELTA_CACHE_ENTRIES;
+        slot = DELTA_CACHE_ENTRIES;
+        for (size_t i = 0; i < DELTA_CACHE_ENTRIES; ++i) {
+            if (!cache[i].contents) {
+                slot = i;
+            } else if (lru == DELTA_CACHE_ENTRIES ||
+                       cache[i].last_used < cache[lru].last_used) {
+                lru = i;
+            }
+        }
+        if (slot != DELTA_CACHE_ENTRIES && cache_bytes + len <= DELTA_CACHE_SIZE) {
+            break;
+        }
+        cache_bytes -= cache[lru].len;
+        free(cache[lru].contents);
+        cache[lru].contents = NULL;
+    }
+
+    cache[slot].hash = hash;
+    cache[slot].contents = safe_malloc(len + 1);
+    memcpy(cache[slot].contents, contents, len);
+    cache[slot].len = len;
+    cache[slot].last_used = ++cache_clock;
+    cache_bytes += len;
+    pthread_mutex_unlock(&cache_lock);
+    return;
+}
+
+static char *read_data(Hash hash, ObjectHeader *header, size_t *data_len) {
+    pthread_mutex_lock(&store_lock);
+    PackEntry entry;
+    int found = find_object(hash, &entry);
+    pthread_mutex_unlock(&store_lock);
+
+    if (!found || read_header(store.pack_fd, (off_t) entry.offset,
+                              header) == -1 ||
+        header->data_offset > entry.length || header->raw_size >= SIZE_MAX) {
+        return NULL;
+    }
+
+    *data_len = entry.length - header->data_offset;
+    char *data = safe_malloc(*data_len + 1);
+    if (read_all(store.pack_fd, data, *data_len,
+                 (off_t) (entry.offset + header->data_offset)) == -1) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+static char *decode_data(ObjectHeader *header, char *data, size_t data_len) {
+    if (header->codec == CodecStore) {
+        if (data_len != header->raw_size) {
+            free(data);
+            return NULL;
+        }
+        return data;
+    }
+
+    char *contents = safe_malloc(header->raw_size + 1);
+    int status = 0;
+    if (header->codec == CodecChunked) {
+        // concatenate chunks
+        uint64_t out = 0;
+        for (size_t i = 0; !status && i + CHUNK_REF_SIZE <= data_len;
+             i += CHUNK_REF_SIZE) {
+            size_t len = 0;
+            char *chunk = read_object(get_le64((unsigned char *) data + i),
+                                      &len);
+            if (!chunk || len != get_le64((unsigned char *) data + i + 8) ||
+                len > header->raw_size - out) {
+                status = -1;
+            } else {
+                memcpy(contents + out, chunk, len);
+                out += len;
+            }
+            free(chunk);
+        }
+        status = status || out != header->raw_size ? -1 : 0;
+    } else {
+        status = decode_frames(get_codec(header->codec), data, data_len,
+                               contents, header->raw_size);
+    }
+    if (status == -1) {
+        free(contents);
+        contents = NULL;
+    }
+    free(data);
+    return contents;
+}
+
+static int object_depth(Hash hash, uint64_t *raw_size) {
+    pthread_mutex_lock(&store_lock);
+    PackEntry entry;
+    int found = find_object(hash, &entry);
+    pthread_mutex_unlock(&store_lock);
+
+    ObjectHeader header;
+    if (!found || read_header(store.pack_fd, (off_t) entry.offset,
+                              &header) == -1) {
+        return -1;
+    }
+    *raw_size = header.raw_size;
+    if (header.codec != CodecDelta) {
+        return 0;
+    }
+
+    unsigned char buf[DELTA_HEADER_SIZE];
+    if (read_all(store.pack_fd, buf, DELTA_HEADER_SIZE,
+                 (off_t) (entry.offset + header.data_offset)) == -1) {
+        return -1;
+    }
+    return (int) get_le32(buf + 8);
+}
+
+static int decode_frames(const ObjectCodec *codec, const char *data,
+                         size_t data_len, char *dst, size_t dst_len) {
+    size_t in = 0;
+    size_t out = 0;
+    while (out < dst_len) {
+        if (data_len - in < OBJECT_FRAME_HEADER_SIZE) {
+            return -1;
+        }
+        const unsigned char *frame_header = (const unsigned char *) data + in;
+        uint32_t frame_len = get_le32(frame_header) & ~OBJECT_FRAME_RAW;
+        int is_raw = (get_le32(frame_header) & OBJECT_FRAME_RAW) != 0;
+        uint32_t raw_len = get_le32(frame_header + 4);
+        in += OBJECT_FRAME_HEADER_SIZE;
+        if (raw_len > OBJECT_FRAME_SIZE || raw_len > dst_len - out ||
+            frame_len > data_len - in) {
+            return -1;
+        }
+
+        if (is_raw) {
+            if (frame_len != raw_len) {
+                return -1;
+            }
+            memcpy(dst + out, data + in, raw_len);
+        } else if (codec->decompress(data + in, frame_len, dst + out,
+                                     raw_len) == -1) {
+            return -1;
+        }
+        in += frame_len;
+        out += raw_len;
+    }
+    return 0;
+}
+
+static void append_object(Hash hash, ObjectHeader *header, const char *data,
+                          size_t data_len) {
+    PackEntry entry;
+    uint64_t disk_len = 0;
+    if (reserve_object(hash, header, data_len, &entry, &disk_len)) {
+        return;
+    }
+
+    unsigned char header_buf[OBJECT_HEADER_SIZE];
+    encode_header(header, header_buf);
+    if (write_all(store.pack_fd, header_buf, OBJECT_HEADER_SIZE,
+                  (off_t) entry.offset) == -1 ||
+        write_all(store.pack_fd, data, data_len,
+                  (off_t) (entry.offset + OBJECT_HEADER_SIZE)) == -1) {
+        perror("unable to store file during commit");
+        exit(2);
+    }
+
+    finish_object(header, disk_len);
+    return;
+}
+
+static int reserve_object(Hash hash, ObjectHeader *header, uint64_t data_len,
+                          PackEntry *entry, uint64_t *disk_len) {
+    // reserve pack space, unless another thread stored the same contents
+    pthread_mutex_lock(&store_lock);
+    if (find_object(hash, NULL)) {
+        pthread_mutex_unlock(&store_lock);
+        return 1;
+    }
+    entry->hash = hash;
+    entry->offset = store.pack_end;
+    entry->length = OBJECT_HEADER_SIZE + data_len;
+    // large stored objects start on a block boundary, so they can be
+    // reflinked, the gap is left as a hole
+    if (header->codec == CodecStore && data_len >= OBJECT_ALIGN_MIN_SIZE) {
+        entry->offset = (entry->offset + OBJECT_HEADER_SIZE + OBJECT_ALIGN - 1) /
+                        OBJECT_ALIGN * OBJECT_ALIGN - OBJECT_HEADER_SIZE;
+    }
+    *disk_len = entry->offset + entry->length - store.pack_end;
+    store.pack_end = entry->offset + entry->length;
+    // hold a batch open while writing, a lone write indexes itself
+    store.batch_depth++;
+    add_pending(entry);
+    pthread_mutex_unlock(&store_lock);
+    return 0;
+}
+
+static void finish_object(ObjectHeader *header, uint64_t disk_len) {
+    if (end_object_batch() == -1) {
+        perror("unable to write object index");
+        exit(2);
+    }
+
+    pthread_mutex_lock(&object_stats_lock);
+    object_stats.n_objects[header->codec]++;
+    object_stats.raw_bytes[header->codec] += header->raw_size;
+    object_stats.disk_bytes[header->codec] += disk_len;
+    pthread_mutex_unlock(&object_stats_lock);
+    return;
+}
+
+static int copy_into_pack(int src, uint64_t len, uint64_t offset) {
+    // in kernel copy first, possibly sharing extents
+    loff_t src_off = 0;
+    loff_t dst_off = (loff_t) offset;
+    while (len) {
+        ssize_t n = copy_file_range(src, &src_off, store.pack_fd, &dst_off,
+                                    len < COPY_BLOCK_SIZE ? len : COPY_BLOCK_SIZE,
+                                    0);
+        if (n <= 0) {
+            break;
+        }
+        len -= (uint64_t) n;
+    }
+
+    // remainder through a buffer
+    char *buf = len ? safe_malloc(COPY_BLOCK_SIZE) : NULL;
+    while (len) {
+        size_t n = len < COPY_BLOCK_SIZE ? len : COPY_BLOCK_SIZE;
+        if (read_all(src, buf, n, src_off) == -1 ||
+            write_all(store.pack_fd, buf, n, dst_off) == -1) {
+            free(buf);
+            return -1;
+        }
+        src_off += (loff_t) n;
+        dst_off += (loff_t) n;
+        len -= n;
+    }
+    free(buf);
+    return 0;
+}
+
+static int flush_frame(ObjectWriter *ow) {
+    if (!ow->raw_len) {
+        return 0;
+    }
+
+    const ObjectCodec *c = get_codec(ow->codec);
+    unsigned char *frame_header = (unsigned char *) ow->frame;
+    char *frame = ow->frame + OBJECT_FRAME_HEADER_SIZE;
+    size_t frame_len = c->compress(ow->raw, ow->raw_len, frame,
+                                   c->bound(OBJECT_FRAME_SIZE));
+    uint32_t flags = 0;
+    if (!frame_len || frame_len >= ow->raw_len) {
+        // frame does not shrink, keep raw
+        memcpy(frame, ow->raw, ow->raw_len);
+        frame_len = ow->raw_len;
+        flags = OBJECT_FRAME_RAW;
+    }
+    put_le32(frame_header, (uint32_t) frame_len | flags);
+    put_le32(frame_header + 4, (uint32_t) ow->raw_len);
+
+    if (write_all(ow->fd, ow->frame, OBJECT_FRAME_HEADER_SIZE + frame_len,
+                  -1) == -1) {
+        return -1;
+    }
+    ow->data_len += OBJECT_FRAME_HEADER_SIZE + frame_len;
+    ow->raw_len = 0;
+    return 0;
+}
+
+static int find_object(Hash hash, PackEntry *entry) {
+    // current batch
+    size_t mask = store.len_pending - 1;
+    for (size_t i = hash & mask; store.len_pending && store.pending[i].offset;
+         i = (i + 1) & mask) {
+        if (store.pending[i].hash == hash) {
+            if (entry) {
+                *entry = store.pending[i];
+            }
+            return 1;
+        }
+    }
+
+    if (!store.index) {
+        return 0;
+    }
+
+    // binary search entries sharing the fanout byte
+    const unsigned char *fanout = store.index + INDEX_HEADER_SIZE;
+    const unsigned char *entries = fanout + INDEX_FANOUT * 4;
+    size_t b = (hash >> 55) & 0xff;
+    uint64_t lo = b ? get_le32(fanout + 4 * (b - 1)) : 0;
+    uint64_t hi = get_le32(fanout + 4 * b);
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        const unsigned char *e = entries + mid * INDEX_ENTRY_SIZE;
+        Hash h = get_le64(e);
+        if (h == hash) {
+            if (entry) {
+                entry->hash = h;
+                entry->offset = get_le64(e + 8);
+                entry->length = get_le64(e + 16);
+            }
+            return 1;
+        } else if (h < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return 0;
+}
+
+static void add_pending(PackEntry *entry) {
+    // keep load factor at most a half
+    if ((store.n_pending + 1) * 2 > store.len_pending) {
+        PackEntry *old = store.pending;
+        size_t old_len = store.len_pending;
+        store.len_pending *= ARRAY_GROWTH_RATE;
+        store.pending = safe_calloc(store.len_pending, sizeof(PackEntry));
+        store.n_pending = 0;
+        for (size_t i = 0; i < old_len; ++i) {
+            if (old[i].offset) {
+                add_pending(&old[i]);
+            }
+        }
+        free(old);
+    }
+
+    size_t mask = store.len_pending - 1;
+    size_t i = entry->hash & mask;
+    while (store.pending[i].offset) {
+        i = (i + 1) & mask;
+    }
+    store.pending[i] = *entry;
+    store.n_pending++;
+    return;
+}
+
+static int map_index(void) {
+    if (store.index) {
+        munmap(store.index, store.index_size);
+        store.index = NULL;
+        store.index_size = 0;
+        store.n_indexed = 0;
+    }
+
+    int fd = open(SVC_INDEX_PATH, O_RDONLY);
+    if (fd == -1) {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) == -1 ||
+        (size_t) sb.st_size < INDEX_HEADER_SIZE + INDEX_FANOUT * 4) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t) sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    // validate header and entry count against size
+    unsigned char *index = (unsigned char *) map;
+    uint64_t n_entries = get_le64(index + 8);
+    if (memcmp(index, INDEX_MAGIC, 4) != 0 ||
+        get_le32(index + 4) != INDEX_VERSION ||
+        n_entries != ((size_t) sb.st_size - INDEX_HEADER_SIZE -
+                      INDEX_FANOUT * 4) / INDEX_ENTRY_SIZE ||
+        get_le32(index + INDEX_HEADER_SIZE + 4 * (INDEX_FANOUT - 1)) !=
+        n_entries) {
+        munmap(map, (size_t) sb.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    store.index = index;
+    store.index_size = (size_t) sb.st_size;
+    store.n_indexed = n_entries;
+    return 0;
+}
+
+static int compare_pack_entry(const void *a, const void *b) {
+    Hash ha = ((const PackEntry *) a)->hash;
+    Hash hb = ((const PackEntry *) b)->hash;
+    return (ha > hb) - (ha < hb);
+}
+
+static int read_header(int fd, off_t offset, ObjectHeader *header) {
+    unsigned char buf[OBJECT_HEADER_SIZE];
+    if (read_all(fd, buf, OBJECT_HEADER_SIZE, offset) == -1 ||
+        memcmp(buf, OBJECT_MAGIC, 4) != 0 || !get_codec(buf[4])) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    header->codec = (enum Codec) buf[4];
+    header->data_offset = get_le32(buf + 8);
+    header->raw_size = get_le64(buf + 16);
+    if (header->data_offset < OBJECT_HEADER_SIZE ||
+        (header->codec != CodecStore && header->codec != CodecDelta &&
+         header->codec != CodecChunked &&
+         !get_codec(header->codec)->decompress)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+static char *compress_frames(const char *contents, size_t len,
+                             const ObjectCodec *codec, size_t *frames_len) {
+    size_t n_frames = (len + OBJECT_FRAME_SIZE - 1) / OBJECT_FRAME_SIZE;
+    char *frames = safe_malloc(n_frames * (OBJECT_FRAME_HEADER_SIZE +
+                                           codec->bound(OBJECT_FRAME_SIZE)));
+
+    size_t out = 0;
+    for (size_t offset = 0; offset < len; offset += OBJECT_FRAME_SIZE) {
+        size_t raw_len = len - offset < OBJECT_FRAME_SIZE ?
+                         len - offset : OBJECT_FRAME_SIZE;
+        unsigned char *frame_header = (unsigned char *) frames + out;
+        char *frame = frames + out + OBJECT_FRAME_HEADER_SIZE;
+
+        size_t frame_len = codec->compress(contents + offset, raw_len, frame,
+                                           codec->bound(raw_len));
+        uint32_t flags = 0;
+        if (!frame_len || frame_len >= raw_len) {
+            // frame does not shrink, keep raw
+            memcpy(frame, contents + offset, raw_len);
+            frame_len = raw_len;
+            flags = OBJECT_FRAME_RAW;
+        }
+
+        put_le32(frame_header, (uint32_t) frame_len | flags);
+        put_le32(frame_header + 4, (uint32_t) raw_len);
+        out += OBJECT_FRAME_HEADER_SIZE + frame_len;
+    }
+
+    *frames_len = out;
+    return frames;
+}
+
+int write_all(int fd, const void *buf, size_t len, off_t offset) {
+    const char *p = (const char *) buf;
+    while (len) {
+        ssize_t n = offset == -1 ? write(fd, p, len) : pwrite(fd, p, len, offset);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t) n;
+        offset += offset == -1 ? 0 : n;
+    }
+    return 0;
+}
+
+int read_all(int fd, void *buf, size_t len, off_t offset) {
+    char *p = (char *) buf;
+    while (len) {
+        ssize_t n = pread(fd, p, len, offset);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t) n;
+        offset += n;
+    }
+    return 0;
+}
@@ -0,0 +1,443 @@
+#ifndef ASSIGNMENT_2_SVC_OBJECT_H
+#define ASSIGNMENT_2_SVC_OBJECT_H
+
+#include "../params.h"
+#include "../memory/memory.h"
+#include "../hash/hash.h"
+#include "../file_data/file_data.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define OBJECT_MAGIC "SVC1"
+#define OBJECT_HEADER_SIZE 24
+#define OBJECT_FRAME_HEADER_SIZE 8
+#define OBJECT_FRAME_RAW 0x80000000U
+#define DELTA_HEADER_SIZE 16
+#define CHUNK_REF_SIZE 16
+
+#define PACK_MAGIC "SVCP"
+#define PACK_HEADER_SIZE 8
+#define INDEX_MAGIC "SVCI"
+#define INDEX_VERSION 1
+#define INDEX_HEADER_SIZE 16
+#define INDEX_FANOUT 256
+#define INDEX_ENTRY_SIZE 24
+
+enum Codec {CodecStore = 0, CodecLz = 1, CodecDelta = 2, CodecChunked = 3};
+#define N_CODECS 4
+
+typedef struct ObjectCodec {
+    const char *name;             // codec name
+    size_t (*bound)(size_t len);  // worst case compressed size of len bytes
+    size_t (*compress)(const char *src, size_t src_len, char *dst,
+                       size_t dst_cap);  // compressed length, 0 if no room
+    int (*decompress)(const char *src, size_t src_len, char *dst,
+                      size_t dst_len);   // 0 if successful, -1 if corrupt
+} ObjectCodec;
+
+typedef struct ObjectHeader {
+    enum Codec codec;      // codec of compressed frames, Store if none
+    uint32_t data_offset;  // offset of stored contents or first frame
+    uint64_t raw_size;     // size of uncompressed contents
+} ObjectHeader;
+
+typedef struct PackEntry {
+    Hash hash;        // hash of object contents
+    uint64_t offset;  // offset of object header in pack, 0 if slot is empty
+    uint64_t length;  // length of object, including header
+} PackEntry;
+
+typedef struct ChunkRef {
+    Hash hash;     // hash of chunk contents, stored as its own object
+    uint64_t len;  // length of chunk
+} ChunkRef;
+
+typedef struct ObjectWriter {
+    int fd;                                   // temporary object, -1 if closed
+    char tmp_path[sizeof(SVC_TMP_PATH_FMT)];  // path of temporary object
+    enum Codec codec;                         // codec of frames, Store if none
+    char *raw;                                // frame being filled
+    size_t raw_len;                           // number of bytes in raw
+    char *frame;                              // compressed frame and header
+    uint64_t raw_size;                        // bytes written to the stream
+    uint64_t data_len;                        // bytes after the header
+} ObjectWriter;
+
+typedef struct ObjectStats {
+    size_t n_objects[N_CODECS];     // objects written, indexed by codec
+    uint64_t raw_bytes[N_CODECS];   // uncompressed bytes of objects written
+    uint64_t disk_bytes[N_CODECS];  // bytes written, including headers
+    size_t n_restored[N_CODECS];    // objects restored to the working tree
+} ObjectStats;
+
+typedef struct Blob {
+    const char *data;  // contents, not null terminated
+    size_t len;        // length of contents
+    void *map;         // mapped pages holding contents, NULL if read
+    size_t map_len;    // length of mapping
+    char *buf;         // contents read into memory, NULL if mapped
+} Blob;
+
+/** @brief Encodes little endian integers, as stored in svc files.
+ *
+ *  @param p : address of 4 or 8 bytes.
+ *  @param v : integer.
+ */
+static inline void put_le32(unsigned char *p, uint32_t v) {
+    for (size_t i = 0; i < 4; ++i) {
+        p[i] = (unsigned char) (v >> (8 * i));
+    }
+}
+
+static inline void put_le64(unsigned char *p, uint64_t v) {
+    for (size_t i = 0; i < 8; ++i) {
+        p[i] = (unsigned char) (v >> (8 * i));
+    }
+}
+
+/** @brief Decodes little endian integers, as stored in svc files.
+ *
+ *  @param p : address of 4 or 8 bytes.
+ *  @return integer.
+ */
+static inline uint32_t get_le32(const unsigned char *p) {
+    uint32_t v = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        v |= (uint32_t) p[i] << (8 * i);
+    }
+    return v;
+}
+
+static inline uint64_t get_le64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        v |= (uint64_t) p[i] << (8 * i);
+    }
+    return v;
+}
+
+/** @brief Returns codec implementation.
+ *
+ *  Codecs are selected by the codec id recorded in each object header. New
+ *  codecs are added to the codec table in object.c. Store, delta and chunked
+ *  objects have no frame codec.
+ *
+ *  @param codec : codec id.
+ *  @return address of codec, NULL if codec is unknown.
+ */
+const ObjectCodec *get_codec(enum Codec codec);
+
+/** @brief Opens object store in the svc directory.
+ *
+ *  Objects are appended to the pack SVC_PACK_PATH (params.h), and located
+ *  through the index SVC_INDEX_PATH, which is mapped into memory and binary
+ *  searched. The pack is created if it does not exist.
+ *
+ *  Format of pack:
+ *
+ *  "SVCP" <0:u32> (<object>)*
+ *
+ *  Format of index, entries sorted by hash, fanout[b] is the number of entries
+ *  whose hash bits 55 to 62 are at most b:
+ *
+ *  "SVCI" <version:u32> <count:u64> <fanout:u32>[256]
+ *  (<hash:u64> <pack offset:u64> <object length:u64>)*
+ *
+ *  @return 0 if successful, -1 otherwise.
+ */
+int open_object_store(void);
+
+/** @brief Closes object store.
+ *
+ *  Objects written in an unfinished batch are indexed first. Files in the svc
+ *  directory are left in place.
+ */
+void close_object_store(void);
+
+/** @brief Starts batch of object writes.
+ *
+ *  Objects written in a batch are appended to the pack straight away, but only
+ *  indexed once, when the batch ends. Batches may be nested, only the outer
+ *  end_object_batch writes the index.
+ */
+void begin_object_batch(void);
+
+/** @brief Ends batch of object writes.
+ *
+ *  Entries of the batch are merged with the mapped index into a new index,
+ *  which is renamed into place and mapped. Must not be called while objects
+ *  are being written.
+ *
+ *  @return 0 if successful, -1 otherwise.
+ */
+int end_object_batch(void);
+
+/** @brief Checks if object is stored.
+ *
+ *  @param hash : hash of object.
+ *  @return 1 if object is in the index or current batch, 0 otherwise.
+ */
+int has_object(Hash hash);
+
+/** @brief Writes object to the object store.
+ *
+ *  If contents are NULL with a non zero length, nothing is done and -1 is
+ *  returned. Object is only written if it is not already stored. Outside a
+ *  batch, each write is a batch of its own.
+ *
+ *  If base is given, usually the previous version of the same path, contents
+ *  of at least DELTA_MIN_SIZE (params.h) bytes are also encoded as copy and
+ *  insert ops against it. The delta is written instead if it is smaller than
+ *  the full object, and the base is at most DELTA_MAX_CHAIN - 1 deltas deep,
+ *  so reconstruction reads at most DELTA_MAX_CHAIN objects. Bases of
+ *  STREAM_MIN_SIZE bytes or more are not read into memory, and not used.
+ *
+ *  Contents are split into OBJECT_FRAME_SIZE (params.h) frames, and each frame
+ *  compressed with codec. Frames that do not shrink are kept raw. If the whole
+ *  object does not shrink below OBJECT_COMPRESS_PCT percent of its size, it is
+ *  written in Store mode instead: raw contents after the header, aligned in
+ *  the pack to OBJECT_ALIGN when large, so restores can reflink them.
+ *
+ *  Pack space is reserved under a lock and written outside it, so objects may
+ *  be written from several threads at once.
+ *
+ *  Format of object:
+ *
+ *  "SVC1" <codec:u8> <0:u24> <data offset:u32> <0:u32> <raw size:u64>
+ *  Store: <raw contents> at data offset
+ *  Delta, from data offset: <base hash:u64> <chain depth:u32> <0:u32>
+ *                           (<0> <n> <n bytes> | <1> <base offset> <n>)*
+ *  with integers of ops 7 bits to a byte, low bits first
+ *  Chunked, from data offset: (<chunk hash:u64> <chunk len:u64>)*
+ *  Otherwise, from data offset: (<frame len|OBJECT_FRAME_RAW:u32>
+ *                                <raw len:u32> <frame>)*
+ *
+ *  @param hash : hash of contents.
+ *  @param contents : contents of object.
+ *  @param len : length of contents.
+ *  @param codec : codec used to compress frames.
+ *  @param base : address of hash of delta base, NULL if none.
+ *  @return 0 if successful, -1 otherwise.
+ */
+int write_object(Hash hash, const char *contents, size_t len, enum Codec codec,
+                 const Hash *base);
+
+/** @brief Opens stream for an object whose hash is not yet known.
+ *
+ *  Contents written to the stream are compressed a frame at a time into a
+ *  temporary object in the svc directory, so memory use is bounded by the
+ *  frame size, whatever the object size. Frames that do not shrink are kept
+ *  raw, the whole object is never switched to Store mode. If codec has no
+ *  frame codec, contents are written raw in Store mode.
+ *
+ *  Writer MUST be closed with close_object_writer or abort_object_writer.
+ *
+ *  @param ow : address of object writer.
+ *  @param codec : codec used to compress frames.
+ *  @return 0 if successful, -1 otherwise.
+ */
+int open_object_writer(ObjectWriter *ow, enum Codec codec);
+
+/** @brief Writes contents to object stream.
+ *
+ *  Whole frames are compressed and written as they fill.
+ *
+ *  @param ow : address of object writer.
+ *  @param data : bytes of contents.
+ *  @param len : number of bytes.
+ *  @return 0 if successful, -1 otherwise.
+ */
+int write_object_stream(ObjectWriter *ow, const char *data, size_t len);
+
+/** @brief Finishes object stream, storing it as object <hash>.
+ *
+ *  The temporary object is copied into the pack, with copy_file_range where
+ *  possible, and removed. If object <hash> is already stored, the temporary
+ *  object is discarded. If the object cannot be written, perror is called and
+ *  exit with status 2 occurs.
+ *
+ *  @param ow : address of object writer.
+ *  @param hash : hash of contents written to the stream.
+ *  @return 0 if successful, -1 otherwise.
+ */
+int close_object_writer(ObjectWriter *ow, Hash hash);
+
+/** @brief Discards object stream and its temporary object.
+ *
+ *  @param ow : address of object writer.
+ */
+void abort_object_writer(ObjectWriter *ow);
+
+/** @brief Writes chunked object to the object store.
+ *
+ *  Object <hash> lists chunks, in order, which must already be stored as
+ *  objects of their own, see write_object. Restores stream the file a chunk at
+ *  a time. Object is only written if it is not already stored.
+ *
+ *  @param hash : hash of whole contents.
+ *  @param chunks : chunks of contents, in order.
+ *  @param n_chunks : number of chunks.
+ *  @return 0 if successful, -1 otherwise.
+ */
+int write_chunk_list(Hash hash, const ChunkRef *chunks, size_t n_chunks);
+
+/** @brief Reads object contents into memory.
+ *
+ *  Delta chains are reconstructed from their bases, and chunked objects are
+ *  concatenated from their chunks. Reconstructed bases are kept in a cache of
+ *  at most DELTA_CACHE_ENTRIES objects and DELTA_CACHE_SIZE bytes (params.h),
+ *  until clear_object_cache is called.
+ *
+ *  @param hash : hash of object.
+ *  @param len : address for length of contents to be set.
+ *  @return address of contents, MUST be released, NULL if the object is
+ *          missing or corrupt.
+ */
+char *read_object(Hash hash, size_t *len);
+
+/** @brief Releases cached delta bases.
+ */
+void clear_object_cache(void);
+
+/** @brief Restores object contents to file.
+ *
+ *  File at file_path is created or truncated, and contents of object <hash>
+ *  are read from the pack and written to it. Compressed objects are
+ *  decompressed a frame at a time, chunked objects a chunk at a time, and
+ *  delta objects are reconstructed in memory with read_object. Store mode objects are copied with
+ *  copy_file_contents, so reflink and in kernel copies apply. If the object
+ *  cannot be read, or is corrupt, perror is called and exit with status 2
+ *  occurs.
+ *
+ *  @param hash : hash of object.
+ *  @param file_path : path of file to be written.
+ */
+void restore_object(Hash hash, char *file_path);
+
+/** @brief Maps object contents for reading.
+ *
+ *  Objects in Store mode of at least BLOB_MAP_MIN_SIZE bytes (params.h) are
+ *  mapped in place from the pack, without being copied. Other objects are
+ *  decoded into memory, as by read_object. MUST be released with
+ *  unmap_blob.
+ *
+ *  @param hash : hash of object.
+ *  @param b : address of blob to be set.
+ *  @return 0 if successful, -1 if the object is missing or corrupt.
+ */
+int map_object(Hash hash, Blob *b);
+
+/** @brief Maps file contents for reading.
+ *
+ *  Files of at least BLOB_MAP_MIN_SIZE bytes (params.h) are mapped, smaller
+ *  files read. MUST be released with unmap_blob.
+ *
+ *  @param file_path : path of file.
+ *  @param b : address of blob to be set.
+ *  @return 0 if successful, -1 if the file cannot be read.
+ */
+int map_file(char *file_path, Blob *b);
+
+/** @brief Releases blob.
+ *
+ *  @param b : address of blob.
+ */
+void unmap_blob(Blob *b);
+
+/** @brief Reads object statistics.
+ *
+ *  Statistics are process wide, and count objects written and restored.
+ *
+ *  @param stats : address of stats to be set.
+ */
+void get_object_stats(ObjectStats *stats);
+
+/** @brief Worst case lz compressed size.
+ *
+ *  @param len : number of bytes to compress.
+ *  @return compressed size bound.
+ */
+size_t lz_bound(size_t len);
+
+/** @brief Compresses bytes with the built in lz codec.
+ *
+ *  Byte oriented LZ77: sequences of a token, literals, and a 16 bit match
+ *  offset. Input longer than 64 KiB is supported, but matches only reach back
+ *  64 KiB.
+ *
+ *  @param src : bytes to compress.
+ *  @param src_len : number of bytes.
+ *  @param dst : address for compressed bytes.
+ *  @param dst_cap : capacity of dst.
+ *  @return compressed length, 0 if dst_cap is too small.
+ */
+size_t lz_compress(const char *src, size_t src_len, char *dst, size_t dst_cap);
+
+/** @brief Decompresses bytes compressed by lz_compress.
+ *
+ *  @param src : compressed bytes.
+ *  @param src_len : number of compressed bytes.
+ *  @param dst : address for decompressed bytes.
+ *  @param dst_len : exact decompressed length.
+ *  @return 0 if successful, -1 if src is corrupt.
+ */
+int lz_decompress(const char *src, size_t src_len, char *dst, size_t dst_len);
+
+/** @brief Encodes target as copy and insert ops against base.
+ *
+ *  Base is indexed in DELTA_BLOCK_SIZE (params.h) blocks, and matches found
+ *  in target are extended in both directions. Encoding stops as soon as the
+ *  delta reaches limit bytes.
+ *
+ *  @param base : base bytes.
+ *  @param base_len : number of base bytes.
+ *  @param target : bytes to encode.
+ *  @param target_len : number of target bytes.
+ *  @param limit : length the delta must stay below.
+ *  @param delta : address for address of delta to be set, MUST be released.
+ *  @return delta length, 0 if no delta below limit was found.
+ */
+size_t delta_encode(const char *base, size_t base_len, const char *target,
+                    size_t target_len, size_t limit, char **delta);
+
+/** @brief Applies delta ops to base.
+ *
+ *  @param base : base bytes.
+ *  @param base_len : number of base bytes.
+ *  @param delta : delta ops.
+ *  @param delta_len : length of delta.
+ *  @param dst : address for reconstructed bytes.
+ *  @param dst_len : exact reconstructed length.
+ *  @return 0 if successful, -1 if delta is corrupt.
+ */
+int delta_apply(const char *base, size_t base_len, const char *delta,
+                size_t delta_len, char *dst, size_t dst_len);
+
+/** @brief Writes whole buffer to file descriptor at offset.
+ *
+ *  @param fd : file descriptor.
+ *  @param buf : bytes to write.
+ *  @param len : number of bytes.
+ *  @param offset : offset of first byte written, -1 for the file position.
+ *  @return 0 if successful, -1 otherwise.
+ */
+int write_all(int fd, const void *buf, size_t len, off_t offset);
+
+/** @brief Reads whole buffer from file descriptor at offset.
+ *
+ *  @param fd : file descriptor.
+ *  @param buf : address for bytes read.
+ *  @param len : number of bytes.
+ *  @param offset : offset of first byte read.
+ *  @return 0 if successful, -1 if file ends or read fails.
+ */
+int read_all(int fd, void *buf, size_t len, off_t offset);
+
+#endif //ASSIGNMENT_2_SVC_OBJECT_H
@@ -2,16 +2,60 @@
 #define ASSIGNMENT_2_SVC_PARAMS_H
 
 #define SVC_DIR_PATH "./.svc/"
-#define SVC_FILE_PATH_FMT "./.svc/%x.svc"
-#define HASH_HEX_SIZE 19
+#define SVC_DIR_NAME ".svc"
+#define SVC_IGNORE_PATH "./.svcignore"
+#define SVC_PACK_PATH "./.svc/objects.pack"
+#define SVC_INDEX_PATH "./.svc/objects.idx"
+#define SVC_TMP_PATH_FMT "./.svc/tmp-XXXXXX"
+#define SVC_COMMIT_LOG_PATH "./.svc/commits.log"
+#define SVC_COMMIT_INDEX_PATH "./.svc/commits.idx"
+#define SVC_BRANCHES_PATH "./.svc/branches"
+#define SVC_TABLES_PATH "./.svc/tables/"
+#define SVC_COMMIT_GRAPH_PATH "./.svc/commits.graph"
 #define INIT_COMMIT_SIZE 10
 #define INIT_BRANCHES_SIZE 2
 #define INIT_STAGING_SIZE 2
-#define INIT_SNAPSHOT_SIZE 1
+#define INIT_COMMIT_RECORD_SIZE 16
+#define SNAPSHOT_NODE_SIZE 32
+#define SNAPSHOT_MIN_NODE_SIZE 8
+#define SNAPSHOT_MAX_DEPTH 16
 #define DEFAULT_BRANCH_NAME "master"
 #define MASTER_BRANCH_INDEX 0
 #define ARRAY_GROWTH_RATE 2
 #define BRANCH_NAME_REGEX  "[0-9a-zA-Z/_-]+$"
 #define MAX_BRANCH_NAME_LEN 50
+#define HASH_BLOCK_SIZE (1 << 16)
+#define STAT_RACY_WINDOW_NS 1000000000LL
+#define DEFAULT_COMMIT_THREADS 1
+#define COPY_BLOCK_SIZE (1 << 20)
+#define OBJECT_FRAME_SIZE (1 << 16)
+#define OBJECT_COMPRESS_PCT 90
+#define OBJECT_ALIGN 4096
+#define OBJECT_ALIGN_MIN_SIZE (1 << 20)
+#define DEFAULT_OBJECT_CODEC CodecLz
+#define INIT_PENDING_OBJECTS 64
+#define DELTA_BLOCK_SIZE 16
+#define DELTA_MIN_SIZE 4096
+#define DELTA_MAX_CHAIN 16
+#define DELTA_ACCEPT_PCT 10
+#define DELTA_CACHE_ENTRIES 32
+#define DELTA_CACHE_SIZE (64 << 20)
+#define CHUNK_MIN_SIZE (16 << 10)
+#define CHUNK_AVG_BITS 16
+#define CHUNK_MAX_SIZE (256 << 10)
+#define INIT_CHUNK_LIST_SIZE 16
+#define DEFAULT_CHUNK_THRESHOLD 0
+#define STREAM_MIN_SIZE (64 << 20)
+#define MIN_ID_PREFIX_LEN 4
+#define INIT_ID_INDEX_SIZE 16
+#define INIT_PATH_INDEX_SIZE 16
+#define INIT_PATH_TABLE_SIZE 1024
+#define PATH_TABLE_BLOCK_SIZE (64 << 10)
+#define INIT_DIFF_CHUNKS 16
+#define DIFF_MAX_COST_MIN 256
+#define DIFF_CONTEXT_LINES 3
+#define DIFF_BINARY_CHECK 8000
+#define BLOB_MAP_MIN_SIZE (64 << 10)
+#define BLAME_CACHE_ENTRIES 32
 
 #endif //ASSIGNMENT_2_SVC_PARAMS_H
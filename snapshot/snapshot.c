@@ -1,51 +1,729 @@
 #include "snapshot.h"
 
-Snapshot init_snapshot() {
-    Snapshot s = {
-            .file_snapshots = (FileSnapshot *) safe_malloc(INIT_SNAPSHOT_SIZE *
-                    sizeof(FileSnapshot)),
-            .n_files = 0,
-            .file_snapshots_len = INIT_SNAPSHOT_SIZE,
-    };
+/** @brief Compares paths, interned paths are equal only if their addresses
+ *  are.
+ *
+ *  @param a : null terminated path.
+ *  @param b : null terminated path.
+ *  @return strcmp of paths.
+ */
+static int compare_path(const char *a, const char *b);
+
+/** @brief Compares file snapshots by path.
+ *
+ *  @param a : address of file snapshot.
+ *  @param b : address of file snapshot.
+ *  @return strcmp of paths.
+ */
+static int compare_file_snapshot_name(const void *a, const void *b);
+
+/** @brief Allocates empty node, referred to once.
+ *
+ *  @param leaf : 1 if node holds files, 0 if it holds children.
+ *  @return address of node.
+ */
+static SnapshotNode *new_node(uint32_t leaf);
+
+/** @brief Returns node that may be changed in place of node.
+ *
+ *  A node referred to once is returned as is. A shared node is copied, the
+ *  copy referring to its children, and the reference to node moved to it.
+ *
+ *  @param node : address of node, the reference to be replaced.
+ *  @return address of node referred to once.
+ */
+static SnapshotNode *own_node(SnapshotNode *node);
+
+/** @brief Drops a reference to node, releasing it and its children if last.
+ *
+ *  @param node : address of node, may be NULL.
+ */
+static void release_node(SnapshotNode *node);
+
+/** @brief Returns first path under node.
+ *
+ *  @param node : address of non empty node.
+ *  @return interned path.
+ */
+static char *first_path(SnapshotNode *node);
+
+/** @brief Finds position of first file of leaf not before name.
+ *
+ *  @param node : address of leaf.
+ *  @param name : null terminated path.
+ *  @return position, n if name is after every file.
+ */
+static uint32_t find_file(SnapshotNode *node, const char *name);
+
+/** @brief Finds position of child of internal node name would be under.
+ *
+ *  @param node : address of internal node.
+ *  @param name : null terminated path.
+ *  @return position of last child with first path not after name, 0 if none.
+ */
+static uint32_t find_child(SnapshotNode *node, const char *name);
+
+/** @brief Moves entries of node, files of leaves or children and keys.
+ *
+ *  @param dst : address of node moved to.
+ *  @param to : position in dst.
+ *  @param src : address of node moved from, of the same kind, may be dst.
+ *  @param from : position in src.
+ *  @param n : number of entries.
+ */
+static void move_entries(SnapshotNode *dst, uint32_t to, SnapshotNode *src,
+                         uint32_t from, uint32_t n);
+
+/** @brief Inserts file or child into node, splitting it if full.
+ *
+ *  A full node is split in half, or, if it is the last node of its level and
+ *  the entry goes last, left full and the entry moved to a new node, so paths
+ *  added in order fill their nodes.
+ *
+ *  @param node : address of node referred to once.
+ *  @param i : position of entry.
+ *  @param fs : file snapshot, leaves only.
+ *  @param child : address of child, internal nodes only.
+ *  @param last : 1 if node is the last of its level.
+ *  @return address of new right sibling if split, NULL otherwise.
+ */
+static SnapshotNode *insert_entry(SnapshotNode *node, uint32_t i,
+                                  FileSnapshot fs, SnapshotNode *child,
+                                  int last);
+
+/** @brief Adds or replaces file under node, copying shared nodes on the way.
+ *
+ *  @param node : address of node referred to once.
+ *  @param fs : file snapshot.
+ *  @param added : address to be set to 1 if file was not under node.
+ *  @param last : 1 if node is the last of its level.
+ *  @return address of new right sibling if node split, NULL otherwise.
+ */
+static SnapshotNode *insert_file(SnapshotNode *node, FileSnapshot fs,
+                                 int *added, int last);
+
+/** @brief Removes file under node, copying shared nodes on the way.
+ *
+ *  Children left with fewer than SNAPSHOT_MIN_NODE_SIZE (params.h) entries
+ *  are merged with, or take entries from, a sibling.
+ *
+ *  @param node : address of node referred to once, with file under it.
+ *  @param name : null terminated path.
+ */
+static void remove_file(SnapshotNode *node, const char *name);
+
+/** @brief Merges child of internal node with a sibling, or evens them out if
+ *  both do not fit in one node.
+ *
+ *  @param node : address of internal node referred to once, with at least 2
+ *                children.
+ *  @param i : position of child.
+ */
+static void rebalance_child(SnapshotNode *node, uint32_t i);
+
+/** @brief Builds tree bottom up, nodes evenly filled.
+ *
+ *  @param files : file snapshots, by path.
+ *  @param n_files : number of file snapshots.
+ *  @return address of root, NULL if n_files is 0.
+ */
+static SnapshotNode *build_tree(FileSnapshot *files, size_t n_files);
+
+/** @brief Streams file through the chunker, storing each chunk.
+ *
+ *  @param file_path : path of file to be stored.
+ *  @param hash : address for hash of file to be set.
+ *  @param st : address for stat of file to be set, may be NULL.
+ *  @return 0 if successful, -1 otherwise.
+ */
+static int store_chunked_file(char *file_path, Hash *hash, FileStat *st);
+
+/** @brief Streams file into a single object through a fixed size buffer.
+ *
+ *  @param file_path : path of file to be stored.
+ *  @param hash : address for hash of file to be set.
+ *  @param st : address for stat of file to be set, may be NULL.
+ *  @return 0 if successful, -1 otherwise.
+ */
+static int store_streamed_file(char *file_path, Hash *hash, FileStat *st);
+
+/** @brief Passes file block to object writer.
+ *
+ *  @param ctx : address of object writer.
+ *  @param block : bytes read.
+ *  @param len : number of bytes.
+ */
+static void stream_block(void *ctx, const char *block, size_t len);
+
+/** @brief Stores chunk and appends it to chunk list.
+ *
+ *  @param ctx : address of chunk list.
+ *  @param chunk : chunk bytes.
+ *  @param len : length of chunk.
+ */
+static void store_chunk(void *ctx, const char *chunk, size_t len);
+
+/** @brief Passes file block to chunker.
+ *
+ *  @param ctx : address of chunker.
+ *  @param block : bytes read.
+ *  @param len : number of bytes.
+ */
+static void chunk_block(void *ctx, const char *block, size_t len);
+
+Snapshot init_snapshot(Snapshot *base) {
+    Snapshot s = {NULL, 0};
+    if (base && base->root) {
+        s.root = base->root;
+        s.n_files = base->n_files;
+        s.root->refs++;
+    }
     return s;
 }
 
-int new_file_snapshot(Snapshot *ss, char *name, int hash, char *file_contents,
-                      size_t file_contents_len) {
-    if (!ss || !name || !file_contents || !hash) {
+void free_snapshot(Snapshot *ss) {
+    if (!ss) {
+        return;
+    }
+
+    release_node(ss->root);
+    ss->root = NULL;
+    ss->n_files = 0;
+    return;
+}
+
+int new_file_snapshot(Snapshot *ss, char *name, Hash hash) {
+    if (!ss || !name) {
         return -1;
     }
 
-    // resize if necessary
-    if (ss->n_files == ss->file_snapshots_len) {
-        ss->file_snapshots = safe_realloc(ss->file_snapshots,
-                                         ss->file_snapshots_len *
-                                          ARRAY_GROWTH_RATE *
-                                          sizeof(FileSnapshot));
-        ss->file_snapshots_len *= ARRAY_GROWTH_RATE;
+    // unchanged files leave shared nodes shared
+    FileSnapshot *fs = find_file_snapshot(ss, name);
+    if (fs && fs->hash == hash) {
+        return 0;
+    }
+
+    ss->root = ss->root ? own_node(ss->root) : new_node(1);
+    int added = 0;
+    SnapshotNode *split = insert_file(ss->root, (FileSnapshot) {name, hash},
+                                      &added, 1);
+    if (split) {
+        // tree grows at the root
+        SnapshotNode *root = new_node(0);
+        root->children[0] = ss->root;
+        root->keys[0] = first_path(ss->root);
+        root->children[1] = split;
+        root->keys[1] = first_path(split);
+        root->n = 2;
+        ss->root = root;
+    }
+    ss->n_files += added;
+
+    return 0;
+}
+
+int remove_file_snapshot(Snapshot *ss, const char *name) {
+    if (!find_file_snapshot(ss, name)) {
+        return -1;
     }
 
-    // new file snapshot
-    FileSnapshot *fss = &ss->file_snapshots[ss->n_files];
-    ss->n_files++;
-    fss->name = copy_string(name);
-    fss->hash = hash;
+    ss->root = own_node(ss->root);
+    remove_file(ss->root, name);
+    ss->n_files--;
 
-    // convert id to hex
-    char file_name[HASH_HEX_SIZE];
-    sprintf(file_name, SVC_FILE_PATH_FMT, hash);
+    // tree shrinks at the root, to its only child
+    while (!ss->root->leaf && ss->root->n == 1) {
+        SnapshotNode *child = ss->root->children[0];
+        child->refs++;
+        release_node(ss->root);
+        ss->root = child;
+    }
+    if (!ss->root->n) {
+        release_node(ss->root);
+        ss->root = NULL;
+    }
+
+    return 0;
+}
 
-    // check file access permission exists
-    if (access(file_name, F_OK) == -1) {
-        FILE *f = fopen(file_name, "w");
-        if (!f) {
-            perror("unable to create file during commit");
-            exit(2);
+FileSnapshot *find_file_snapshot(Snapshot *ss, const char *name) {
+    if (!ss || !ss->root || !name) {
+        return NULL;
+    }
+
+    SnapshotNode *node = ss->root;
+    while (!node->leaf) {
+        node = node->children[find_child(node, name)];
+    }
+    uint32_t i = find_file(node, name);
+    return i < node->n && !compare_path(node->files[i].name, name) ?
+           &node->files[i] : NULL;
+}
+
+int load_snapshot(Snapshot *ss, FileSnapshot *files, size_t n_files) {
+    if (!ss || (!files && n_files)) {
+        return -1;
+    }
+
+    // files are usually logged in path order already, without duplicates
+    size_t n_sorted = 1;
+    while (n_sorted < n_files &&
+           compare_path(files[n_sorted - 1].name, files[n_sorted].name) < 0) {
+        n_sorted++;
+    }
+    if (n_sorted < n_files) {
+        qsort(files, n_files, sizeof(FileSnapshot),
+              compare_file_snapshot_name);
+        for (size_t i = 1; i < n_files; ++i) {
+            if (!compare_path(files[i - 1].name, files[i].name)) {
+                return -1;
+            }
+        }
+    }
+
+    if (!ss->root) {
+        ss->root = build_tree(files, n_files);
+        ss->n_files = n_files;
+        return 0;
+    }
+
+    // differences found in one ordered pass, then applied, as the tree
+    // changes with them
+    FileSnapshot *changed = safe_malloc((ss->n_files + n_files + 1) *
+                                        sizeof(FileSnapshot));
+    size_t n_removed = 0;
+    size_t n_changed = 0;
+    SnapshotIter it;
+    init_snapshot_iter(&it, ss);
+    FileSnapshot *fs = next_file_snapshot(&it);
+    size_t i = 0;
+    while (fs || i < n_files) {
+        int cmp = !fs ? 1 : i == n_files ? -1 :
+                  compare_path(fs->name, files[i].name);
+        if (cmp < 0) {
+            // removed paths first, from the front
+            changed[n_removed++] = *fs;
+        } else if (cmp > 0 || fs->hash != files[i].hash) {
+            // added or replaced paths after, from the back
+            changed[ss->n_files + n_files - ++n_changed] = files[i];
+        }
+        if (cmp <= 0) {
+            fs = next_file_snapshot(&it);
+        }
+        if (cmp >= 0) {
+            i++;
+        }
+    }
+
+    FileSnapshot *added = changed + ss->n_files + n_files - n_changed;
+    for (size_t j = 0; j < n_removed; ++j) {
+        remove_file_snapshot(ss, changed[j].name);
+    }
+    for (size_t j = 0; j < n_changed; ++j) {
+        new_file_snapshot(ss, added[j].name, added[j].hash);
+    }
+    free(changed);
+
+    return 0;
+}
+
+void init_snapshot_iter(SnapshotIter *it, Snapshot *ss) {
+    it->depth = 0;
+    if (ss && ss->root) {
+        it->nodes[0] = ss->root;
+        it->pos[0] = 0;
+        it->depth = 1;
+    }
+    return;
+}
+
+FileSnapshot *next_file_snapshot(SnapshotIter *it) {
+    while (it->depth) {
+        size_t d = it->depth - 1;
+        SnapshotNode *node = it->nodes[d];
+        if (it->pos[d] == node->n) {
+            it->depth--;
+            continue;
         }
-        // save file contents
-        fwrite(file_contents, sizeof(char), file_contents_len, f);
-        fclose(f);
+
+        uint32_t i = it->pos[d]++;
+        if (node->leaf) {
+            return &node->files[i];
+        }
+        it->nodes[d + 1] = node->children[i];
+        it->pos[d + 1] = 0;
+        it->depth++;
+    }
+
+    return NULL;
+}
+
+int store_file_snapshot(char *file_path, Hash *hash, FileStat *st,
+                        const Hash *base, uint64_t chunk_threshold) {
+    if (!file_path || !hash) {
+        return -1;
+    }
+
+    // large files are chunked or streamed instead of copied
+    struct stat sb;
+    if (stat(file_path, &sb) == 0) {
+        if (chunk_threshold && (uint64_t) sb.st_size >= chunk_threshold) {
+            return store_chunked_file(file_path, hash, st);
+        } else if ((uint64_t) sb.st_size >= STREAM_MIN_SIZE) {
+            return store_streamed_file(file_path, hash, st);
+        }
+    }
+
+    // hash and copy file contents
+    char *file_cpy = NULL;
+    size_t file_cpy_len = 0;
+    if (hash_and_copy_file(file_path, &file_cpy, &file_cpy_len, hash,
+                           st) == -1) {
+        return -1;
     }
 
+    // save file contents
+    write_object(*hash, file_cpy, file_cpy_len, DEFAULT_OBJECT_CODEC, base);
+
+    free(file_cpy);
     return 0;
-}
\ No newline at end of file
+}
+
+SnapshotPair *pair_snapshots(Snapshot *from, Snapshot *to, size_t *n_pairs) {
+    if (!to || !n_pairs) {
+        return NULL;
+    }
+
+    size_t n_from = from ? from->n_files : 0;
+    SnapshotPair *pairs = safe_malloc((n_from + to->n_files + 1) *
+                                      sizeof(SnapshotPair));
+
+    // merge join on path, both trees in path order
+    SnapshotIter from_it;
+    SnapshotIter to_it;
+    init_snapshot_iter(&from_it, from);
+    init_snapshot_iter(&to_it, to);
+    FileSnapshot *a = next_file_snapshot(&from_it);
+    FileSnapshot *b = next_file_snapshot(&to_it);
+    *n_pairs = 0;
+    while (a || b) {
+        int cmp = !a ? 1 : !b ? -1 : compare_path(a->name, b->name);
+        pairs[*n_pairs].from = cmp <= 0 ? a : NULL;
+        pairs[*n_pairs].to = cmp >= 0 ? b : NULL;
+        (*n_pairs)++;
+        if (cmp <= 0) {
+            a = next_file_snapshot(&from_it);
+        }
+        if (cmp >= 0) {
+            b = next_file_snapshot(&to_it);
+        }
+    }
+
+    return pairs;
+}
+
+static int compare_path(const char *a, const char *b) {
+    return a == b ? 0 : strcmp(a, b);
+}
+
+static int compare_file_snapshot_name(const void *a, const void *b) {
+    return compare_path(((FileSnapshot *) a)->name,
+                        ((FileSnapshot *) b)->name);
+}
+
+static SnapshotNode *new_node(uint32_t leaf) {
+    SnapshotNode *node = safe_malloc(sizeof(SnapshotNode));
+    node->refs = 1;
+    node->n = 0;
+    node->leaf = leaf;
+    return node;
+}
+
+static SnapshotNode *own_node(SnapshotNode *node) {
+    if (node->refs == 1) {
+        return node;
+    }
+
+    SnapshotNode *copy = safe_malloc(sizeof(SnapshotNode));
+    memcpy(copy, node, sizeof(SnapshotNode));
+    copy->refs = 1;
+    if (!copy->leaf) {
+        for (uint32_t i = 0; i < copy->n; ++i) {
+            copy->children[i]->refs++;
+        }
+    }
+    node->refs--;
+    return copy;
+}
+
+static void release_node(SnapshotNode *node) {
+    if (!node || --node->refs) {
+        return;
+    }
+
+    if (!node->leaf) {
+        for (uint32_t i = 0; i < node->n; ++i) {
+            release_node(node->children[i]);
+        }
+    }
+    free(node);
+    return;
+}
+
+static char *first_path(SnapshotNode *node) {
+    return node->leaf ? node->files[0].name : node->keys[0];
+}
+
+static uint32_t find_file(SnapshotNode *node, const char *name) {
+    uint32_t lo = 0;
+    uint32_t hi = node->n;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (compare_path(node->files[mid].name, name) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static uint32_t find_child(SnapshotNode *node, const char *name) {
+    uint32_t lo = 0;
+    uint32_t hi = node->n;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (compare_path(node->keys[mid], name) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo ? lo - 1 : 0;
+}
+
+static void move_entries(SnapshotNode *dst, uint32_t to, SnapshotNode *src,
+                         uint32_t from, uint32_t n) {
+    if (src->leaf) {
+        memmove(dst->files + to, src->files + from, n * sizeof(FileSnapshot));
+    } else {
+        memmove(dst->children + to, src->children + from,
+                n * sizeof(SnapshotNode *));
+        memmove(dst->keys + to, src->keys + from, n * sizeof(char *));
+    }
+    return;
+}
+
+static SnapshotNode *insert_entry(SnapshotNode *node, uint32_t i,
+                                  FileSnapshot fs, SnapshotNode *child,
+                                  int last) {
+    SnapshotNode *target = node;
+    SnapshotNode *split = NULL;
+    if (node->n == SNAPSHOT_NODE_SIZE) {
+        uint32_t half = last && i == SNAPSHOT_NODE_SIZE ? SNAPSHOT_NODE_SIZE :
+                        SNAPSHOT_NODE_SIZE / 2;
+        split = new_node(node->leaf);
+        move_entries(split, 0, node, half, node->n - half);
+        split->n = node->n - half;
+        node->n = half;
+        if (i > half || half == SNAPSHOT_NODE_SIZE) {
+            target = split;
+            i -= half;
+        }
+    }
+
+    move_entries(target, i + 1, target, i, target->n - i);
+    if (target->leaf) {
+        target->files[i] = fs;
+    } else {
+        target->children[i] = child;
+        target->keys[i] = first_path(child);
+    }
+    target->n++;
+    return split;
+}
+
+static SnapshotNode *insert_file(SnapshotNode *node, FileSnapshot fs,
+                                 int *added, int last) {
+    if (node->leaf) {
+        uint32_t i = find_file(node, fs.name);
+        if (i < node->n && !compare_path(node->files[i].name, fs.name)) {
+            node->files[i].hash = fs.hash;
+            return NULL;
+        }
+        *added = 1;
+        return insert_entry(node, i, fs, NULL, last);
+    }
+
+    uint32_t i = find_child(node, fs.name);
+    node->children[i] = own_node(node->children[i]);
+    SnapshotNode *split = insert_file(node->children[i], fs, added,
+                                      last && i == node->n - 1);
+    // path may now be first under child
+    node->keys[i] = first_path(node->children[i]);
+    return split ? insert_entry(node, i + 1, fs, split, last) : NULL;
+}
+
+static void remove_file(SnapshotNode *node, const char *name) {
+    if (node->leaf) {
+        uint32_t i = find_file(node, name);
+        move_entries(node, i, node, i + 1, node->n - i - 1);
+        node->n--;
+        return;
+    }
+
+    uint32_t i = find_child(node, name);
+    node->children[i] = own_node(node->children[i]);
+    SnapshotNode *child = node->children[i];
+    remove_file(child, name);
+    if (!child->n) {
+        release_node(child);
+        move_entries(node, i, node, i + 1, node->n - i - 1);
+        node->n--;
+        return;
+    }
+
+    node->keys[i] = first_path(child);
+    if (child->n < SNAPSHOT_MIN_NODE_SIZE && node->n > 1) {
+        rebalance_child(node, i);
+    }
+    return;
+}
+
+static void rebalance_child(SnapshotNode *node, uint32_t i) {
+    // right sibling, left one for the last child
+    uint32_t l = i + 1 < node->n ? i : i - 1;
+    node->children[l] = own_node(node->children[l]);
+    node->children[l + 1] = own_node(node->children[l + 1]);
+    SnapshotNode *left = node->children[l];
+    SnapshotNode *right = node->children[l + 1];
+
+    if (left->n + right->n <= SNAPSHOT_NODE_SIZE) {
+        // right moves into left, its children keeping their references
+        move_entries(left, left->n, right, 0, right->n);
+        left->n += right->n;
+        free(right);
+        move_entries(node, l + 1, node, l + 2, node->n - l - 2);
+        node->n--;
+        return;
+    }
+
+    uint32_t n_left = (left->n + right->n) / 2;
+    if (left->n < n_left) {
+        uint32_t n = n_left - left->n;
+        move_entries(left, left->n, right, 0, n);
+        move_entries(right, 0, right, n, right->n - n);
+        left->n += n;
+        right->n -= n;
+    } else {
+        uint32_t n = left->n - n_left;
+        move_entries(right, n, right, 0, right->n);
+        move_entries(right, 0, left, n_left, n);
+        left->n -= n;
+        right->n += n;
+    }
+    node->keys[l + 1] = first_path(right);
+    return;
+}
+
+static SnapshotNode *build_tree(FileSnapshot *files, size_t n_files) {
+    if (!n_files) {
+        return NULL;
+    }
+
+    // leaves, then each level over the one below, until a single root
+    size_t n_nodes = (n_files + SNAPSHOT_NODE_SIZE - 1) / SNAPSHOT_NODE_SIZE;
+    SnapshotNode **level = safe_malloc(n_nodes * sizeof(SnapshotNode *));
+    for (size_t i = 0, start = 0; i < n_nodes; ++i) {
+        size_t end = n_files * (i + 1) / n_nodes;
+        level[i] = new_node(1);
+        memcpy(level[i]->files, files + start,
+               (end - start) * sizeof(FileSnapshot));
+        level[i]->n = (uint32_t) (end - start);
+        start = end;
+    }
+    while (n_nodes > 1) {
+        size_t n_parents = (n_nodes + SNAPSHOT_NODE_SIZE - 1) /
+                           SNAPSHOT_NODE_SIZE;
+        for (size_t i = 0, start = 0; i < n_parents; ++i) {
+            size_t end = n_nodes * (i + 1) / n_parents;
+            SnapshotNode *parent = new_node(0);
+            for (size_t j = start; j < end; ++j) {
+                parent->children[parent->n] = level[j];
+                parent->keys[parent->n] = first_path(level[j]);
+                parent->n++;
+            }
+            // parents are written behind the children still to be read
+            level[i] = parent;
+            start = end;
+        }
+        n_nodes = n_parents;
+    }
+
+    SnapshotNode *root = level[0];
+    free(level);
+    return root;
+}
+
+static int store_chunked_file(char *file_path, Hash *hash, FileStat *st) {
+    ChunkList list = {
+            .chunks = safe_malloc(INIT_CHUNK_LIST_SIZE * sizeof(ChunkRef)),
+            .n_chunks = 0,
+            .len_chunks = INIT_CHUNK_LIST_SIZE,
+    };
+    Chunker ch;
+    init_chunker(&ch, store_chunk, &list);
+    int status = hash_and_stream_file(file_path, chunk_block, &ch, hash, st);
+    chunker_final(&ch);
+
+    if (status == 0) {
+        write_chunk_list(*hash, list.chunks, list.n_chunks);
+    }
+    free(list.chunks);
+    return status;
+}
+
+static int store_streamed_file(char *file_path, Hash *hash, FileStat *st) {
+    ObjectWriter ow;
+    if (open_object_writer(&ow, DEFAULT_OBJECT_CODEC) == -1) {
+        return -1;
+    }
+
+    if (hash_and_stream_file(file_path, stream_block, &ow, hash, st) == -1) {
+        abort_object_writer(&ow);
+        return -1;
+    }
+    return close_object_writer(&ow, *hash);
+}
+
+static void stream_block(void *ctx, const char *block, size_t len) {
+    if (write_object_stream((ObjectWriter *) ctx, block, len) == -1) {
+        perror("unable to store file during commit");
+        exit(2);
+    }
+    return;
+}
+
+static void store_chunk(void *ctx, const char *chunk, size_t len) {
+    ChunkList *list = (ChunkList *) ctx;
+
+    // resize if necessary
+    if (list->n_chunks == list->len_chunks) {
+        list->chunks = safe_realloc(list->chunks, list->len_chunks *
+                                    ARRAY_GROWTH_RATE * sizeof(ChunkRef));
+        list->len_chunks *= ARRAY_GROWTH_RATE;
+    }
+
+    // unchanged chunks are already stored, and only hashed
+    ChunkRef *ref = &list->chunks[list->n_chunks];
+    list->n_chunks++;
+    ref->hash = hash_bytes(chunk, len);
+    ref->len = len;
+    write_object(ref->hash, chunk, len, DEFAULT_OBJECT_CODEC, NULL);
+    return;
+}
+
+static void chunk_block(void *ctx, const char *block, size_t len) {
+    chunker_update((Chunker *) ctx, block, len);
+    return;
+}
@@ -3,44 +3,183 @@
 
 #include "../params.h"
 #include "../memory/memory.h"
+#include "../hash/hash.h"
+#include "../file_data/file_data.h"
+#include "../object/object.h"
+#include "../chunk/chunk.h"
+#include "../intern/intern.h"
 #include <stdio.h>
+#include <inttypes.h>
 #include <unistd.h>
 
 typedef struct FileSnapshot {
-    char *name;  // original file name, including extension
-    int hash;    // hash of the file
+    char *name;  // interned file name, including extension, do NOT free
+    Hash hash;   // hash of the file contents
 } FileSnapshot;
 
+typedef struct SnapshotNode {
+    size_t refs;     // number of snapshots and nodes referring to node
+    uint32_t n;      // number of files or children
+    uint32_t leaf;   // 1 if node holds files, 0 if it holds children
+    union {
+        FileSnapshot files[SNAPSHOT_NODE_SIZE];  // files, by path
+        struct {
+            struct SnapshotNode *children[SNAPSHOT_NODE_SIZE]; // by path
+            char *keys[SNAPSHOT_NODE_SIZE];  // first path under each child
+        };
+    };
+} SnapshotNode;
+
 typedef struct Snapshot {
-    FileSnapshot *file_snapshots;  // all file snapshots int the snapshot
-    size_t n_files;                // number of files
-    size_t file_snapshots_len;     // length of file snapshot
+    SnapshotNode *root;  // tree of all files by path, NULL if no files
+    size_t n_files;      // number of files
 } Snapshot;
 
-/** @brief Initialises new snapshot.
+typedef struct SnapshotIter {
+    SnapshotNode *nodes[SNAPSHOT_MAX_DEPTH];  // nodes from root to leaf
+    uint32_t pos[SNAPSHOT_MAX_DEPTH];         // next entry of each node
+    size_t depth;                             // number of nodes, 0 if done
+} SnapshotIter;
+
+typedef struct SnapshotPair {
+    FileSnapshot *from;  // file snapshot in from, NULL if path only in to
+    FileSnapshot *to;    // file snapshot in to, NULL if path only in from
+} SnapshotPair;
+
+typedef struct ChunkList {
+    ChunkRef *chunks;   // chunks stored so far, in file order
+    size_t n_chunks;    // number of chunks
+    size_t len_chunks;  // capacity of chunks
+} ChunkList;
+
+/** @brief Initialises new snapshot, sharing the files of base.
  *
- *  Initialises snapshot. Files is allocated with size set to INIT_SNAPSHOT_SIZE,
- *  specified in params.h. This MUST be released.
+ *  Files are held in a persistent B+tree ordered by path. Nodes are reference
+ *  counted and shared between snapshots, and copied only when a snapshot
+ *  changes a node it shares, so a snapshot differing from base in a few
+ *  files costs a few nodes. Snapshots MUST only be used from one thread at a
+ *  time. File names are interned, and not part of the tree. MUST be released
+ *  with free_snapshot.
  *
+ *  @param base : address of snapshot to share files of, may be NULL.
  *  @return snapshot instance.
  */
-Snapshot init_snapshot();
+Snapshot init_snapshot(Snapshot *base);
+
+/** @brief Releases snapshot.
+ *
+ *  Nodes no other snapshot refers to are released. Snapshot is left empty.
+ *
+ *  @param ss : address of snapshot, may be NULL.
+ */
+void free_snapshot(Snapshot *ss);
 
-/** @brief Takes a new file snapshot.
+/** @brief Records a file snapshot.
  *
- *  If snapshot, name, file contents, or hash are NULL, nothing is done and -1
- *  is returned. Snapshot files array is reallocated if full. New file snapshot
- *  based on the provided parameters is created. A new file is only created if
- *  no file with the name <hash>.svc exists in the svc directory.
+ *  If snapshot or name are NULL, nothing is done and -1 is returned. File
+ *  snapshot of name is added, or its hash replaced if already recorded. Shared
+ *  nodes on the path to it are copied, unless the hash is unchanged. File
+ *  contents are not written, they must already be stored with
+ *  store_file_snapshot.
  *
  *  @param ss : snapshot instance.
- *  @param name : file path.
+ *  @param name : file path, interned.
  *  @param hash : hash of file.
- *  @param file_contents : byte array of file contents.
- *  @param file_contents_len : length of file contents.
  *  @return 0 if successful, -1 otherwise.
  */
-int new_file_snapshot(Snapshot *ss, char *name, int hash, char *file_contents,
-                      size_t file_contents_len);
+int new_file_snapshot(Snapshot *ss, char *name, Hash hash);
+
+/** @brief Removes a file snapshot.
+ *
+ *  @param ss : snapshot instance.
+ *  @param name : null terminated file path.
+ *  @return 0 if successful, -1 if snapshot has no file name.
+ */
+int remove_file_snapshot(Snapshot *ss, const char *name);
+
+/** @brief Finds file snapshot by path.
+ *
+ *  Returned file snapshot may be shared with other snapshots, do NOT modify.
+ *
+ *  @param ss : address of snapshot, may be NULL.
+ *  @param name : null terminated file path.
+ *  @return address of file snapshot, NULL if not found.
+ */
+FileSnapshot *find_file_snapshot(Snapshot *ss, const char *name);
+
+/** @brief Sets files of snapshot to exactly files.
+ *
+ *  files is sorted by path in place. If snapshot is empty the tree is built
+ *  bottom up, otherwise only files differing from the snapshot are added,
+ *  replaced or removed, so nodes of unchanged files stay shared.
+ *
+ *  @param ss : snapshot instance.
+ *  @param files : file snapshots, names interned.
+ *  @param n_files : number of file snapshots.
+ *  @return 0 if successful, -1 if a path appears more than once.
+ */
+int load_snapshot(Snapshot *ss, FileSnapshot *files, size_t n_files);
+
+/** @brief Initialises iterator over files of snapshot, in path order.
+ *
+ *  Snapshot MUST NOT change while iterated.
+ *
+ *  @param it : address of iterator to be set.
+ *  @param ss : address of snapshot, may be NULL.
+ */
+void init_snapshot_iter(SnapshotIter *it, Snapshot *ss);
+
+/** @brief Returns next file of snapshot iterator.
+ *
+ *  @param it : address of iterator.
+ *  @return address of file snapshot, do NOT modify, NULL if no files remain.
+ */
+FileSnapshot *next_file_snapshot(SnapshotIter *it);
+
+/** @brief Stores file contents in the svc directory.
+ *
+ *  If file_path or hash are NULL, or the file cannot be read, nothing is done
+ *  and -1 is returned. File is hashed and copied, and hash is set. Contents are
+ *  written as object <hash> in the object store, compressed with
+ *  DEFAULT_OBJECT_CODEC (params.h), or as a delta against base, see
+ *  write_object. As objects are named by a 64 bit content hash, identical
+ *  contents are stored once, regardless of path.
+ *
+ *  If chunk_threshold is non zero, files of at least chunk_threshold bytes are
+ *  streamed through the content defined chunker instead of being copied. Each
+ *  chunk is stored once as an object of its own, and the file as a list of
+ *  chunks, see write_chunk_list, so unchanged chunks are never written again.
+ *  Otherwise, files of at least STREAM_MIN_SIZE (params.h) bytes are streamed
+ *  into a single object through a fixed size buffer, see open_object_writer,
+ *  so memory use does not grow with the file size. Streamed files are not
+ *  stored as deltas.
+ *
+ *  It is safe to store files from several threads at once, including files
+ *  with identical contents.
+ *
+ *  @param file_path : path of file to be stored.
+ *  @param hash : address for hash of file to be set.
+ *  @param st : address for stat of file to be set, may be NULL.
+ *  @param base : address of hash of previous version of file, may be NULL.
+ *  @param chunk_threshold : minimum size of chunked files, 0 if disabled.
+ *  @return 0 if successful, -1 otherwise.
+ */
+int store_file_snapshot(char *file_path, Hash *hash, FileStat *st,
+                        const Hash *base, uint64_t chunk_threshold);
+
+/** @brief Pairs file snapshots of two snapshots by path.
+ *
+ *  Every path in either snapshot appears in exactly one pair, in path order.
+ *  Paths in both snapshots are paired, whether or not their hashes differ. If
+ *  from is NULL, every pair has from set to NULL. If to or n_pairs are NULL,
+ *  NULL is returned. Both trees are walked in order, nothing is sorted.
+ *  Returned array MUST be released, file snapshots are not copied.
+ *
+ *  @param from : address of snapshot, may be NULL.
+ *  @param to : address of snapshot.
+ *  @param n_pairs : address for number of pairs to be set.
+ *  @return address of pair array.
+ */
+SnapshotPair *pair_snapshots(Snapshot *from, Snapshot *to, size_t *n_pairs);
 
 #endif //ASSIGNMENT_2_SVC_SNAPSHOT_H
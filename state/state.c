@@ -0,0 +1,833 @@
+#include "state.h"
+
+// smallest encodings, bound counts read before allocating
+#define MIN_RECORD_SIZE 25
+#define MIN_FILE_SNAPSHOT_SIZE 13
+#define MIN_BRANCH_SIZE 21
+#define MIN_FILE_DATA_SIZE 65
+
+typedef struct StateBuffer {
+    unsigned char *data;  // encoded bytes
+    size_t len;           // number of bytes
+    size_t cap;           // capacity of data
+} StateBuffer;
+
+typedef struct StateReader {
+    const unsigned char *p;    // next byte read
+    const unsigned char *end;  // end of input
+} StateReader;
+
+/** @brief Appends bytes to buffer, growing it if necessary.
+ *
+ *  @param b : address of buffer.
+ *  @param src : bytes.
+ *  @param n : number of bytes.
+ */
+static void put_bytes(StateBuffer *b, const void *src, size_t n);
+
+/** @brief Appends little endian integer to buffer.
+ *
+ *  @param b : address of buffer.
+ *  @param v : integer.
+ */
+static void put_u32(StateBuffer *b, uint32_t v);
+static void put_u64(StateBuffer *b, uint64_t v);
+
+/** @brief Appends string, as its length including terminator, then its bytes.
+ *
+ *  @param b : address of buffer.
+ *  @param s : null terminated string.
+ */
+static void put_string(StateBuffer *b, const char *s);
+
+/** @brief Reads little endian integer.
+ *
+ *  @param r : address of reader, advanced past the integer.
+ *  @param v : address of integer to be set.
+ *  @return 0 if successful, -1 if input ends.
+ */
+static int get_u32(StateReader *r, uint32_t *v);
+static int get_u64(StateReader *r, uint64_t *v);
+
+/** @brief Reads string written by put_string.
+ *
+ *  @param r : address of reader, advanced past the string.
+ *  @return null terminated string within input, NULL if input is corrupt.
+ */
+static const char *get_string(StateReader *r);
+
+/** @brief Reads parents, commit records and snapshot following the message.
+ *
+ *  @param r : address of reader.
+ *  @param c : address of commit, records allocated to size.
+ *  @param n_parents : number of parents.
+ *  @param flags : flags of commit header.
+ *  @param n_record : number of commit records.
+ *  @param n_files : number of file snapshots.
+ *  @return 0 if successful, -1 if input is corrupt.
+ */
+static int read_commit_body(StateReader *r, Commit *c, size_t n_parents,
+                            uint32_t flags, size_t n_record, size_t n_files);
+
+/** @brief Reads branch files written by save_branches.
+ *
+ *  @param r : address of reader.
+ *  @param b : address of branch, files allocated to size.
+ *  @param n_files : number of files.
+ *  @return 0 if successful, -1 if input is corrupt.
+ */
+static int read_branch_files(StateReader *r, Branch *b, size_t n_files);
+
+/** @brief Appends branch files to buffer.
+ *
+ *  @param b : address of buffer.
+ *  @param branch : address of branch.
+ */
+static void put_branch_files(StateBuffer *b, Branch *branch);
+
+/** @brief Writes files of branch to a table file named by their hash.
+ *
+ *  Table file is only written if no table with the same hash exists. Sets the
+ *  saved hash of the branch table.
+ *
+ *  @param b : address of branch.
+ *  @return 0 if successful, -1 otherwise.
+ */
+static int save_file_table(Branch *b);
+
+/** @brief Reads files of branch from table file written by save_file_table.
+ *
+ *  @param hash : hash of table.
+ *  @param b : address of branch without files, files indexed once read.
+ *  @return 0 if successful, -1 if table is missing or corrupt.
+ */
+static int load_file_table(Hash hash, Branch *b);
+
+/** @brief Removes table files no branch refers to.
+ *
+ *  @param branches : branch array.
+ *  @param n_branches : number of branches.
+ */
+static void remove_unused_tables(Branch *branches, size_t n_branches);
+
+/** @brief Formats path of table file.
+ *
+ *  @param hash : hash of table.
+ *  @param path : address for TABLE_PATH_SIZE characters to be written.
+ */
+static void get_table_path(Hash hash, char *path);
+
+/** @brief Compares hashes, for sorting.
+ *
+ *  @param a : address of hash.
+ *  @param b : address of hash.
+ *  @return -1, 0 or 1.
+ */
+static int compare_hash(const void *a, const void *b);
+
+/** @brief Replaces file with buffer contents at once.
+ *
+ *  Contents are written to a temporary file in the svc directory, renamed
+ *  over path, so the file is always complete.
+ *
+ *  @param path : path of file.
+ *  @param b : address of buffer.
+ *  @return 0 if successful, -1 otherwise.
+ */
+static int replace_state_file(const char *path, StateBuffer *b);
+
+/** @brief Reads whole file into memory.
+ *
+ *  @param path : path of file.
+ *  @param min_len : smallest valid length of file.
+ *  @param len : address for length of file to be set.
+ *  @return address of contents, MUST be released, NULL if the file is
+ *          missing or shorter than min_len.
+ */
+static unsigned char *read_state_file(const char *path, size_t min_len,
+                                      size_t *len);
+
+/** @brief Checks if logged commit was completely written.
+ *
+ *  @param log : address of commit log.
+ *  @param offset : offset of commit in log.
+ *  @return 1 if complete, 0 otherwise.
+ */
+static int is_commit_complete(CommitLog *log, uint64_t offset);
+
+int open_commit_log(CommitLog *log) {
+    if (!log) {
+        errno = EFAULT;
+        return -1;
+    }
+
+    log->index = NULL;
+    log->index_size = 0;
+    log->n_mapped = 0;
+    log->n_commits = 0;
+    uint64_t index_size = 0;
+    log->log_fd = open_state_file(SVC_COMMIT_LOG_PATH, COMMIT_LOG_MAGIC,
+                                  COMMIT_LOG_HEADER_SIZE, &log->log_end);
+    log->index_fd = open_state_file(SVC_COMMIT_INDEX_PATH, COMMIT_INDEX_MAGIC,
+                                    COMMIT_INDEX_HEADER_SIZE, &index_size);
+    if (log->log_fd == -1 || log->index_fd == -1) {
+        close_commit_log(log);
+        return -1;
+    }
+
+    // partly written entries are ignored, and overwritten by the next commit
+    size_t n_entries = (index_size - COMMIT_INDEX_HEADER_SIZE) /
+                       COMMIT_INDEX_ENTRY_SIZE;
+    if (!n_entries) {
+        return 0;
+    }
+    log->index_size = COMMIT_INDEX_HEADER_SIZE +
+                      n_entries * COMMIT_INDEX_ENTRY_SIZE;
+    void *map = mmap(NULL, log->index_size, PROT_READ, MAP_SHARED,
+                     log->index_fd, 0);
+    if (map == MAP_FAILED) {
+        log->index_size = 0;
+        close_commit_log(log);
+        return -1;
+    }
+    log->index = (unsigned char *) map;
+
+    // log is written before the index, only the last commit can be partial
+    if (!is_commit_complete(log, get_le64(log->index +
+                                          COMMIT_INDEX_HEADER_SIZE +
+                                          (n_entries - 1) *
+                                          COMMIT_INDEX_ENTRY_SIZE))) {
+        n_entries--;
+    }
+    log->n_mapped = n_entries;
+    log->n_commits = n_entries;
+    return 0;
+}
+
+void close_commit_log(CommitLog *log) {
+    if (!log) {
+        return;
+    }
+
+    if (log->index) {
+        munmap(log->index, log->index_size);
+        log->index = NULL;
+        log->index_size = 0;
+    }
+    if (log->log_fd != -1) {
+        close(log->log_fd);
+        log->log_fd = -1;
+    }
+    if (log->index_fd != -1) {
+        close(log->index_fd);
+        log->index_fd = -1;
+    }
+    log->n_mapped = 0;
+    log->n_commits = 0;
+    return;
+}
+
+int append_commit(CommitLog *log, Commit *c) {
+    if (!log || !c || log->log_fd == -1 || c->index != log->n_commits ||
+        !c->id || strlen(c->id) >= COMMIT_ID_SIZE) {
+        return -1;
+    }
+
+    // header, length is set once the commit is encoded
+    StateBuffer b = {NULL, 0, 0};
+    put_u64(&b, 0);
+    put_u64(&b, c->branch_id);
+    put_u32(&b, (uint32_t) c->n_parent_commits);
+    put_u32(&b, (uint32_t) c->n_record);
+    put_u32(&b, (uint32_t) c->snapshot.n_files);
+    put_u32(&b, c->tree ? COMMIT_FLAG_TREE : 0);
+
+    put_string(&b, c->message);
+    for (size_t i = 0; i < c->n_parent_commits; ++i) {
+        put_u64(&b, c->parent_commits[i]);
+    }
+    if (c->tree) {
+        put_u64(&b, c->tree);
+    }
+    for (size_t i = 0; i < c->n_record; ++i) {
+        put_u32(&b, c->commit_record[i].change_type);
+        put_u64(&b, c->commit_record[i].hash_change.old_hash);
+        put_u64(&b, c->commit_record[i].hash_change.new_hash);
+        put_string(&b, c->commit_record[i].file_name);
+    }
+    SnapshotIter it;
+    init_snapshot_iter(&it, &c->snapshot);
+    FileSnapshot *fs = NULL;
+    while ((fs = next_file_snapshot(&it))) {
+        put_u64(&b, fs->hash);
+        put_string(&b, fs->name);
+    }
+    put_le64(b.data, b.len);
+
+    // index entry, offset then id padded with terminators
+    unsigned char entry[COMMIT_INDEX_ENTRY_SIZE] = {0};
+    put_le64(entry, log->log_end);
+    memcpy(entry + 8, c->id, strlen(c->id));
+
+    int ret = write_all(log->log_fd, b.data, b.len, log->log_end);
+    if (ret == 0) {
+        ret = write_all(log->index_fd, entry, COMMIT_INDEX_ENTRY_SIZE,
+                        COMMIT_INDEX_HEADER_SIZE +
+                        log->n_commits * COMMIT_INDEX_ENTRY_SIZE);
+    }
+    if (ret == 0) {
+        log->log_end += b.len;
+        log->n_commits++;
+    }
+    free(b.data);
+    return ret;
+}
+
+Commit *read_commit(CommitLog *log, size_t index, Snapshot *base) {
+    const char *id = get_logged_commit_id(log, index);
+    if (!id) {
+        return NULL;
+    }
+
+    uint64_t offset = get_le64(log->index + COMMIT_INDEX_HEADER_SIZE +
+                               index * COMMIT_INDEX_ENTRY_SIZE);
+    unsigned char header[COMMIT_HEADER_SIZE];
+    if (!is_commit_complete(log, offset) ||
+        read_all(log->log_fd, header, COMMIT_HEADER_SIZE, offset) == -1) {
+        return NULL;
+    }
+    uint64_t len = get_le64(header) - COMMIT_HEADER_SIZE;
+    uint64_t branch_id = get_le64(header + 8);
+    size_t n_parents = get_le32(header + 16);
+    size_t n_record = get_le32(header + 20);
+    size_t n_files = get_le32(header + 24);
+    uint32_t flags = get_le32(header + 28);
+
+    // counts larger than the commit could hold are corrupt
+    if (flags & ~(uint32_t) COMMIT_FLAG_TREE ||
+        n_parents * 8 + (flags & COMMIT_FLAG_TREE ? 8 : 0) +
+        n_record * MIN_RECORD_SIZE + n_files * MIN_FILE_SNAPSHOT_SIZE > len) {
+        return NULL;
+    }
+
+    unsigned char *body = safe_malloc(len + 1);
+    StateReader r = {body, body + len};
+    const char *message = NULL;
+    if (read_all(log->log_fd, body, len, offset + COMMIT_HEADER_SIZE) == -1 ||
+        !(message = get_string(&r))) {
+        free(body);
+        return NULL;
+    }
+
+    // records allocated once, in the commit arena
+    Commit *c = init_commit((char *) message, n_record, branch_id, base);
+    c->id = arena_copy_string(&c->arena, id);
+    c->index = index;
+    if (read_commit_body(&r, c, n_parents, flags, n_record, n_files) == -1) {
+        free_commit(c);
+        c = NULL;
+    }
+
+    free(body);
+    return c;
+}
+
+const char *get_logged_commit_id(CommitLog *log, size_t index) {
+    if (!log || index >= log->n_mapped) {
+        return NULL;
+    }
+
+    const char *id = (const char *) log->index + COMMIT_INDEX_HEADER_SIZE +
+                     index * COMMIT_INDEX_ENTRY_SIZE + 8;
+    return memchr(id, '\0', COMMIT_ID_SIZE) ? id : NULL;
+}
+
+int set_commit_branch(CommitLog *log, size_t index, size_t branch_id) {
+    if (!log || index >= log->n_commits) {
+        return -1;
+    }
+
+    unsigned char buf[8];
+    if (read_all(log->index_fd, buf, sizeof(buf), COMMIT_INDEX_HEADER_SIZE +
+                 index * COMMIT_INDEX_ENTRY_SIZE) == -1) {
+        return -1;
+    }
+    uint64_t offset = get_le64(buf);
+    put_le64(buf, branch_id);
+    return write_all(log->log_fd, buf, sizeof(buf), offset + 8);
+}
+
+int save_branches(Branch *branches, size_t n_branches, size_t current_branch) {
+    if (!branches) {
+        return -1;
+    }
+
+    // tables changed since saved are written first, shared tables once
+    int changed = 0;
+    for (size_t i = 0; i < n_branches; ++i) {
+        if (!branches[i].table->saved) {
+            if (save_file_table(&branches[i]) == -1) {
+                return -1;
+            }
+            changed = 1;
+        }
+    }
+
+    StateBuffer b = {NULL, 0, 0};
+    put_bytes(&b, BRANCHES_MAGIC, 4);
+    put_u32(&b, BRANCHES_VERSION);
+    put_u64(&b, current_branch);
+    put_u64(&b, n_branches);
+    for (size_t i = 0; i < n_branches; ++i) {
+        put_u64(&b, branches[i].commit ? branches[i].commit->index : NO_COMMIT);
+        put_u64(&b, branches[i].table->saved);
+        put_string(&b, branches[i].name);
+    }
+
+    // replace saved branches at once, then drop tables no longer referred to
+    int ret = replace_state_file(SVC_BRANCHES_PATH, &b);
+    if (ret == 0 && changed) {
+        remove_unused_tables(branches, n_branches);
+    }
+
+    free(b.data);
+    return ret;
+}
+
+Branch *load_branches(size_t *n_branches, size_t *current_branch,
+                      uint64_t **heads) {
+    if (!n_branches || !current_branch || !heads) {
+        return NULL;
+    }
+
+    size_t len = 0;
+    unsigned char *data = read_state_file(SVC_BRANCHES_PATH,
+                                          BRANCHES_HEADER_SIZE, &len);
+    if (!data) {
+        return NULL;
+    }
+
+    // version 1 branches hold their files, later versions refer to tables
+    uint32_t version = get_le32(data + 4);
+    size_t n = (size_t) get_le64(data + 16);
+    size_t current = (size_t) get_le64(data + 8);
+    if (memcmp(data, BRANCHES_MAGIC, 4) != 0 ||
+        (version != STATE_VERSION && version != BRANCHES_VERSION) || !n ||
+        current >= n || n > (len - BRANCHES_HEADER_SIZE) / MIN_BRANCH_SIZE) {
+        free(data);
+        return NULL;
+    }
+
+    StateReader r = {data + BRANCHES_HEADER_SIZE, data + len};
+    Branch *branches = safe_malloc(n * sizeof(Branch));
+    uint64_t *commits = safe_malloc(n * sizeof(uint64_t));
+    size_t n_loaded = 0;
+    for (; n_loaded < n; ++n_loaded) {
+        uint64_t count = 0;
+        const char *name = NULL;
+        if (get_u64(&r, &commits[n_loaded]) == -1 ||
+            get_u64(&r, &count) == -1 || !(name = get_string(&r))) {
+            break;
+        }
+
+        Branch *b = &branches[n_loaded];
+        if (version == STATE_VERSION) {
+            // files follow the branch name
+            if (count > (uint64_t) (r.end - r.p) / MIN_FILE_DATA_SIZE) {
+                break;
+            }
+            *b = init_branch((char *) name, (size_t) count > INIT_STAGING_SIZE ?
+                                            (size_t) count : INIT_STAGING_SIZE);
+            if (read_branch_files(&r, b, count) == -1) {
+                free_branch(*b);
+                break;
+            }
+            index_branch_files(b);
+            continue;
+        }
+
+        // count is the hash of the table, shared with any earlier branch
+        size_t j = 0;
+        while (j < n_loaded && branches[j].table->saved != count) {
+            j++;
+        }
+        if (j < n_loaded) {
+            *b = fork_branch(&branches[j], (char *) name);
+            continue;
+        }
+        *b = init_branch((char *) name, INIT_STAGING_SIZE);
+        if (load_file_table(count, b) == -1) {
+            free_branch(*b);
+            break;
+        }
+    }
+    free(data);
+
+    if (n_loaded < n) {
+        for (size_t i = 0; i < n_loaded; ++i) {
+            free_branch(branches[i]);
+        }
+        free(branches);
+        free(commits);
+        return NULL;
+    }
+
+    *n_branches = n;
+    *current_branch = current;
+    *heads = commits;
+    return branches;
+}
+
+static int read_commit_body(StateReader *r, Commit *c, size_t n_parents,
+                            uint32_t flags, size_t n_record, size_t n_files) {
+    if (n_parents) {
+        c->parent_commits = arena_alloc(&c->arena,
+                                        n_parents * sizeof(size_t));
+    }
+    for (; c->n_parent_commits < n_parents; ++c->n_parent_commits) {
+        uint64_t parent = 0;
+        if (get_u64(r, &parent) == -1 || parent >= c->index) {
+            return -1;
+        }
+        c->parent_commits[c->n_parent_commits] = (size_t) parent;
+    }
+    if (flags & COMMIT_FLAG_TREE &&
+        (get_u64(r, &c->tree) == -1 || !c->tree)) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < n_record; ++i) {
+        uint32_t change_type = 0;
+        HashChange hash_change = {0, 0};
+        const char *name = NULL;
+        if (get_u32(r, &change_type) == -1 || change_type > Change ||
+            get_u64(r, &hash_change.old_hash) == -1 ||
+            get_u64(r, &hash_change.new_hash) == -1 ||
+            !(name = get_string(r))) {
+            return -1;
+        }
+        CommitRecord *cr = &c->commit_record[c->n_record];
+        cr->file_name = intern_path(name);
+        cr->change_type = (enum CommitChangeType) change_type;
+        cr->hash_change = hash_change;
+        c->n_record++;
+    }
+
+    // snapshot set at once, sharing nodes of unchanged files with base
+    FileSnapshot *files = safe_malloc((n_files + 1) * sizeof(FileSnapshot));
+    for (size_t i = 0; i < n_files; ++i) {
+        const char *name = NULL;
+        if (get_u64(r, &files[i].hash) == -1 || !(name = get_string(r))) {
+            free(files);
+            return -1;
+        }
+        files[i].name = intern_path(name);
+    }
+    int ret = r->p == r->end ? load_snapshot(&c->snapshot, files, n_files) : -1;
+    free(files);
+
+    return ret;
+}
+
+static int read_branch_files(StateReader *r, Branch *b, size_t n_files) {
+    for (size_t i = 0; i < n_files; ++i) {
+        uint32_t state = 0;
+        uint64_t v[7];
+        const char *path = NULL;
+        if (get_u32(r, &state) == -1 ||
+            (state != Tracked && state != Staged && state != Deleted)) {
+            return -1;
+        }
+        for (size_t j = 0; j < 7; ++j) {
+            if (get_u64(r, &v[j]) == -1) {
+                return -1;
+            }
+        }
+        if (!(path = get_string(r))) {
+            return -1;
+        }
+
+        FileData *fd = &b->files[b->n_files];
+        fd->file_path = intern_path(path);
+        fd->state = (enum FileState) state;
+        fd->previous_hash = v[0];
+        fd->stat.size = v[1];
+        fd->stat.mtime_ns = (int64_t) v[2];
+        fd->stat.ctime_ns = (int64_t) v[3];
+        fd->stat.ino = v[4];
+        fd->stat.dev = v[5];
+        fd->stat.checked_ns = (int64_t) v[6];
+        b->n_files++;
+    }
+
+    return 0;
+}
+
+static void put_branch_files(StateBuffer *b, Branch *branch) {
+    for (size_t i = 0; i < branch->n_files; ++i) {
+        FileData *fd = &branch->files[i];
+        put_u32(b, fd->state);
+        put_u64(b, fd->previous_hash);
+        put_u64(b, fd->stat.size);
+        put_u64(b, (uint64_t) fd->stat.mtime_ns);
+        put_u64(b, (uint64_t) fd->stat.ctime_ns);
+        put_u64(b, fd->stat.ino);
+        put_u64(b, fd->stat.dev);
+        put_u64(b, (uint64_t) fd->stat.checked_ns);
+        put_string(b, fd->file_path);
+    }
+    return;
+}
+
+static int save_file_table(Branch *b) {
+    StateBuffer buf = {NULL, 0, 0};
+    put_bytes(&buf, FILE_TABLE_MAGIC, 4);
+    put_u32(&buf, STATE_VERSION);
+    put_u64(&buf, b->n_files);
+    put_branch_files(&buf, b);
+
+    // equal tables, of branches that converged, are saved once
+    Hash hash = hash_bytes(buf.data, buf.len);
+    char path[TABLE_PATH_SIZE];
+    get_table_path(hash, path);
+    int ret = 0;
+    if (access(path, F_OK) == -1) {
+        ret = mkdir(SVC_TABLES_PATH, S_IRWXU) == -1 && errno != EEXIST ? -1 :
+              replace_state_file(path, &buf);
+    }
+    if (ret == 0) {
+        b->table->saved = hash;
+    }
+
+    free(buf.data);
+    return ret;
+}
+
+static int load_file_table(Hash hash, Branch *b) {
+    char path[TABLE_PATH_SIZE];
+    get_table_path(hash, path);
+    size_t len = 0;
+    unsigned char *data = read_state_file(path, FILE_TABLE_HEADER_SIZE, &len);
+    if (!data) {
+        return -1;
+    }
+
+    // table is named by its hash, which also checks its contents
+    uint64_t n = get_le64(data + 8);
+    if (memcmp(data, FILE_TABLE_MAGIC, 4) != 0 ||
+        get_le32(data + 4) != STATE_VERSION ||
+        hash_bytes(data, len) != hash ||
+        n > (len - FILE_TABLE_HEADER_SIZE) / MIN_FILE_DATA_SIZE) {
+        free(data);
+        return -1;
+    }
+    if (n > b->files_len) {
+        b->files_len = (size_t) n;
+        b->files = safe_realloc(b->files, b->files_len * sizeof(FileData));
+    }
+
+    StateReader r = {data + FILE_TABLE_HEADER_SIZE, data + len};
+    int ret = read_branch_files(&r, b, (size_t) n) == -1 || r.p != r.end ?
+              -1 : 0;
+    free(data);
+    if (ret == 0) {
+        index_branch_files(b);
+        b->table->saved = hash;
+    }
+    return ret;
+}
+
+static void remove_unused_tables(Branch *branches, size_t n_branches) {
+    DIR *dir = opendir(SVC_TABLES_PATH);
+    if (!dir) {
+        return;
+    }
+
+    Hash *used = safe_malloc((n_branches + 1) * sizeof(Hash));
+    for (size_t i = 0; i < n_branches; ++i) {
+        used[i] = branches[i].table->saved;
+    }
+    qsort(used, n_branches, sizeof(Hash), compare_hash);
+
+    struct dirent *e = NULL;
+    char path[TABLE_PATH_SIZE];
+    while ((e = readdir(dir))) {
+        // anything but a table file is left alone
+        char *end = NULL;
+        Hash hash = (Hash) strtoull(e->d_name, &end, 16);
+        if (end != e->d_name + 16 || *end ||
+            bsearch(&hash, used, n_branches, sizeof(Hash), compare_hash)) {
+            continue;
+        }
+        get_table_path(hash, path);
+        unlink(path);
+    }
+
+    free(used);
+    closedir(dir);
+    return;
+}
+
+static void get_table_path(Hash hash, char *path) {
+    snprintf(path, TABLE_PATH_SIZE, SVC_TABLES_PATH "%016" PRIx64, hash);
+    return;
+}
+
+static int compare_hash(const void *a, const void *b) {
+    Hash x = *(const Hash *) a;
+    Hash y = *(const Hash *) b;
+    return x < y ? -1 : x > y;
+}
+
+static int replace_state_file(const char *path, StateBuffer *b) {
+    char tmp_path[] = SVC_TMP_PATH_FMT;
+    int fd = mkstemp(tmp_path);
+    int ret = fd == -1 ? -1 : write_all(fd, b->data, b->len, 0);
+    if (fd != -1 && close(fd) == -1) {
+        ret = -1;
+    }
+    if (ret == 0 && rename(tmp_path, path) == -1) {
+        ret = -1;
+    }
+    if (ret == -1 && fd != -1) {
+        unlink(tmp_path);
+    }
+    return ret;
+}
+
+static unsigned char *read_state_file(const char *path, size_t min_len,
+                                      size_t *len) {
+    int fd = open(path, O_RDONLY);
+    struct stat sb;
+    if (fd == -1 || fstat(fd, &sb) == -1 || (size_t) sb.st_size < min_len) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return NULL;
+    }
+
+    *len = (size_t) sb.st_size;
+    unsigned char *data = safe_malloc(*len + 1);
+    int ret = read_all(fd, data, *len, 0);
+    close(fd);
+    if (ret == -1) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+int open_state_file(const char *path, const char *magic, size_t header_size,
+                    uint64_t *size) {
+    if (!path || !magic || !size || header_size < 8 ||
+        header_size > STATE_HEADER_MAX_SIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    struct stat sb;
+    if (fd == -1 || fstat(fd, &sb) == -1) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    // new file, write header
+    unsigned char header[STATE_HEADER_MAX_SIZE] = {0};
+    if (sb.st_size == 0) {
+        memcpy(header, magic, 4);
+        put_le32(header + 4, STATE_VERSION);
+        if (write_all(fd, header, header_size, 0) == -1) {
+            close(fd);
+            return -1;
+        }
+        *size = header_size;
+        return fd;
+    }
+
+    if ((uint64_t) sb.st_size < header_size ||
+        read_all(fd, header, header_size, 0) == -1 ||
+        memcmp(header, magic, 4) != 0 ||
+        get_le32(header + 4) != STATE_VERSION) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    *size = (uint64_t) sb.st_size;
+    return fd;
+}
+
+static int is_commit_complete(CommitLog *log, uint64_t offset) {
+    unsigned char buf[8];
+    if (offset < COMMIT_LOG_HEADER_SIZE ||
+        log->log_end < COMMIT_HEADER_SIZE ||
+        offset > log->log_end - COMMIT_HEADER_SIZE ||
+        read_all(log->log_fd, buf, sizeof(buf), offset) == -1) {
+        return 0;
+    }
+
+    uint64_t len = get_le64(buf);
+    return len >= COMMIT_HEADER_SIZE && len <= log->log_end - offset;
+}
+
+static void put_bytes(StateBuffer *b, const void *src, size_t n) {
+    if (b->len + n > b->cap) {
+        b->cap = (b->len + n) * ARRAY_GROWTH_RATE;
+        b->data = safe_realloc(b->data, b->cap);
+    }
+    memcpy(b->data + b->len, src, n);
+    b->len += n;
+    return;
+}
+
+static void put_u32(StateBuffer *b, uint32_t v) {
+    unsigned char buf[4];
+    put_le32(buf, v);
+    put_bytes(b, buf, sizeof(buf));
+    return;
+}
+
+static void put_u64(StateBuffer *b, uint64_t v) {
+    unsigned char buf[8];
+    put_le64(buf, v);
+    put_bytes(b, buf, sizeof(buf));
+    return;
+}
+
+static void put_string(StateBuffer *b, const char *s) {
+    size_t n = strlen(s) + 1;
+    put_u32(b, (uint32_t) n);
+    put_bytes(b, s, n);
+    return;
+}
+
+static int get_u32(StateReader *r, uint32_t *v) {
+    if (r->end - r->p < 4) {
+        return -1;
+    }
+    *v = get_le32(r->p);
+    r->p += 4;
+    return 0;
+}
+
+static int get_u64(StateReader *r, uint64_t *v) {
+    if (r->end - r->p < 8) {
+        return -1;
+    }
+    *v = get_le64(r->p);
+    r->p += 8;
+    return 0;
+}
+
+static const char *get_string(StateReader *r) {
+    uint32_t n = 0;
+    if (get_u32(r, &n) == -1 || !n || n > (size_t) (r->end - r->p) ||
+        r->p[n - 1] != '\0') {
+        return NULL;
+    }
+    const char *s = (const char *) r->p;
+    r->p += n;
+    return s;
+}
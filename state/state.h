@@ -0,0 +1,169 @@
+#ifndef ASSIGNMENT_2_SVC_STATE_H
+#define ASSIGNMENT_2_SVC_STATE_H
+
+#include "../params.h"
+#include "../memory/memory.h"
+#include "../object/object.h"
+#include "../commit/commit.h"
+#include "../branch/branch.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define COMMIT_LOG_MAGIC "SVCL"
+#define COMMIT_LOG_HEADER_SIZE 8
+#define COMMIT_HEADER_SIZE 32
+#define COMMIT_FLAG_TREE 1
+#define COMMIT_INDEX_MAGIC "SVCO"
+#define COMMIT_INDEX_HEADER_SIZE 8
+#define COMMIT_INDEX_ENTRY_SIZE 24
+#define COMMIT_ID_SIZE 16
+#define BRANCHES_MAGIC "SVCB"
+#define BRANCHES_HEADER_SIZE 24
+#define BRANCHES_VERSION 2
+#define FILE_TABLE_MAGIC "SVCF"
+#define FILE_TABLE_HEADER_SIZE 16
+#define TABLE_PATH_SIZE (sizeof(SVC_TABLES_PATH) + 16)
+#define STATE_VERSION 1
+#define STATE_HEADER_MAX_SIZE 16
+#define NO_COMMIT UINT64_MAX
+
+typedef struct CommitLog {
+    int log_fd;              // descriptor of commit log, -1 if closed
+    uint64_t log_end;        // offset of next commit appended
+    int index_fd;            // descriptor of commit index, -1 if closed
+    size_t n_commits;        // number of commits in log
+    unsigned char *index;    // mapped index, NULL if no commits when opened
+    size_t index_size;       // size of mapping
+    size_t n_mapped;         // number of index entries mapped
+} CommitLog;
+
+/** @brief Opens file of the svc directory, creating it if missing.
+ *
+ *  New files are given a header of magic followed by STATE_VERSION, padded
+ *  to header_size. Header of existing files is checked.
+ *
+ *  @param path : path of file.
+ *  @param magic : 4 byte magic.
+ *  @param header_size : size of header, 8 to STATE_HEADER_MAX_SIZE bytes.
+ *  @param size : address for size of file to be set.
+ *  @return descriptor, opened for reading and writing, -1 if unsuccessful,
+ *          with errno set.
+ */
+int open_state_file(const char *path, const char *magic, size_t header_size,
+                    uint64_t *size);
+
+/** @brief Opens commit log of the svc directory.
+ *
+ *  Commits are appended to SVC_COMMIT_LOG_PATH (params.h), in order of
+ *  creation. Each is located through a fixed size entry of
+ *  SVC_COMMIT_INDEX_PATH, holding its log offset and id, so commit i is found
+ *  without reading the commits before it. The index is mapped, nothing else
+ *  is read, so opening does not depend on the number of commits. Both files
+ *  are created if missing. A commit only partly written when a process
+ *  stopped is ignored, and overwritten by the next commit appended.
+ *
+ *  @param log : address of commit log to be set.
+ *  @return 0 if successful, -1 otherwise, with errno set.
+ */
+int open_commit_log(CommitLog *log);
+
+/** @brief Closes commit log.
+ *
+ *  Unmaps index and closes descriptors. Files are left in the svc directory.
+ *  If log is NULL or closed, nothing is done.
+ *
+ *  @param log : address of commit log.
+ */
+void close_commit_log(CommitLog *log);
+
+/** @brief Appends commit to commit log.
+ *
+ *  Commit id, message, records, snapshot and parent indices are written, and
+ *  index of commit MUST equal the number of commits in the log. The hash of
+ *  the root tree of the commit follows its parents, if it has one, and is
+ *  flagged by COMMIT_FLAG_TREE in the header. Log entry is
+ *  written before the index entry, so a commit is only visible once complete.
+ *
+ *  @param log : address of commit log.
+ *  @param c : address of commit.
+ *  @return 0 if successful, -1 otherwise.
+ */
+int append_commit(CommitLog *log, Commit *c);
+
+/** @brief Reads commit from commit log.
+ *
+ *  Commits appended since the log was opened are not read, they are only
+ *  known to the process that created them. The snapshot is set from base,
+ *  so nodes of files unchanged since base are shared, see load_snapshot.
+ *  Returned commit MUST be released with free_commit.
+ *
+ *  @param log : address of commit log.
+ *  @param index : index of commit, less than the number mapped.
+ *  @param base : address of snapshot of a parent, may be NULL.
+ *  @return address of commit, NULL if unavailable or corrupt.
+ */
+Commit *read_commit(CommitLog *log, size_t index, Snapshot *base);
+
+/** @brief Returns id of commit in the mapped index.
+ *
+ *  Id is read from the index entry, the commit itself is not read. Returned
+ *  id is valid until the log is closed, do NOT free.
+ *
+ *  @param log : address of commit log.
+ *  @param index : index of commit.
+ *  @return null terminated id, NULL if index is not mapped.
+ */
+const char *get_logged_commit_id(CommitLog *log, size_t index);
+
+/** @brief Updates branch of logged commit.
+ *
+ *  Branch id is rewritten in place, the rest of the log is untouched.
+ *
+ *  @param log : address of commit log.
+ *  @param index : index of commit.
+ *  @param branch_id : id of branch.
+ *  @return 0 if successful, -1 otherwise.
+ */
+int set_commit_branch(CommitLog *log, size_t index, size_t branch_id);
+
+/** @brief Saves branches to the svc directory.
+ *
+ *  Branch names, last commit indices and the hash of their file table are
+ *  written to a temporary file and renamed over SVC_BRANCHES_PATH (params.h),
+ *  so the saved branches are always complete. Files, including staged and
+ *  deleted files with their last known hash and stat, are saved in table
+ *  files under SVC_TABLES_PATH, named by their hash. Only tables changed
+ *  since saved are written, once however many branches share them, so saving
+ *  a new branch does not depend on the number of files. Tables no branch
+ *  refers to are removed once the branches are saved.
+ *
+ *  @param branches : branch array.
+ *  @param n_branches : number of branches.
+ *  @param current_branch : index of current branch.
+ *  @return 0 if successful, -1 otherwise.
+ */
+int save_branches(Branch *branches, size_t n_branches, size_t current_branch);
+
+/** @brief Loads branches saved by save_branches.
+ *
+ *  Branch commits are set to NULL, heads is set to an array of last commit
+ *  indices instead, NO_COMMIT for branches without commits. Returned branches
+ *  MUST be released with free_branch, and the array and heads released.
+ *
+ *  @param n_branches : address for number of branches to be set.
+ *  @param current_branch : address for index of current branch to be set.
+ *  @param heads : address for array of last commit indices to be set.
+ *  @return branch array, NULL if unavailable or corrupt.
+ */
+Branch *load_branches(size_t *n_branches, size_t *current_branch,
+                      uint64_t **heads);
+
+#endif //ASSIGNMENT_2_SVC_STATE_H
@@ -8,8 +8,134 @@ typedef struct VersionControl {
     Commit **commits;        // all commits known to vc
     size_t n_commits;        // number of current commits (total)
     size_t len_commits;      // total allocated size of commits array
+    size_t n_threads;        // worker threads used to hash and store on commit
+    uint64_t chunk_threshold; // minimum size of chunked files, 0 if disabled
+    CommitLog log;           // commits on disk, NULL commits are read on use
+    CommitGraph graph;       // parents and generation numbers of all commits
+    IdIndex ids;             // commits by id, NULL slots until first lookup
+    BlameCache blame;        // line maps of files blamed
 } VersionControl;
 
+enum CommitFileStatus {FileMissing = 0, FileUnchanged = 1, FileStored = 2};
+
+typedef struct CommitTask {
+    FileData *fd;                  // file being committed
+    enum CommitFileStatus status;  // outcome of hashing and storing the file
+    Hash hash;                     // hash of stored contents
+    FileStat stat;                 // stat of stored contents
+    uint64_t chunk_threshold;      // minimum size of chunked files, 0 if off
+} CommitTask;
+
+typedef struct AddTask {
+    char *file_path;  // file being added
+    int status;       // 0 if hashed, -1 if missing
+    Hash hash;        // hash of contents
+    FileStat stat;    // stat of hashed contents
+} AddTask;
+
+typedef struct Suspect {
+    size_t commit;     // index of commit suspected
+    LineTrace *lines;  // lines of blamed file, traced to the commit file
+    size_t n_lines;    // number of lines
+    size_t len_lines;  // capacity of lines
+    int sorted;        // 1 if lines are sorted by line in the commit file
+    int has_text;      // 1 if blob and text are set
+    Blob blob;         // contents of file in commit
+    Text text;         // lines of contents
+} Suspect;
+
+typedef struct BlameState {
+    VersionControl *vc;   // version control instance
+    const char *path;     // interned path blamed
+    LineOrigin *origins;  // origin of each line of blamed file
+    Suspect *suspects;    // commits with lines still traced, max heap by index
+    size_t n_suspects;    // number of suspects
+    size_t len_suspects;  // capacity of suspects
+} BlameState;
+
+typedef struct MergeState {
+    VersionControl *vc;        // version control instance
+    Commit *ours;              // last commit of current branch, may be NULL
+    int apply;                 // 1 if merged files are written and staged
+    MergeConflict *conflicts;  // conflicts found, in path order
+    size_t n_conflicts;        // number of conflicts
+    size_t len_conflicts;      // capacity of conflicts
+} MergeState;
+
+typedef struct PathList {
+    char **paths;     // copied paths
+    size_t n_paths;   // number of paths
+    size_t len_paths; // capacity of paths
+} PathList;
+
+/** @brief Commits files of current branch.
+ *
+ *  Implements svc_commit. If merged is not NULL, it is recorded as the second
+ *  parent of the new commit. New commit is appended to the commit log, and
+ *  branches are saved. If either cannot be written, perror is called and exit
+ *  with status 2 occurs.
+ *
+ *  @param vc : Version control instance address.
+ *  @param message : commit message.
+ *  @param merged : address of last commit of merged branch, may be NULL.
+ *  @return Commit id (Hex), NULL if there are no changes.
+ */
+static char *commit_branch(VersionControl *vc, char *message, Commit *merged);
+
+/** @brief Returns commit at index, reading it from the commit log if needed.
+ *
+ *  A commit read shares the snapshot nodes of files unchanged since a parent
+ *  already read, if there is one.
+ *
+ *  @param vc : Version control instance address.
+ *  @param index : index of commit, in order of creation.
+ *  @return commit address, NULL if it cannot be read.
+ */
+static Commit *load_commit(VersionControl *vc, size_t index);
+
+/** @brief Finds index of commit by id or unique id prefix.
+ *
+ *  Commits are not read. The id index is built on first use, then kept up to
+ *  date by commit, so later lookups take constant time. See find_id.
+ *
+ *  @param vc : Version control instance address.
+ *  @param commit_id : commit id (hex), or prefix of commit id.
+ *  @return index of newest commit with matching id, ID_NOT_FOUND if not found,
+ *          ID_AMBIGUOUS if several commit ids match.
+ */
+static int64_t find_commit(VersionControl *vc, char *commit_id);
+
+/** @brief Returns id of commit at index, for the id index.
+ *
+ *  @param ctx : Version control instance address.
+ *  @param index : index of commit, in order of creation.
+ *  @return null terminated commit id, NULL if unavailable.
+ */
+static const char *index_commit_id(void *ctx, size_t index);
+
+/** @brief Returns id of commit at index, without reading the commit.
+ *
+ *  @param vc : Version control instance address.
+ *  @param index : index of commit, in order of creation.
+ *  @return null terminated commit id, NULL if unavailable.
+ */
+static const char *get_commit_id(VersionControl *vc, size_t index);
+
+/** @brief Saves branches to the svc directory.
+ *
+ *  If branches cannot be written, perror is called and exit with status 2
+ *  occurs.
+ *
+ *  @param vc : Version control instance address.
+ */
+static void save_vc_branches(VersionControl *vc);
+
+/** @brief Releases commits, branches and interned paths, and closes commit log.
+ *
+ *  @param vc : Version control instance address.
+ */
+static void free_vc(VersionControl *vc);
+
 /** @brief Checks if there exist uncommitted changes.
  *
  *  If uncommitted changes exist, 1 is returned. Otherwise, 0 is
@@ -22,15 +148,183 @@ typedef struct VersionControl {
  */
 static int check_uncommitted_changes(VersionControl *vc);
 
-/** @brief Restores tracked files to state recorded in snapshot.
+/** @brief Restores tracked files to state recorded in commit.
+ *
+ *  If vc or to are NULL, nothing is done. Files are restored incrementally,
+ *  from the commit of the files currently checked out. Files only in to, or
+ *  with a different hash in from and to, are written. Files only in from are
+ *  removed. Files with the same hash in both are skipped. If from is NULL,
+ *  every file recorded by to is written.
+ *
+ *  Unless verify is set, files are found by diffing the commit trees, when
+ *  both commits have one, so unchanged directories are skipped unread.
+ *
+ *  If verify is set, skipped files are first checked against the last known
+ *  hash of the current branch files, and rewritten if they have diverged.
+ *  Delta bases reconstructed during the restore are cached until it ends.
+ *
+ *  @param vc : Version control instance address.
+ *  @param from : Commit instance address of checked out files, may be NULL.
+ *  @param to : Commit instance address.
+ *  @param verify : 1 if working copies of skipped files must be checked.
+ */
+static void restore_snapshot(VersionControl *vc, Commit *from, Commit *to,
+                             int verify);
+
+/** @brief Restores or removes file differing between trees.
+ *
+ *  @param ctx : unused.
+ *  @param path : null terminated file path.
+ *  @param from : address of hash of checked out file, NULL if untracked.
+ *  @param to : address of hash restored, NULL if file is removed.
+ */
+static void restore_tree_file(void *ctx, char *path, const Hash *from,
+                              const Hash *to);
+
+/** @brief Finds files differing between two commits.
+ *
+ *  Trees are diffed when both commits have one, otherwise, or if a tree
+ *  cannot be read, snapshots are paired.
+ *
+ *  @param from : address of commit, NULL for no files.
+ *  @param to : address of commit.
+ *  @param fn : called for each differing file, in path order.
+ *  @param ctx : context passed to fn.
+ */
+static void diff_commits(Commit *from, Commit *to, tree_diff_fn fn, void *ctx);
+
+/** @brief Appends diff of file contents to text buffer, see svc_diff.
+ *
+ *  @param out : address of text buffer.
+ *  @param path : null terminated file path.
+ *  @param a : address of contents diffed from, NULL if file is added.
+ *  @param b : address of contents diffed to, NULL if file is removed.
+ */
+static void put_file_diff(TextBuffer *out, char *path, Blob *a, Blob *b);
+
+/** @brief Appends diff of file differing between two commits.
+ *
+ *  @param ctx : address of text buffer.
+ *  @param path : null terminated file path.
+ *  @param from : address of hash diffed from, NULL if not in it.
+ *  @param to : address of hash diffed to, NULL if not in it.
+ */
+static void diff_commit_file(void *ctx, char *path, const Hash *from,
+                             const Hash *to);
+
+/** @brief Adds lines traced to commit, as a new suspect or to its suspect.
+ *
+ *  If blob and text are given, they are the contents of the file in the
+ *  commit, owned by the suspect from then on, or released if it already has
+ *  them.
+ *
+ *  @param b : address of blame state.
+ *  @param commit : index of commit.
+ *  @param lines : traces of lines.
+ *  @param n_lines : number of traces.
+ *  @param blob : address of contents, may be NULL.
+ *  @param text : address of lines of contents, NULL if blob is.
+ */
+static void add_suspect(BlameState *b, size_t commit, LineTrace *lines,
+                        size_t n_lines, Blob *blob, Text *text);
+
+/** @brief Passes lines of suspect to its parents, or blames them on it.
+ *
+ *  @param b : address of blame state.
+ *  @param s : address of suspect, removed from the heap.
+ */
+static void blame_suspect(BlameState *b, Suspect *s);
+
+/** @brief Reads file of commit into blob and text.
+ *
+ *  @param hash : hash of file.
+ *  @param blob : address of blob to be set.
+ *  @param text : address of text to be set, numbered later.
+ *  @return 0 if successful, -1 if the file cannot be read.
+ */
+static int read_text(Hash hash, Blob *blob, Text *text);
+
+/** @brief Releases suspect.
+ *
+ *  @param s : address of suspect.
+ */
+static void free_suspect(Suspect *s);
+
+/** @brief Compares branch files by path.
  *
- *  If parameters are NULL, nothing is done. Every file recorded by the
- *  provided snapshot is restored to the state recorded by the snapshot.
+ *  @param a : address of file data address.
+ *  @param b : address of file data address.
+ *  @return strcmp of paths.
+ */
+static int compare_file_path(const void *a, const void *b);
+
+/** @brief Merges commit into the current branch, three ways.
+ *
+ *  Only files changed by theirs since the merge base are visited, found by
+ *  diffing trees when both commits have one. If m is not set to apply, only
+ *  conflicts are found.
+ *
+ *  @param m : address of merge state.
+ *  @param theirs : address of commit merged, may be NULL.
+ */
+static void merge_commits(MergeState *m, Commit *theirs);
+
+/** @brief Merges file changed by the merged branch since the merge base.
+ *
+ *  @param ctx : address of merge state.
+ *  @param path : null terminated file path.
+ *  @param base : address of hash in merge base, NULL if not in it.
+ *  @param theirs : address of hash in merged commit, NULL if not in it.
+ */
+static void merge_file(void *ctx, char *path, const Hash *base,
+                       const Hash *theirs);
+
+/** @brief Merges contents changed by both branches, line by line.
+ *
+ *  @param base : address of hash in merge base, NULL if not in it.
+ *  @param ours : hash on current branch.
+ *  @param theirs : hash on merged branch.
+ *  @param merged : address for merged contents to be set, MUST be released.
+ *  @param merged_len : address for length of merged contents to be set.
+ *  @param hunks : address for conflicting line ranges to be set.
+ *  @param n_hunks : address for number of conflicting ranges to be set.
+ *  @return 0 if merged, 1 if lines conflict, -1 if an object cannot be read.
+ */
+static int merge_contents(const Hash *base, Hash ours, Hash theirs,
+                          char **merged, size_t *merged_len, MergeHunk **hunks,
+                          size_t *n_hunks);
+
+/** @brief Takes file as changed by the merged branch.
+ *
+ *  Tracked files are overwritten, and unknown files restored if missing and
+ *  staged. Files deleted by the merged branch are removed.
  *
  *  @param vc : Version control instance address.
- *  @param ss : Snapshot instance address.
+ *  @param path : null terminated file path.
+ *  @param theirs : address of hash in merged commit, NULL if deleted.
+ */
+static void take_merged_file(VersionControl *vc, char *path,
+                             const Hash *theirs);
+
+/** @brief Checks if two optional hashes are equal.
+ *
+ *  @param a : address of hash, NULL if file is absent.
+ *  @param b : address of hash, NULL if file is absent.
+ *  @return 1 if both are absent or equal, 0 otherwise.
  */
-static void restore_snapshot(VersionControl *vc, Snapshot *ss);
+static int same_hash(const Hash *a, const Hash *b);
+
+/** @brief Checks if working copy of file matches snapshot.
+ *
+ *  Looks up the file snapshot path in the branch path index. Working copy
+ *  matches if the file is tracked with the same last known hash, and the file
+ *  is unchanged by stat, or rehashes to the same hash.
+ *
+ *  @param b : address of branch.
+ *  @param fs : address of file snapshot.
+ *  @return 1 if working copy matches, 0 otherwise.
+ */
+static int is_working_copy_current(Branch *b, FileSnapshot *fs);
 
 /** @brief Finds index of branch by name.
  *
@@ -43,6 +337,41 @@ static void restore_snapshot(VersionControl *vc, Snapshot *ss);
  */
 static int get_branch_index(VersionControl *vc, char *branch_name);
 
+/** @brief Hashes and stores a file for commit.
+ *
+ *  Pool task. Deleted files are skipped. Tracked files with an unchanged stat
+ *  are not read. Remaining files are hashed and stored in the svc directory.
+ *  Only the task at index i is written, branch files are left untouched.
+ *
+ *  @param ctx : address of commit task array.
+ *  @param i : index of task.
+ */
+static void store_commit_task(void *ctx, size_t i);
+
+/** @brief Hashes a file for bulk add.
+ *
+ *  Pool task. Only the task at index i is written.
+ *
+ *  @param ctx : address of add task array.
+ *  @param i : index of task.
+ */
+static void hash_add_task(void *ctx, size_t i);
+
+/** @brief Appends copy of walked path to path list.
+ *
+ *  @param ctx : address of path list.
+ *  @param file_path : null terminated path.
+ */
+static void collect_path(void *ctx, const char *file_path);
+
+/** @brief Compares path addresses, for sorting.
+ *
+ *  @param a : address of path address.
+ *  @param b : address of path address.
+ *  @return strcmp of paths.
+ */
+static int compare_path(const void *a, const void *b);
+
 void *svc_init(void) {
     VersionControl *vc = (VersionControl *) safe_malloc(sizeof(VersionControl));
 
@@ -51,6 +380,15 @@ void *svc_init(void) {
         perror("unable to make svc directory");
         return NULL;
     }
+    if (open_object_store() == -1) {
+        perror("unable to open object store");
+        return NULL;
+    }
+    if (open_commit_log(&vc->log) == -1 ||
+        open_commit_graph(&vc->graph, 0) == -1) {
+        perror("unable to open commit log");
+        return NULL;
+    }
 
     // init branches array
     vc->branches = (Branch *) safe_malloc(INIT_BRANCHES_SIZE * sizeof(Branch));
@@ -62,13 +400,116 @@ void *svc_init(void) {
     vc->len_commits = INIT_COMMIT_SIZE;
     vc->n_commits = 0;
 
+    vc->n_threads = DEFAULT_COMMIT_THREADS;
+    vc->chunk_threshold = DEFAULT_CHUNK_THRESHOLD;
+    // id index is built on first lookup
+    memset(&vc->ids, 0, sizeof(IdIndex));
+    init_blame_cache(&vc->blame);
+
     // init master branch
     vc->branches[MASTER_BRANCH_INDEX] = init_master_branch();
     vc->current_branch = MASTER_BRANCH_INDEX;
     vc->n_branches++;
+    save_vc_branches(vc);
+    return vc;
+}
+
+void *svc_open(void) {
+    VersionControl *vc = (VersionControl *) safe_malloc(sizeof(VersionControl));
+
+    if (open_object_store() == -1) {
+        perror("unable to open object store");
+        free(vc);
+        return NULL;
+    }
+    if (open_commit_log(&vc->log) == -1) {
+        perror("unable to open commit log");
+        close_object_store();
+        free(vc);
+        return NULL;
+    }
+
+    if (open_commit_graph(&vc->graph, vc->log.n_commits) == -1) {
+        perror("unable to open commit graph");
+        close_commit_log(&vc->log);
+        close_object_store();
+        free(vc);
+        return NULL;
+    }
+
+    uint64_t *heads = NULL;
+    vc->branches = load_branches(&vc->n_branches, &vc->current_branch, &heads);
+    if (!vc->branches) {
+        fprintf(stderr, "unable to load branches\n");
+        close_commit_graph(&vc->graph);
+        close_commit_log(&vc->log);
+        close_object_store();
+        free(vc);
+        return NULL;
+    }
+    vc->len_branches = vc->n_branches;
+
+    // commits are read from the log on first use
+    vc->n_commits = vc->log.n_commits;
+    vc->len_commits = vc->n_commits > INIT_COMMIT_SIZE ? vc->n_commits :
+                      INIT_COMMIT_SIZE;
+    vc->commits = (Commit **) safe_calloc(vc->len_commits, sizeof(Commit *));
+
+    vc->n_threads = DEFAULT_COMMIT_THREADS;
+    vc->chunk_threshold = DEFAULT_CHUNK_THRESHOLD;
+    // id index is built on first lookup
+    memset(&vc->ids, 0, sizeof(IdIndex));
+    init_blame_cache(&vc->blame);
+
+    // graph misses commits logged just before a process stopped
+    int corrupt = 0;
+    for (size_t i = vc->graph.n_commits; i < vc->n_commits && !corrupt; ++i) {
+        Commit *c = load_commit(vc, i);
+        corrupt = !c || append_graph_commit(&vc->graph, c->parent_commits,
+                                            c->n_parent_commits) == -1;
+    }
+
+    // last commit of each branch
+    for (size_t i = 0; i < vc->n_branches; ++i) {
+        if (heads[i] == NO_COMMIT) {
+            continue;
+        }
+        vc->branches[i].commit = heads[i] < vc->n_commits ?
+                                 load_commit(vc, heads[i]) : NULL;
+        corrupt |= !vc->branches[i].commit;
+    }
+    free(heads);
+
+    if (corrupt) {
+        fprintf(stderr, "unable to read commits\n");
+        free_vc(vc);
+        close_object_store();
+        free(vc);
+        return NULL;
+    }
+
     return vc;
 }
 
+void svc_close(void *helper) {
+    if (!helper) {
+        return;
+    }
+
+    VersionControl *vc = (VersionControl *) helper;
+
+    // keep staged and removed files for the next open
+    if (save_branches(vc->branches, vc->n_branches, vc->current_branch) == -1) {
+        perror("unable to save branches");
+    }
+
+    free_vc(vc);
+    close_object_store();
+
+    free(vc);
+    return;
+}
+
 void cleanup(void *helper) {
     if (!helper) {
         return;
@@ -76,6 +517,18 @@ void cleanup(void *helper) {
 
     VersionControl *vc = (VersionControl *) helper;
 
+    // free commits, branches and close commit log
+    free_vc(vc);
+
+    // delete pack, index, commit log and .svc dir
+    close_object_store();
+    remove_svc_directory();
+
+    free(vc);
+    return;
+}
+
+static void free_vc(VersionControl *vc) {
     // free commit and associated snapshot memory
     for (size_t i = 0; i < vc->n_commits; ++i) {
         free_commit(vc->commits[i]);
@@ -88,22 +541,76 @@ void cleanup(void *helper) {
     }
     free(vc->branches);
 
-    // delete snapshot files and .svc dir
-    remove_svc_directory();
+    free_id_index(&vc->ids);
+    free_blame_cache(&vc->blame);
+    close_commit_graph(&vc->graph);
+    close_commit_log(&vc->log);
+
+    // no branch or commit refers to interned paths any more
+    clear_path_table();
+    return;
+}
+
+static Commit *load_commit(VersionControl *vc, size_t index) {
+    if (index >= vc->n_commits) {
+        return NULL;
+    }
+
+    if (!vc->commits[index]) {
+        // parents are not read only to share their snapshots
+        Snapshot *base = NULL;
+        GraphEntry e;
+        if (get_graph_entry(&vc->graph, index, &e) == 0) {
+            for (size_t i = 0; i < MAX_GRAPH_PARENTS && !base; ++i) {
+                if (e.parents[i] != NO_COMMIT && vc->commits[e.parents[i]]) {
+                    base = &vc->commits[e.parents[i]]->snapshot;
+                }
+            }
+        }
+        vc->commits[index] = read_commit(&vc->log, index, base);
+    }
+
+    return vc->commits[index];
+}
+
+static int64_t find_commit(VersionControl *vc, char *commit_id) {
+    if (!vc->ids.slots) {
+        init_id_index(&vc->ids, index_commit_id, vc, vc->n_commits);
+    }
+
+    return find_id(&vc->ids, commit_id);
+}
+
+static const char *index_commit_id(void *ctx, size_t index) {
+    return get_commit_id((VersionControl *) ctx, index);
+}
+
+static const char *get_commit_id(VersionControl *vc, size_t index) {
+    if (vc->commits[index]) {
+        return vc->commits[index]->id;
+    }
+
+    return get_logged_commit_id(&vc->log, index);
+}
+
+static void save_vc_branches(VersionControl *vc) {
+    if (save_branches(vc->branches, vc->n_branches, vc->current_branch) == -1) {
+        perror("unable to save branches");
+        exit(2);
+    }
 
-    free(vc);
     return;
 }
 
-int hash_file(void *helper, char *file_path) {
+int64_t hash_file(void *helper, char *file_path) {
     if (!file_path) {
         return -1;
     }
 
     // calc hash, dont copy file
     errno = 0;
-    int hash = hash_and_copy_file(file_path, NULL, NULL);
-    if (hash == -1) {
+    Hash hash = 0;
+    if (hash_and_copy_file(file_path, NULL, NULL, &hash, NULL) == -1) {
         switch errno {
             case ENOENT:
                 return -2;
@@ -117,7 +624,7 @@ int hash_file(void *helper, char *file_path) {
         }
     }
 
-    return hash;
+    return (int64_t) hash;
 }
 
 char *svc_commit(void *helper, char *message) {
@@ -125,8 +632,10 @@ char *svc_commit(void *helper, char *message) {
         return NULL;
     }
 
-    VersionControl *vc = (VersionControl *) helper;
+    return commit_branch((VersionControl *) helper, message, NULL);
+}
 
+static char *commit_branch(VersionControl *vc, char *message, Commit *merged) {
     // resize if necessary
     if (vc->n_commits == vc->len_commits) {
         vc->commits = safe_realloc(vc->commits, vc->len_commits *
@@ -134,41 +643,67 @@ char *svc_commit(void *helper, char *message) {
         vc->len_commits *= ARRAY_GROWTH_RATE;
     }
 
-    // initialise new commit
+    // initialise new commit, sharing the snapshot of the last
+    Commit *prev_commit = vc->branches[vc->current_branch].commit;
     Commit *new_commit =
-            init_commit(message, vc->branches[vc->current_branch].n_files,
-                        vc->current_branch);
+            init_commit(message, INIT_COMMIT_RECORD_SIZE, vc->current_branch,
+                        prev_commit ? &prev_commit->snapshot : NULL);
+    new_commit->index = vc->n_commits;
     vc->commits[vc->n_commits] = new_commit;
     vc->n_commits++;
 
-    // check current known files, commit changes
+    // hash and store current known files, across the worker pool
+    Branch *cur_branch = &vc->branches[vc->current_branch];
+    own_branch_files(cur_branch);
+    CommitTask *tasks = safe_malloc((cur_branch->n_files + 1) *
+                                    sizeof(CommitTask));
+    for (size_t i = 0; i < cur_branch->n_files; ++i) {
+        tasks[i].fd = &cur_branch->files[i];
+        tasks[i].chunk_threshold = vc->chunk_threshold;
+    }
+    // batch ends once the commit tree is written, so the index is written once
+    begin_object_batch();
+    parallel_for(cur_branch->n_files, vc->n_threads, store_commit_task, tasks);
+
+    // commit changes in file order, same records as a single thread
     FileData *fd = NULL;
-    for (size_t i = 0; i < vc->branches[vc->current_branch].n_files; ++i) {
-        fd = &vc->branches[vc->current_branch].files[i];
+    for (size_t i = 0; i < cur_branch->n_files; ++i) {
+        fd = tasks[i].fd;
         if (fd->state == Deleted) {
             commit_deleted_file(new_commit, fd->file_path);
         } else if (fd->state == Staged) {
-            if (access(fd->file_path, F_OK) == -1) {
+            if (tasks[i].status == FileMissing) {
                 fd->state = Deleted;
             } else {
                 // commit change and upgrade status
+                commit_staged_file(new_commit, fd->file_path, tasks[i].hash);
                 fd->state = Tracked;
-                fd->previous_hash = commit_staged_file(new_commit, fd->file_path);
+                fd->previous_hash = tasks[i].hash;
+                fd->stat = tasks[i].stat;
             }
+        } else if (tasks[i].status == FileMissing) {
+            commit_deleted_file(new_commit, fd->file_path);
+            fd->state = Deleted;
+        } else if (tasks[i].status == FileUnchanged) {
+            // stat matches last hash, file was not read
+            commit_tracked_file(new_commit, fd->file_path, fd->previous_hash,
+                                fd->previous_hash);
         } else {
-            if (access(fd->file_path, F_OK) == -1) {
-                commit_deleted_file(new_commit, fd->file_path);
-                fd->state = Deleted;
-            } else {
-                // update hash
-                fd->previous_hash = commit_tracked_file(new_commit, fd->file_path,
-                                                        fd->previous_hash);
-            }
+            // update hash
+            commit_tracked_file(new_commit, fd->file_path, fd->previous_hash,
+                                tasks[i].hash);
+            fd->previous_hash = tasks[i].hash;
+            fd->stat = tasks[i].stat;
         }
     }
+    free(tasks);
 
     // no changes, undo commit
     if (new_commit->n_record == 0) {
+        if (end_object_batch() == -1) {
+            perror("unable to write object index");
+            exit(2);
+        }
         free_commit(new_commit);
         vc->n_commits--;
         return NULL;
@@ -177,20 +712,87 @@ char *svc_commit(void *helper, char *message) {
     char *commit_id = generate_commit_id(new_commit);
     new_commit->id = commit_id;
 
-    // edge from new commit to prev commit if exists
+    // edges from new commit to prev commit and merged commit if exist
+    new_commit->parent_commits = arena_alloc(&new_commit->arena,
+                                             2 * sizeof(size_t));
     if (vc->branches[vc->current_branch].commit) {
-        new_commit->parent_commits = safe_malloc(sizeof(Commit *));
-        new_commit->parent_commits[0] = vc->branches[vc->current_branch].commit;
-        new_commit->n_parent_commits = 1;
+        new_commit->parent_commits[new_commit->n_parent_commits++] =
+                vc->branches[vc->current_branch].commit->index;
+    }
+    if (merged) {
+        new_commit->parent_commits[new_commit->n_parent_commits++] =
+                merged->index;
+    }
+
+    // root tree, only directories changed since the last commit are written
+    if (write_commit_tree(new_commit, prev_commit) == -1 ||
+        end_object_batch() == -1) {
+        perror("unable to write object index");
+        exit(2);
+    }
+
+    if (append_commit(&vc->log, new_commit) == -1 ||
+        append_graph_commit(&vc->graph, new_commit->parent_commits,
+                            new_commit->n_parent_commits) == -1) {
+        perror("unable to write commit log");
+        exit(2);
+    }
+    if (vc->ids.slots) {
+        add_id(&vc->ids, new_commit->index);
     }
 
     // advance branch to latest commit
     vc->branches[vc->current_branch].commit = new_commit;
     // remove deleted files, track remaining
     clean_branch_files(&vc->branches[vc->current_branch]);
+    save_vc_branches(vc);
     return commit_id;
 }
 
+static void store_commit_task(void *ctx, size_t i) {
+    CommitTask *task = &((CommitTask *) ctx)[i];
+    FileData *fd = task->fd;
+
+    if (fd->state == Deleted) {
+        return;
+    }
+
+    if (fd->state == Tracked && is_file_unchanged(fd)) {
+        task->status = FileUnchanged;
+    } else if (store_file_snapshot(fd->file_path, &task->hash, &task->stat,
+                                   fd->state == Tracked ?
+                                   &fd->previous_hash : NULL,
+                                   task->chunk_threshold) == -1) {
+        task->status = FileMissing;
+    } else {
+        task->status = FileStored;
+    }
+
+    return;
+}
+
+int svc_set_commit_threads(void *helper, size_t n_threads) {
+    if (!helper || !n_threads) {
+        return -1;
+    }
+
+    VersionControl *vc = (VersionControl *) helper;
+    vc->n_threads = n_threads;
+
+    return 0;
+}
+
+int svc_set_chunk_threshold(void *helper, uint64_t threshold) {
+    if (!helper) {
+        return -1;
+    }
+
+    VersionControl *vc = (VersionControl *) helper;
+    vc->chunk_threshold = threshold;
+
+    return 0;
+}
+
 void *get_commit(void *helper, char *commit_id) {
     if (!helper || !commit_id) {
         return NULL;
@@ -198,14 +800,61 @@ void *get_commit(void *helper, char *commit_id) {
 
     VersionControl *vc = (VersionControl *) helper;
 
-    // linear search through commit array in order of creation
-    for (size_t i = vc->n_commits - 1; i >= 0 && i < vc->n_commits; --i) {
-        if (!strcmp(vc->commits[i]->id, commit_id)) {
-            return vc->commits[i];
-        }
+    int64_t index = find_commit(vc, commit_id);
+    return index < 0 ? NULL : load_commit(vc, (size_t) index);
+}
+
+int svc_resolve_commit(void *helper, char *prefix, char **commit_id) {
+    if (!helper || !prefix || !commit_id) {
+        return -1;
+    }
+
+    VersionControl *vc = (VersionControl *) helper;
+
+    int64_t index = find_commit(vc, prefix);
+    if (index == ID_AMBIGUOUS) {
+        return -3;
+    } else if (index < 0) {
+        return -2;
+    }
+
+    *commit_id = (char *) get_commit_id(vc, (size_t) index);
+    return 0;
+}
+
+int svc_is_ancestor(void *helper, char *ancestor_id, char *commit_id) {
+    if (!helper || !ancestor_id || !commit_id) {
+        return -1;
+    }
+
+    VersionControl *vc = (VersionControl *) helper;
+
+    int64_t ancestor = find_commit(vc, ancestor_id);
+    int64_t commit = find_commit(vc, commit_id);
+    if (ancestor == ID_AMBIGUOUS || commit == ID_AMBIGUOUS) {
+        return -3;
+    } else if (ancestor < 0 || commit < 0) {
+        return -2;
+    }
+
+    return is_graph_ancestor(&vc->graph, (size_t) ancestor, (size_t) commit);
+}
+
+char *svc_merge_base(void *helper, char *commit_a, char *commit_b) {
+    if (!helper || !commit_a || !commit_b) {
+        return NULL;
+    }
+
+    VersionControl *vc = (VersionControl *) helper;
+
+    int64_t a = find_commit(vc, commit_a);
+    int64_t b = find_commit(vc, commit_b);
+    if (a < 0 || b < 0) {
+        return NULL;
     }
 
-    return NULL;
+    int64_t base = find_graph_merge_base(&vc->graph, (size_t) a, (size_t) b);
+    return base < 0 ? NULL : (char *) get_commit_id(vc, (size_t) base);
 }
 
 char **get_prev_commits(void *helper, void *commit, int *n_prev) {
@@ -218,6 +867,7 @@ char **get_prev_commits(void *helper, void *commit, int *n_prev) {
         return NULL;
     }
 
+    VersionControl *vc = (VersionControl *) helper;
     Commit *c = (Commit *) commit;
 
     *n_prev = c->n_parent_commits;
@@ -229,26 +879,97 @@ char **get_prev_commits(void *helper, void *commit, int *n_prev) {
     char **adjacent_commit_ids = safe_malloc(c->n_parent_commits *
                                               sizeof(char *));
     for (size_t i = 0; i < c->n_parent_commits; ++i) {
-        adjacent_commit_ids[i] = c->parent_commits[i]->id;
+        adjacent_commit_ids[i] = (char *) get_commit_id(vc,
+                                                        c->parent_commits[i]);
     }
 
     return adjacent_commit_ids;
 }
 
-void print_commit(void *helper, char *commit_id) {
-    if (!helper) {
-        return;
+int svc_log_init(void *helper, LogIter *it, char *commit_id,
+                 enum LogOrder order, int first_parent, size_t skip,
+                 size_t limit) {
+    if (!helper || !it) {
+        return -1;
     }
 
-    if (!commit_id) {
-        printf("Invalid commit id\n");
-        return;
+    VersionControl *vc = (VersionControl *) helper;
+
+    it->helper = helper;
+    it->walk = (GraphWalk) {&vc->graph, WalkCreation, first_parent, NULL, 0,
+                            {NULL, 0, 0}};
+    it->skip = skip;
+    it->limit = limit ? limit : SIZE_MAX;
+
+    int64_t index = -1;
+    if (commit_id) {
+        index = find_commit(vc, commit_id);
+        if (index == ID_AMBIGUOUS) {
+            return -3;
+        } else if (index < 0) {
+            return -2;
+        }
+    } else if (vc->branches[vc->current_branch].commit) {
+        index = (int64_t) vc->branches[vc->current_branch].commit->index;
+    }
+
+    // no commits yet, nothing to walk
+    if (index < 0) {
+        return 0;
+    }
+    enum WalkOrder walk_order = order == LogTopo ? WalkGeneration :
+                                                   WalkCreation;
+    return init_graph_walk(&it->walk, &vc->graph, (size_t) index, walk_order,
+                           first_parent) == -1 ? -2 : 0;
+}
+
+void *svc_log_next(LogIter *it) {
+    if (!it || !it->walk.seen || !it->limit) {
+        return NULL;
+    }
+
+    // skipped commits are never read
+    int64_t index = next_graph_commit(&it->walk);
+    for (; index >= 0 && it->skip; it->skip--) {
+        index = next_graph_commit(&it->walk);
+    }
+    if (index < 0) {
+        return NULL;
+    }
+
+    it->limit--;
+    return load_commit((VersionControl *) it->helper, (size_t) index);
+}
+
+void svc_log_free(LogIter *it) {
+    if (!it) {
+        return;
+    }
+
+    free_graph_walk(&it->walk);
+    return;
+}
+
+void print_commit(void *helper, char *commit_id) {
+    if (!helper) {
+        return;
+    }
+
+    if (!commit_id) {
+        printf("Invalid commit id\n");
+        return;
     }
 
     VersionControl *vc = (VersionControl *) helper;
 
-    // find commit by id
-    Commit *selected_commit = get_commit(vc, commit_id);
+    // find commit by id or unique prefix
+    int64_t index = find_commit(vc, commit_id);
+    if (index == ID_AMBIGUOUS) {
+        printf("Ambiguous commit id\n");
+        return;
+    }
+    Commit *selected_commit = index < 0 ? NULL :
+                              load_commit(vc, (size_t) index);
 
     // NULL, no commit found
     if (!selected_commit) {
@@ -261,7 +982,7 @@ void print_commit(void *helper, char *commit_id) {
             sizeof(CommitRecord), compare_commit_record_change);
 
     // print commit info
-    printf("%s [%s]: %s\n", commit_id,
+    printf("%s [%s]: %s\n", selected_commit->id,
             vc->branches[selected_commit->branch_id].name,
             selected_commit->message);
 
@@ -277,7 +998,7 @@ void print_commit(void *helper, char *commit_id) {
                        selected_commit->commit_record[i].file_name);
                 break;
             case Change:
-                printf("    / %s [%10d -> %10d]\n",
+                printf("    / %s [%016" PRIx64 " -> %016" PRIx64 "]\n",
                        selected_commit->commit_record[i].file_name,
                        selected_commit->commit_record[i].hash_change.old_hash,
                        selected_commit->commit_record[i].hash_change.new_hash);
@@ -289,9 +1010,11 @@ void print_commit(void *helper, char *commit_id) {
     // print tracked files and data
     Snapshot *ss = &selected_commit->snapshot;
     printf("    Tracked files (%zu):\n", ss->n_files);
-    for (size_t i = 0; i < ss->n_files; ++i) {
-        printf("    [%10d] %s\n", ss->file_snapshots[i].hash,
-                ss->file_snapshots[i].name);
+    SnapshotIter it;
+    init_snapshot_iter(&it, ss);
+    FileSnapshot *fs = NULL;
+    while ((fs = next_file_snapshot(&it))) {
+        printf("    [%016" PRIx64 "] %s\n", fs->hash, fs->name);
     }
 
     return;
@@ -325,14 +1048,21 @@ static int check_uncommitted_changes(VersionControl *vc) {
 
     // check for changes
     for (size_t i = 0; i < vc->branches[vc->current_branch].n_files; ++i) {
-        if (vc->branches[vc->current_branch].files[i].state == Staged) {
+        FileData *fd = &vc->branches[vc->current_branch].files[i];
+        if (fd->state == Staged) {
             return 1;
-        } else if (vc->branches[vc->current_branch].files[i].state == Tracked) {
+        } else if (fd->state == Tracked && !is_file_unchanged(fd)) {
             // compare current file hash with last known hash
-            if (hash_file(vc, vc->branches[vc->current_branch].files[i].file_path)
-                != vc->branches[vc->current_branch].files[i].previous_hash) {
+            Hash hash = 0;
+            FileStat st;
+            if (hash_and_copy_file(fd->file_path, NULL, NULL, &hash,
+                                   &st) == -1 || hash != fd->previous_hash) {
                 return 1;
             }
+            // contents unchanged, refresh stat so next check skips the hash,
+            // a cache valid for every branch sharing the files
+            fd->stat = st;
+            vc->branches[vc->current_branch].table->saved = 0;
         }
     }
 
@@ -361,33 +1091,84 @@ int svc_branch(void *helper, char *branch_name) {
         vc->len_branches++;
     }
 
-    // copy previous branch
-    vc->branches[vc->n_branches] = vc->branches[vc->current_branch];
-    vc->branches[vc->n_branches].name = copy_string(branch_name);
-    vc->branches[vc->n_branches].files =
-            copy_file_data(vc->branches[vc->current_branch].files,
-                           vc->branches[vc->current_branch].n_files,
-                           vc->branches[vc->current_branch].files_len);
+    // share files of previous branch, copied once either branch changes them
+    vc->branches[vc->n_branches] =
+            fork_branch(&vc->branches[vc->current_branch], branch_name);
     vc->n_branches++;
+    save_vc_branches(vc);
 
     return 0;
 }
 
-static void restore_snapshot(VersionControl *vc, Snapshot *ss) {
-    if (!vc || !ss) {
+static void restore_snapshot(VersionControl *vc, Commit *from, Commit *to,
+                             int verify) {
+    if (!vc || !to) {
+        return;
+    }
+
+    // differing files only, unchanged directories are not read
+    if (!verify && to->tree && (!from || from->tree) &&
+        diff_trees(from ? from->tree : 0, to->tree, restore_tree_file,
+                   NULL) == 0) {
+        clear_object_cache();
         return;
     }
 
-    // update tracked file contents to snapshot content
-    for (size_t i = 0; i < ss->n_files; ++i) {
-        char snapshot_f_name[HASH_HEX_SIZE];
-        sprintf(snapshot_f_name, SVC_FILE_PATH_FMT, ss->file_snapshots[i].hash);
-        update_file(ss->file_snapshots[i].name, snapshot_f_name);
+    // current branch files, for checking skipped working copies
+    Branch *cur_branch = &vc->branches[vc->current_branch];
+    size_t n_pairs = 0;
+    SnapshotPair *pairs = pair_snapshots(from ? &from->snapshot : NULL,
+                                         &to->snapshot, &n_pairs);
+    for (size_t i = 0; i < n_pairs; ++i) {
+        if (!pairs[i].to) {
+            // no longer tracked
+            remove(pairs[i].from->name);
+            continue;
+        }
+
+        if (pairs[i].from && pairs[i].from->hash == pairs[i].to->hash &&
+            (!verify || is_working_copy_current(cur_branch, pairs[i].to))) {
+            continue;
+        }
+
+        // update tracked file contents to snapshot content
+        restore_object(pairs[i].to->hash, pairs[i].to->name);
+    }
+
+    // release delta bases reconstructed for this restore
+    clear_object_cache();
+    free(pairs);
+    return;
+}
+
+static void restore_tree_file(void *ctx, char *path, const Hash *from,
+                              const Hash *to) {
+    if (!to) {
+        // no longer tracked
+        remove(path);
+        return;
     }
 
+    restore_object(*to, path);
     return;
 }
 
+static int is_working_copy_current(Branch *b, FileSnapshot *fs) {
+    int64_t i = find_branch_file(b, fs->name);
+    if (i < 0 || b->files[i].state != Tracked ||
+        b->files[i].previous_hash != fs->hash) {
+        return 0;
+    }
+
+    if (is_file_unchanged(&b->files[i])) {
+        return 1;
+    }
+
+    Hash hash = 0;
+    return hash_and_copy_file(fs->name, NULL, NULL, &hash, NULL) == 0 &&
+           hash == fs->hash;
+}
+
 int svc_checkout(void *helper, char *branch_name) {
     if (!helper || !branch_name) {
         return -1;
@@ -403,14 +1184,20 @@ int svc_checkout(void *helper, char *branch_name) {
     if (check_uncommitted_changes(vc)) {
         return -2;
     }
+
+    // files checked out, match their last commit as nothing is uncommitted
+    Commit *prev_commit = vc->branches[vc->current_branch].commit;
+
     // switch to current branch
     vc->current_branch = branch_index;
 
     // last snapshot taken on the new branch is coppied
     if (vc->branches[vc->current_branch].commit) {
-        // restore files to last commit on new branch
-        restore_snapshot(vc, &vc->branches[vc->current_branch].commit->snapshot);
+        // restore files that differ from last commit on previous branch
+        restore_snapshot(vc, prev_commit,
+                         vc->branches[vc->current_branch].commit, 0);
     }
+    save_vc_branches(vc);
 
     return 0;
 }
@@ -433,7 +1220,7 @@ char **list_branches(void *helper, int *n_branches) {
     return branch_names;
 }
 
-int svc_add(void *helper, char *file_name) {
+int64_t svc_add(void *helper, char *file_name) {
     if (!file_name || !helper) {
         return -1;
     }
@@ -446,35 +1233,139 @@ int svc_add(void *helper, char *file_name) {
     Branch *cur_branch = &vc->branches[vc->current_branch];
 
     // branch name is unknown
-    if (!is_unknown(cur_branch->files, cur_branch->n_files, file_name)) {
+    if (!is_unknown_file(cur_branch, file_name)) {
         return -2;
     }
 
-    // cpy file name
-    char *file_name_cpy = copy_string(file_name);
-
     // calc hash of file
-    int hash = hash_file(NULL, file_name);
+    Hash hash = 0;
+    FileStat st;
+    if (hash_and_copy_file(file_name, NULL, NULL, &hash, &st) == -1) {
+        return -3;
+    }
+
+    // stage file, with copy of file name
+    FileData fd = {
+            .file_path = intern_path(file_name),
+            .state = Staged,
+            .previous_hash = hash,
+            .stat = st,
+    };
+    add_branch_file(cur_branch, fd);
+
+    return (int64_t) hash;
+}
+
+int svc_add_many(void *helper, char **file_names, size_t n_files,
+                 AddReport *report) {
+    if (!helper || !file_names || !report) {
+        return -1;
+    }
+
+    VersionControl *vc = (VersionControl *) helper;
+    Branch *cur_branch = &vc->branches[vc->current_branch];
+    report->n_added = 0;
+    report->n_known = 0;
+    report->n_missing = 0;
+    report->n_ignored = 0;
+
+    // known files are not hashed
+    AddTask *tasks = safe_malloc((n_files + 1) * sizeof(AddTask));
+    size_t n_tasks = 0;
+    for (size_t i = 0; i < n_files; ++i) {
+        if (!file_names[i]) {
+            report->n_missing++;
+        } else if (!is_unknown_file(cur_branch, file_names[i])) {
+            report->n_known++;
+        } else {
+            tasks[n_tasks++].file_path = file_names[i];
+        }
+    }
+    parallel_for(n_tasks, vc->n_threads, hash_add_task, tasks);
+
+    // stage in order given, earlier copies of a path make later ones known
+    for (size_t i = 0; i < n_tasks; ++i) {
+        if (tasks[i].status == -1) {
+            report->n_missing++;
+        } else if (!is_unknown_file(cur_branch, tasks[i].file_path)) {
+            report->n_known++;
+        } else {
+            FileData fd = {
+                    .file_path = intern_path(tasks[i].file_path),
+                    .state = Staged,
+                    .previous_hash = tasks[i].hash,
+                    .stat = tasks[i].stat,
+            };
+            add_branch_file(cur_branch, fd);
+            report->n_added++;
+        }
+    }
+    free(tasks);
+
+    return 0;
+}
+
+int svc_add_tree(void *helper, char *dir_path, AddReport *report) {
+    if (!helper || !dir_path || !report) {
+        return -1;
+    }
+
+    IgnoreList ignore;
+    init_ignore_list(&ignore);
+    if (load_ignore_file(&ignore, SVC_IGNORE_PATH) == -1) {
+        free_ignore_list(&ignore);
+        return -2;
+    }
+
+    // collect paths first, so staging order does not depend on the walk
+    PathList list = {safe_malloc(INIT_STAGING_SIZE * sizeof(char *)), 0,
+                     INIT_STAGING_SIZE};
+    size_t n_ignored = 0;
+    size_t n_failed = 0;
+    int ret = walk_tree(dir_path, &ignore, collect_path, &list, &n_ignored,
+                        &n_failed);
+    free_ignore_list(&ignore);
+    if (ret == 0) {
+        qsort(list.paths, list.n_paths, sizeof(char *), compare_path);
+        svc_add_many(helper, list.paths, list.n_paths, report);
+        report->n_ignored = n_ignored;
+        report->n_missing += n_failed;
+    }
 
-    // add space if required
-    if (cur_branch->n_files == cur_branch->files_len) {
-        cur_branch->files = (FileData *) safe_realloc(cur_branch->files,
-                                                      cur_branch->files_len *
-                                                      ARRAY_GROWTH_RATE *
-                                                      sizeof(FileData));
-        cur_branch->files_len *= ARRAY_GROWTH_RATE;
+    for (size_t i = 0; i < list.n_paths; ++i) {
+        free(list.paths[i]);
     }
+    free(list.paths);
 
-    // stage file
-    cur_branch->files[cur_branch->n_files].state = Staged;
-    cur_branch->files[cur_branch->n_files].file_path = file_name_cpy;
-    cur_branch->files[cur_branch->n_files].previous_hash = hash;
-    cur_branch->n_files++;
+    return ret == 0 ? 0 : -3;
+}
+
+static void hash_add_task(void *ctx, size_t i) {
+    AddTask *task = &((AddTask *) ctx)[i];
+    task->hash = 0;
+    task->status = hash_and_copy_file(task->file_path, NULL, NULL,
+                                      &task->hash, &task->stat);
+    return;
+}
+
+static void collect_path(void *ctx, const char *file_path) {
+    PathList *list = (PathList *) ctx;
+
+    // resize if necessary
+    if (list->n_paths == list->len_paths) {
+        list->len_paths *= ARRAY_GROWTH_RATE;
+        list->paths = safe_realloc(list->paths,
+                                   list->len_paths * sizeof(char *));
+    }
+    list->paths[list->n_paths++] = copy_string((char *) file_path);
+    return;
+}
 
-    return hash;
+static int compare_path(const void *a, const void *b) {
+    return strcmp(*(char **) a, *(char **) b);
 }
 
-int svc_rm(void *helper, char *file_name) {
+int64_t svc_rm(void *helper, char *file_name) {
     if (!helper || !file_name) {
         return -1;
     }
@@ -482,27 +1373,23 @@ int svc_rm(void *helper, char *file_name) {
     VersionControl *vc = (VersionControl *) helper;
     Branch *curr_branch = &vc->branches[vc->current_branch];
 
-    // remove from vc
-    for (size_t i = 0; i < curr_branch->n_files; ++i) {
-        if (!strcmp(curr_branch->files[i].file_path, file_name) &&
-            curr_branch->files[i].state == Staged) {
-            // removed staged file
-            free(curr_branch->files[i].file_path);
-            int prev_hash = curr_branch->files[i].previous_hash;
-            memmove(curr_branch->files + i, curr_branch->files + (i + 1),
-                    (curr_branch->n_files - i - 1) * sizeof(FileData));
-            curr_branch->n_files--;
-            return prev_hash;
-        } else if (!strcmp(curr_branch->files[i].file_path, file_name) &&
-                    curr_branch->files[i].state != Deleted) {
-            // remove file if state isnt deleted
-            curr_branch->files[i].state = Deleted;
-            return curr_branch->files[i].previous_hash;
-        }
+    // no file exists in vc
+    int64_t i = find_branch_file(curr_branch, file_name);
+    if (i < 0 || curr_branch->files[i].state == Deleted) {
+        return -2;
     }
 
-    // no file exists in vc
-    return -2;
+    // remove from vc
+    Hash prev_hash = curr_branch->files[i].previous_hash;
+    if (curr_branch->files[i].state == Staged) {
+        // removed staged file
+        remove_branch_file(curr_branch, (size_t) i);
+    } else {
+        // remove file if state isnt deleted
+        own_branch_files(curr_branch);
+        curr_branch->files[i].state = Deleted;
+    }
+    return (int64_t) prev_hash;
 }
 
 int svc_reset(void *helper, char *commit_id) {
@@ -512,41 +1399,48 @@ int svc_reset(void *helper, char *commit_id) {
 
     VersionControl *vc = (VersionControl *) helper;
 
-    Commit *c = (Commit *) get_commit(vc, commit_id);
+    int64_t index = find_commit(vc, commit_id);
+    if (index == ID_AMBIGUOUS) {
+        return -3;
+    }
+    Commit *c = index < 0 ? NULL : load_commit(vc, (size_t) index);
     if (!c) {
         return -2;
     }
 
+    // restore files that differ from current commit, or were modified since
+    Commit *prev_commit = vc->branches[vc->current_branch].commit;
+    restore_snapshot(vc, prev_commit, c, 1);
+
     // reset branch to commit
     vc->branches[vc->current_branch].commit = c;
     c->branch_id = vc->current_branch;
-
-    // free prev files
-    for (size_t i = 0; i < vc->branches[vc->current_branch].n_files; ++i) {
-        free(vc->branches[vc->current_branch].files[i].file_path);
+    if (set_commit_branch(&vc->log, c->index, c->branch_id) == -1) {
+        perror("unable to write commit log");
+        exit(2);
     }
-    free(vc->branches[vc->current_branch].files);
 
-    // generate new file data from snapshot
+    // replace prev files, paths are interned
+    reset_branch_files(&vc->branches[vc->current_branch], c->snapshot.n_files);
     vc->branches[vc->current_branch].n_files = c->snapshot.n_files;
-    vc->branches[vc->current_branch].files_len = c->snapshot.n_files;
-    vc->branches[vc->current_branch].files =
-            safe_malloc(vc->branches[vc->current_branch].files_len *
-                         sizeof(FileData));
 
-    // track restored files
-    for (size_t i = 0; i < vc->branches[vc->current_branch].n_files; ++i) {
-        // copy file name
-        vc->branches[vc->current_branch].files[i].file_path =
-                copy_string(c->snapshot.file_snapshots[i].name);
+    // track restored files, in path order
+    SnapshotIter it;
+    init_snapshot_iter(&it, &c->snapshot);
+    FileSnapshot *fs = NULL;
+    for (size_t i = 0; (fs = next_file_snapshot(&it)); ++i) {
+        // share interned file name
+        vc->branches[vc->current_branch].files[i].file_path = fs->name;
         // set all files to tracked
         vc->branches[vc->current_branch].files[i].state = Tracked;
-        vc->branches[vc->current_branch].files[i].previous_hash =
-                c->snapshot.file_snapshots[i].hash;
+        vc->branches[vc->current_branch].files[i].previous_hash = fs->hash;
+        // stat is taken on next hash
+        memset(&vc->branches[vc->current_branch].files[i].stat, 0,
+               sizeof(FileStat));
     }
+    index_branch_files(&vc->branches[vc->current_branch]);
+    save_vc_branches(vc);
 
-    // restore snapshot
-    restore_snapshot(vc, &c->snapshot);
     return 0;
 }
 
@@ -581,25 +1475,10 @@ char *svc_merge(void *helper, char *branch_name, struct resolution *resolutions,
         return NULL;
     }
 
-    // last snapshot of the branch being merged
-    Snapshot *merge_snapshot = &vc->branches[branch_index].commit->snapshot;
-    for (size_t i = 0; i < merge_snapshot->n_files; ++i) {
-        // if unknown to vc, stage file
-        if (is_unknown(vc->branches[vc->current_branch].files,
-                       vc->branches[vc->current_branch].n_files,
-                       merge_snapshot->file_snapshots[i].name)) {
-            if (access(merge_snapshot->file_snapshots[i].name, F_OK) == -1) {
-                char snapshot_file_name[HASH_HEX_SIZE];
-                // format file path to svc directory
-                sprintf(snapshot_file_name, SVC_FILE_PATH_FMT,
-                        merge_snapshot->file_snapshots[i].hash);
-                // update file to old contents from snapshot
-                update_file(merge_snapshot->file_snapshots[i].name,
-                            snapshot_file_name);
-            }
-            svc_add(vc, merge_snapshot->file_snapshots[i].name);
-        }
-    }
+    // files changed by the branch being merged, conflicts keep ours
+    MergeState m = {vc, vc->branches[vc->current_branch].commit, 1, NULL, 0, 0};
+    merge_commits(&m, vc->branches[branch_index].commit);
+    free_merge_conflicts(m.conflicts, m.n_conflicts);
 
     // resolve conflicts
     for (size_t i = 0; i < n_resolutions; ++i) {
@@ -614,21 +1493,9 @@ char *svc_merge(void *helper, char *branch_name, struct resolution *resolutions,
     // print merge msg to stdout
     char *commit_msg = safe_malloc(MAX_BRANCH_NAME_LEN * sizeof(char));
     sprintf(commit_msg, "Merged branch %s", branch_name);
-    char *commit_id = svc_commit(vc, commit_msg);
-
-    // add as parent commit if non-null
-    if (commit_id) {
-        // child commit
-        Commit *c = vc->commits[vc->n_commits - 1];
-        // allocate memory for second parent
-        c->parent_commits =
-                safe_realloc(vc->commits[vc->n_commits - 1]->parent_commits,
-                             (vc->commits[vc->n_commits - 1]->n_parent_commits + 1) *
-                             sizeof(Commit *));
-        // add branch commit as parent of child
-        c->parent_commits[c->n_parent_commits] = vc->branches[branch_index].commit;
-        vc->commits[vc->n_commits - 1]->n_parent_commits++;
-    }
+    // branch commit is second parent of child
+    char *commit_id = commit_branch(vc, commit_msg,
+                                    vc->branches[branch_index].commit);
 
     free(commit_msg);
 
@@ -636,3 +1503,652 @@ char *svc_merge(void *helper, char *branch_name, struct resolution *resolutions,
 
     return commit_id;
 }
+
+MergeConflict *svc_merge_conflicts(void *helper, char *branch_name,
+                                   size_t *n_conflicts) {
+    if (!helper || !branch_name || !n_conflicts) {
+        return NULL;
+    }
+    *n_conflicts = 0;
+
+    VersionControl *vc = (VersionControl *) helper;
+    int branch_index = get_branch_index(vc, branch_name);
+    if (branch_index < 0 || (size_t) branch_index == vc->current_branch) {
+        return NULL;
+    }
+
+    // nothing is written or staged
+    MergeState m = {vc, vc->branches[vc->current_branch].commit, 0, NULL, 0, 0};
+    merge_commits(&m, vc->branches[branch_index].commit);
+    *n_conflicts = m.n_conflicts;
+    return m.conflicts;
+}
+
+void free_merge_conflicts(MergeConflict *conflicts, size_t n_conflicts) {
+    if (!conflicts) {
+        return;
+    }
+
+    for (size_t i = 0; i < n_conflicts; ++i) {
+        free(conflicts[i].file_name);
+        free(conflicts[i].hunks);
+    }
+    free(conflicts);
+    return;
+}
+
+static void merge_commits(MergeState *m, Commit *theirs) {
+    if (!theirs) {
+        return;
+    }
+
+    // last common ancestor, none if histories are unrelated
+    Commit *base = NULL;
+    if (m->ours) {
+        int64_t index = find_graph_merge_base(&m->vc->graph, m->ours->index,
+                                              theirs->index);
+        base = index < 0 ? NULL : load_commit(m->vc, (size_t) index);
+    }
+
+    // files changed by theirs since base
+    diff_commits(base, theirs, merge_file, m);
+
+    // release delta bases reconstructed for this merge
+    clear_object_cache();
+    return;
+}
+
+static void merge_file(void *ctx, char *path, const Hash *base,
+                       const Hash *theirs) {
+    MergeState *m = (MergeState *) ctx;
+    FileSnapshot *fs = m->ours ? find_file_snapshot(&m->ours->snapshot, path) :
+                       NULL;
+    const Hash *ours = fs ? &fs->hash : NULL;
+
+    // same change on both branches
+    if (same_hash(ours, theirs)) {
+        return;
+    }
+
+    // unchanged on current branch, change of merged branch is taken
+    if (same_hash(ours, base)) {
+        if (m->apply) {
+            take_merged_file(m->vc, path, theirs);
+        }
+        return;
+    }
+
+    // changed by both, lines merged unless either deleted the file
+    MergeHunk *hunks = NULL;
+    size_t n_hunks = 0;
+    if (ours && theirs) {
+        char *merged = NULL;
+        size_t merged_len = 0;
+        int ret = merge_contents(base, *ours, *theirs, &merged, &merged_len,
+                                 &hunks, &n_hunks);
+        if (ret == 0 && m->apply) {
+            int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            if (fd == -1 || write_all(fd, merged, merged_len, 0) == -1 ||
+                close(fd) == -1) {
+                perror("unable to write merged file");
+                exit(2);
+            }
+        }
+        free(merged);
+        if (ret == 0) {
+            return;
+        }
+    }
+
+    if (m->n_conflicts == m->len_conflicts) {
+        m->len_conflicts = m->len_conflicts ? m->len_conflicts *
+                                              ARRAY_GROWTH_RATE : 4;
+        m->conflicts = safe_realloc(m->conflicts, m->len_conflicts *
+                                                  sizeof(MergeConflict));
+    }
+    m->conflicts[m->n_conflicts++] = (MergeConflict) {
+            .file_name = copy_string(path),
+            .base_hash = base ? *base : 0,
+            .ours_hash = ours ? *ours : 0,
+            .theirs_hash = theirs ? *theirs : 0,
+            .hunks = hunks,
+            .n_hunks = n_hunks,
+    };
+    return;
+}
+
+static int merge_contents(const Hash *base, Hash ours, Hash theirs,
+                          char **merged, size_t *merged_len, MergeHunk **hunks,
+                          size_t *n_hunks) {
+    // a file added by both branches merges from an empty base
+    size_t len[3] = {0, 0, 0};
+    char *data[3] = {
+            base ? read_object(*base, &len[0]) : NULL,
+            read_object(ours, &len[1]),
+            read_object(theirs, &len[2]),
+    };
+
+    int ret = -1;
+    if ((!base || data[0]) && data[1] && data[2]) {
+        Text t[3];
+        Text *texts[3] = {&t[0], &t[1], &t[2]};
+        for (size_t i = 0; i < 3; ++i) {
+            init_text(&t[i], data[i], len[i]);
+        }
+        number_lines(texts, 3);
+        ret = merge_texts(&t[0], &t[1], &t[2], merged, merged_len, hunks,
+                          n_hunks);
+        for (size_t i = 0; i < 3; ++i) {
+            free_text(&t[i]);
+        }
+    }
+
+    for (size_t i = 0; i < 3; ++i) {
+        free(data[i]);
+    }
+    return ret;
+}
+
+static void take_merged_file(VersionControl *vc, char *path,
+                             const Hash *theirs) {
+    if (!theirs) {
+        // deleted by merged branch
+        svc_rm(vc, path);
+        remove(path);
+        return;
+    }
+
+    // if unknown to vc, stage file, keeping any untracked working copy
+    if (is_unknown_file(&vc->branches[vc->current_branch], path)) {
+        if (access(path, F_OK) == -1) {
+            restore_object(*theirs, path);
+        }
+        svc_add(vc, path);
+        return;
+    }
+
+    // tracked, new contents are committed with the merge
+    restore_object(*theirs, path);
+    return;
+}
+
+static int same_hash(const Hash *a, const Hash *b) {
+    return a && b ? *a == *b : a == b;
+}
+
+char *svc_diff(void *helper, char *commit_a, char *commit_b) {
+    if (!helper || !commit_b) {
+        return NULL;
+    }
+
+    VersionControl *vc = (VersionControl *) helper;
+
+    int64_t a = commit_a ? find_commit(vc, commit_a) : 0;
+    int64_t b = find_commit(vc, commit_b);
+    if (a < 0 || b < 0) {
+        return NULL;
+    }
+    Commit *from = commit_a ? load_commit(vc, (size_t) a) : NULL;
+    Commit *to = load_commit(vc, (size_t) b);
+    if ((commit_a && !from) || !to) {
+        return NULL;
+    }
+
+    TextBuffer out = {NULL, 0, 0};
+    diff_commits(from, to, diff_commit_file, &out);
+    clear_object_cache();
+    put_text(&out, "", 1);
+    return out.data;
+}
+
+char *svc_diff_worktree(void *helper, char *commit_id) {
+    if (!helper) {
+        return NULL;
+    }
+
+    VersionControl *vc = (VersionControl *) helper;
+    Branch *cur_branch = &vc->branches[vc->current_branch];
+
+    Commit *commit = cur_branch->commit;
+    if (commit_id) {
+        int64_t index = find_commit(vc, commit_id);
+        commit = index < 0 ? NULL : load_commit(vc, (size_t) index);
+        if (!commit) {
+            return NULL;
+        }
+    }
+
+    // files with working copies, in path order as the snapshot
+    FileData **files = safe_malloc((cur_branch->n_files + 1) *
+                                   sizeof(FileData *));
+    size_t n_files = 0;
+    for (size_t i = 0; i < cur_branch->n_files; ++i) {
+        if (cur_branch->files[i].state != Deleted) {
+            files[n_files++] = &cur_branch->files[i];
+        }
+    }
+    qsort(files, n_files, sizeof(FileData *), compare_file_path);
+
+    SnapshotIter it;
+    FileSnapshot *fs = NULL;
+    if (commit) {
+        init_snapshot_iter(&it, &commit->snapshot);
+        fs = next_file_snapshot(&it);
+    }
+    TextBuffer out = {NULL, 0, 0};
+    size_t i = 0;
+    while (fs || i < n_files) {
+        int cmp = !fs ? 1 : i == n_files ? -1 :
+                  strcmp(fs->name, files[i]->file_path);
+        FileSnapshot *old = cmp <= 0 ? fs : NULL;
+        FileData *fd = cmp >= 0 ? files[i++] : NULL;
+        char *path = old ? old->name : fd->file_path;
+        if (old) {
+            fs = next_file_snapshot(&it);
+        }
+
+        // tracked copies last hashed as the commit are not read
+        if (old && fd && fd->state == Tracked &&
+            fd->previous_hash == old->hash && is_file_unchanged(fd)) {
+            continue;
+        }
+
+        Blob a;
+        Blob b;
+        int has_a = old && map_object(old->hash, &a) == 0;
+        int has_b = fd && map_file(path, &b) == 0;
+        if ((has_a || has_b) && (has_a != has_b || a.len != b.len ||
+                                 memcmp(a.data, b.data, a.len) != 0)) {
+            put_file_diff(&out, path, has_a ? &a : NULL, has_b ? &b : NULL);
+        }
+        if (has_a) {
+            unmap_blob(&a);
+        }
+        if (has_b) {
+            unmap_blob(&b);
+        }
+    }
+
+    free(files);
+    clear_object_cache();
+    put_text(&out, "", 1);
+    return out.data;
+}
+
+BlameLine *svc_blame(void *helper, char *commit_id, char *file_path,
+                     size_t *n_lines) {
+    if (!helper || !file_path || !n_lines) {
+        return NULL;
+    }
+
+    VersionControl *vc = (VersionControl *) helper;
+
+    Commit *commit = vc->branches[vc->current_branch].commit;
+    if (commit_id) {
+        int64_t index = find_commit(vc, commit_id);
+        commit = index < 0 ? NULL : load_commit(vc, (size_t) index);
+    }
+    FileSnapshot *fs = commit ? find_file_snapshot(&commit->snapshot,
+                                                   file_path) : NULL;
+    if (!fs) {
+        return NULL;
+    }
+
+    // blamed before, or read and traced to itself
+    BlameState b = {vc, fs->name, NULL, NULL, 0, 0};
+    size_t n = 0;
+    LineOrigin *cached = get_blame_map(&vc->blame, commit->index, fs->name,
+                                       &n);
+    if (cached) {
+        b.origins = safe_malloc((n + 1) * sizeof(LineOrigin));
+        memcpy(b.origins, cached, n * sizeof(LineOrigin));
+    } else {
+        Blob blob;
+        Text text;
+        if (read_text(fs->hash, &blob, &text) == -1) {
+            return NULL;
+        }
+        n = text.n_lines;
+        b.origins = safe_malloc((n + 1) * sizeof(LineOrigin));
+        LineTrace *lines = safe_malloc((n + 1) * sizeof(LineTrace));
+        for (size_t i = 0; i < n; ++i) {
+            lines[i] = (LineTrace) {i, i};
+        }
+        add_suspect(&b, commit->index, lines, n, &blob, &text);
+        free(lines);
+
+        // children before parents, parents have lower indices
+        while (b.n_suspects) {
+            Suspect s = b.suspects[0];
+            b.suspects[0] = b.suspects[--b.n_suspects];
+            for (size_t i = 0; 2 * i + 1 < b.n_suspects; ) {
+                size_t c = 2 * i + 1;
+                if (c + 1 < b.n_suspects &&
+                    b.suspects[c + 1].commit > b.suspects[c].commit) {
+                    c++;
+                }
+                if (b.suspects[c].commit <= b.suspects[i].commit) {
+                    break;
+                }
+                Suspect tmp = b.suspects[i];
+                b.suspects[i] = b.suspects[c];
+                b.suspects[c] = tmp;
+                i = c;
+            }
+            blame_suspect(&b, &s);
+            free_suspect(&s);
+        }
+        free(b.suspects);
+        clear_object_cache();
+        put_blame_map(&vc->blame, commit->index, fs->name, b.origins, n);
+    }
+
+    BlameLine *blame = safe_malloc((n + 1) * sizeof(BlameLine));
+    for (size_t i = 0; i < n; ++i) {
+        blame[i].commit_id = (char *) get_commit_id(vc, b.origins[i].commit);
+        blame[i].line = b.origins[i].line;
+    }
+    free(b.origins);
+    *n_lines = n;
+    return blame;
+}
+
+static void add_suspect(BlameState *b, size_t commit, LineTrace *lines,
+                        size_t n_lines, Blob *blob, Text *text) {
+    // few commits are suspected at once
+    size_t i = 0;
+    while (i < b->n_suspects && b->suspects[i].commit != commit) {
+        i++;
+    }
+    if (i == b->n_suspects) {
+        if (b->n_suspects == b->len_suspects) {
+            b->len_suspects = b->len_suspects ? b->len_suspects *
+                                                ARRAY_GROWTH_RATE : 4;
+            b->suspects = safe_realloc(b->suspects, b->len_suspects *
+                                                    sizeof(Suspect));
+        }
+        b->suspects[b->n_suspects++] = (Suspect) {
+                .commit = commit,
+                .sorted = 1,
+        };
+
+        // sift up, parents of the heap have higher indices
+        while (i && b->suspects[(i - 1) / 2].commit < commit) {
+            Suspect tmp = b->suspects[i];
+            b->suspects[i] = b->suspects[(i - 1) / 2];
+            b->suspects[(i - 1) / 2] = tmp;
+            i = (i - 1) / 2;
+        }
+    }
+    Suspect *s = &b->suspects[i];
+
+    // lines of each child arrive sorted, those of several may interleave
+    if (s->n_lines + n_lines > s->len_lines) {
+        s->len_lines = s->n_lines + n_lines;
+        s->lines = safe_realloc(s->lines, (s->len_lines + 1) *
+                                          sizeof(LineTrace));
+    }
+    if (s->n_lines && n_lines &&
+        lines[0].line < s->lines[s->n_lines - 1].line) {
+        s->sorted = 0;
+    }
+    memcpy(s->lines + s->n_lines, lines, n_lines * sizeof(LineTrace));
+    s->n_lines += n_lines;
+
+    if (blob && !s->has_text) {
+        s->blob = *blob;
+        s->text = *text;
+        s->has_text = 1;
+    } else if (blob) {
+        free_text(text);
+        unmap_blob(blob);
+    }
+    return;
+}
+
+static void blame_suspect(BlameState *b, Suspect *s) {
+    VersionControl *vc = b->vc;
+
+    // lines reaching a commit blamed before are resolved by its map
+    size_t n_cached = 0;
+    LineOrigin *cached = get_blame_map(&vc->blame, s->commit, b->path,
+                                       &n_cached);
+    if (cached) {
+        for (size_t i = 0; i < s->n_lines; ++i) {
+            LineTrace *t = &s->lines[i];
+            b->origins[t->target] = t->line < n_cached ? cached[t->line] :
+                                    (LineOrigin) {s->commit, t->line};
+        }
+        return;
+    }
+
+    // lines passed on stay sorted, as each child passes them
+    if (!s->sorted) {
+        sort_line_traces(s->lines, s->n_lines);
+        s->sorted = 1;
+    }
+
+    // file left unchanged from the first parent, passed on unread
+    Commit *c = load_commit(vc, s->commit);
+    size_t n_parents = c ? c->n_parent_commits : 0;
+    int recorded = 0;
+    for (size_t i = 0; c && i < c->n_record && !recorded; ++i) {
+        recorded = !strcmp(c->commit_record[i].file_name, b->path);
+    }
+    if (n_parents && !recorded) {
+        add_suspect(b, c->parent_commits[0], s->lines, s->n_lines,
+                    s->has_text ? &s->blob : NULL, &s->text);
+        s->has_text = 0;
+        return;
+    }
+
+    // same file in a parent, as when a merge takes one side
+    FileSnapshot *fs = c ? find_file_snapshot(&c->snapshot, b->path) : NULL;
+    Commit **parents = safe_malloc((n_parents + 1) * sizeof(Commit *));
+    FileSnapshot **files = safe_malloc((n_parents + 1) *
+                                       sizeof(FileSnapshot *));
+    for (size_t i = 0; i < n_parents; ++i) {
+        parents[i] = load_commit(vc, c->parent_commits[i]);
+        files[i] = parents[i] ? find_file_snapshot(&parents[i]->snapshot,
+                                                   b->path) : NULL;
+        if (fs && files[i] && files[i]->hash == fs->hash) {
+            add_suspect(b, c->parent_commits[i], s->lines, s->n_lines,
+                        s->has_text ? &s->blob : NULL, &s->text);
+            s->has_text = 0;
+            s->n_lines = 0;
+            break;
+        }
+    }
+
+    // lines found in a parent are passed to the first holding them
+    if (s->n_lines && fs && (s->has_text ||
+                             read_text(fs->hash, &s->blob, &s->text) == 0)) {
+        s->has_text = 1;
+        size_t *from = safe_malloc((s->n_lines + 1) * sizeof(size_t));
+        for (size_t i = 0; i < n_parents && s->n_lines; ++i) {
+            Blob blob;
+            Text text;
+            if (!files[i] || read_text(files[i]->hash, &blob, &text) == -1) {
+                continue;
+            }
+            Text *texts[2] = {&text, &s->text};
+            number_lines(texts, 2);
+            size_t n_chunks = 0;
+            DiffChunk *chunks = diff_texts(&text, &s->text, &n_chunks);
+            trace_lines(chunks, n_chunks, s->lines, s->n_lines, from);
+            free(chunks);
+
+            // passed lines traced to the parent file, others kept in order
+            size_t n_passed = 0;
+            size_t n_kept = 0;
+            LineTrace *passed = safe_malloc((s->n_lines + 1) *
+                                            sizeof(LineTrace));
+            for (size_t j = 0; j < s->n_lines; ++j) {
+                if (from[j] == LINE_CHANGED) {
+                    s->lines[n_kept++] = s->lines[j];
+                } else {
+                    passed[n_passed++] = (LineTrace) {s->lines[j].target,
+                                                      from[j]};
+                }
+            }
+            s->n_lines = n_kept;
+            if (n_passed) {
+                add_suspect(b, c->parent_commits[i], passed, n_passed, &blob,
+                            &text);
+            } else {
+                free_text(&text);
+                unmap_blob(&blob);
+            }
+            free(passed);
+        }
+        free(from);
+    }
+    free(parents);
+    free(files);
+
+    // lines in no parent were last changed here
+    for (size_t i = 0; i < s->n_lines; ++i) {
+        b->origins[s->lines[i].target] = (LineOrigin) {s->commit,
+                                                      s->lines[i].line};
+    }
+    return;
+}
+
+static int read_text(Hash hash, Blob *blob, Text *text) {
+    if (map_object(hash, blob) == -1) {
+        return -1;
+    }
+    init_text(text, blob->data, blob->len);
+    return 0;
+}
+
+static void free_suspect(Suspect *s) {
+    if (s->has_text) {
+        free_text(&s->text);
+        unmap_blob(&s->blob);
+    }
+    free(s->lines);
+    return;
+}
+
+static void diff_commits(Commit *from, Commit *to, tree_diff_fn fn,
+                         void *ctx) {
+    // unchanged directories are not read
+    if (to->tree && (!from || from->tree) &&
+        diff_trees(from ? from->tree : 0, to->tree, fn, ctx) == 0) {
+        return;
+    }
+
+    size_t n_pairs = 0;
+    SnapshotPair *pairs = pair_snapshots(from ? &from->snapshot : NULL,
+                                         &to->snapshot, &n_pairs);
+    for (size_t i = 0; i < n_pairs; ++i) {
+        FileSnapshot *a = pairs[i].from;
+        FileSnapshot *b = pairs[i].to;
+        if (!a || !b || a->hash != b->hash) {
+            fn(ctx, b ? b->name : a->name, a ? &a->hash : NULL,
+               b ? &b->hash : NULL);
+        }
+    }
+    free(pairs);
+    return;
+}
+
+static void put_file_diff(TextBuffer *out, char *path, Blob *a, Blob *b) {
+    size_t len = strlen(path);
+    put_text(out, "diff --svc a/", 13);
+    put_text(out, path, len);
+    put_text(out, " b/", 3);
+    put_text(out, path, len);
+    put_text(out, "\n", 1);
+
+    // contents with a null byte near the start are not split into lines
+    int binary = 0;
+    for (size_t i = 0; i < 2 && !binary; ++i) {
+        Blob *blob = i ? b : a;
+        size_t n = blob && blob->len < DIFF_BINARY_CHECK ? blob->len :
+                   DIFF_BINARY_CHECK;
+        binary = blob && memchr(blob->data, '\0', n) != NULL;
+    }
+    if (binary) {
+        put_text(out, "Binary files ", 13);
+        put_text(out, a ? "a/" : "/dev/null", a ? 2 : 9);
+        put_text(out, path, a ? len : 0);
+        put_text(out, " and ", 5);
+        put_text(out, b ? "b/" : "/dev/null", b ? 2 : 9);
+        put_text(out, path, b ? len : 0);
+        put_text(out, " differ\n", 8);
+        return;
+    }
+
+    put_text(out, "--- ", 4);
+    put_text(out, a ? "a/" : "/dev/null", a ? 2 : 9);
+    put_text(out, path, a ? len : 0);
+    put_text(out, "\n+++ ", 5);
+    put_text(out, b ? "b/" : "/dev/null", b ? 2 : 9);
+    put_text(out, path, b ? len : 0);
+    put_text(out, "\n", 1);
+
+    Text ta;
+    Text tb;
+    Text *texts[2] = {&ta, &tb};
+    init_text(&ta, a ? a->data : NULL, a ? a->len : 0);
+    init_text(&tb, b ? b->data : NULL, b ? b->len : 0);
+    number_lines(texts, 2);
+    size_t n_chunks = 0;
+    DiffChunk *chunks = diff_texts(&ta, &tb, &n_chunks);
+    put_unified_diff(out, &ta, &tb, chunks, n_chunks, DIFF_CONTEXT_LINES);
+    free(chunks);
+    free_text(&ta);
+    free_text(&tb);
+    return;
+}
+
+static void diff_commit_file(void *ctx, char *path, const Hash *from,
+                             const Hash *to) {
+    Blob a;
+    Blob b;
+    int has_a = from && map_object(*from, &a) == 0;
+    int has_b = to && map_object(*to, &b) == 0;
+    put_file_diff((TextBuffer *) ctx, path, has_a ? &a : NULL,
+                  has_b ? &b : NULL);
+    if (has_a) {
+        unmap_blob(&a);
+    }
+    if (has_b) {
+        unmap_blob(&b);
+    }
+    return;
+}
+
+static int compare_file_path(const void *a, const void *b) {
+    return strcmp((*(FileData *const *) a)->file_path,
+                  (*(FileData *const *) b)->file_path);
+}
+
+void svc_print_stats(void *helper) {
+    if (!helper) {
+        return;
+    }
+
+    // files restored by each copy backend
+    size_t copy_counts[N_COPY_BACKENDS];
+    get_copy_stats(copy_counts);
+    printf("Restore backends:\n");
+    for (size_t i = 0; i < N_COPY_BACKENDS; ++i) {
+        printf("    %s: %zu\n", copy_backend_name(i), copy_counts[i]);
+    }
+
+    // objects written by each codec, raw and on disk size
+    ObjectStats object_stats;
+    get_object_stats(&object_stats);
+    printf("Object codecs:\n");
+    for (size_t i = 0; i < N_CODECS; ++i) {
+        printf("    %s: %zu objects, %" PRIu64 " -> %" PRIu64 " bytes, "
+               "%zu restored\n", get_codec(i)->name, object_stats.n_objects[i],
+               object_stats.raw_bytes[i], object_stats.disk_bytes[i],
+               object_stats.n_restored[i]);
+    }
+
+    return;
+}
\ No newline at end of file
@@ -3,20 +3,60 @@
 
 #include "memory/memory.h"
 #include "snapshot/snapshot.h"
+#include "tree/tree.h"
+#include "diff/diff.h"
+#include "blame/blame.h"
 #include "commit/commit.h"
 #include "branch/branch.h"
+#include "thread_pool/thread_pool.h"
+#include "state/state.h"
+#include "graph/graph.h"
+#include "id_index/id_index.h"
+#include "ignore/ignore.h"
 #include "params.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdint.h>
+#include <inttypes.h>
 
 typedef struct resolution {
     char *file_name;       // file path of file with conflicts
     char *resolved_file;   // file path of resolved file contents
 } resolution;
 
+typedef struct BlameLine {
+    char *commit_id;  // id of commit that last changed the line, NOT owned
+    size_t line;      // line in the file of that commit, 0 based
+} BlameLine;
+
+enum LogOrder {LogDate = 0, LogTopo = 1};
+
+typedef struct LogIter {
+    void *helper;    // svc data structure walked
+    GraphWalk walk;  // ancestors of the first commit, children first
+    size_t skip;     // commits still to be skipped
+    size_t limit;    // commits still to be returned, SIZE_MAX if unlimited
+} LogIter;
+
+typedef struct MergeConflict {
+    char *file_name;   // file path of file with conflicts
+    Hash base_hash;    // hash in merge base, 0 if not in it
+    Hash ours_hash;    // hash on current branch, 0 if deleted
+    Hash theirs_hash;  // hash on merged branch, 0 if deleted
+    MergeHunk *hunks;  // conflicting line ranges, NULL if deleted on a side
+    size_t n_hunks;    // number of conflicting line ranges
+} MergeConflict;
+
+typedef struct AddReport {
+    size_t n_added;    // files staged
+    size_t n_known;    // files already staged or tracked
+    size_t n_missing;  // files that dont exist or cannot be read
+    size_t n_ignored;  // paths skipped by ignore patterns, tree only
+} AddReport;
+
 /** @brief Initialises svc helper struct.
  *
  *  Creates internal data structure required for following methods.
@@ -25,10 +65,35 @@ typedef struct resolution {
  */
 void *svc_init(void);
 
-/** @brief Releases all svc allocated memory.
+/** @brief Opens svc helper struct of an existing svc directory.
+ *
+ *  Restores the state left by the last process, from the svc directory made
+ *  by svc_init. Commits are appended to the svc directory as they are made,
+ *  and branches are saved on commit, branch, checkout, reset and svc_close.
+ *  Files staged or removed since are only kept if svc_close is called.
  *
+ *  Only the commit index is mapped, and the last commit of each branch read,
+ *  so opening does not depend on the number of commits. Other commits are read
+ *  when first used. If the svc directory is missing or corrupt, an error is
+ *  printed to stderr and NULL is returned.
+ *
+ *  @return pointer to the struct instance, NULL if unsuccessful.
+ */
+void *svc_open(void);
+
+/** @brief Releases all svc allocated memory, keeping the svc directory.
+ *
+ *  Branches are saved, so the svc directory can be opened again by svc_open.
  *  Only call at end of program.
  *
+ *  @param helper : address of svc data structure returned from init or open.
+ */
+void svc_close(void *helper);
+
+/** @brief Releases all svc allocated memory.
+ *
+ *  The svc directory is deleted. Only call at end of program.
+ *
  *  @param helper : address of svc data structure returned from init.
  */
 void cleanup(void *helper);
@@ -37,13 +102,14 @@ void cleanup(void *helper);
  *
  *  Hashes file at file path. If file path is NULL, -1 is returned. If no file
  *  exists at the current path, or access is not permitted, -2 is returned. On
- *  successful completion, the hash is returned.
+ *  successful completion, the hash is returned. Hashes are 63 bit content
+ *  hashes, and are never negative. The file path is not part of the hash.
  *
  *  @param helper : address of svc data structure returned from init.
  *  @param file_path : file path of file to be hashed.
  *  @return Hash if successful, error code if unsuccessful.
  */
-int hash_file(void *helper, char *file_path);
+int64_t hash_file(void *helper, char *file_path);
 
 /** @brief Commits.
  *
@@ -56,6 +122,35 @@ int hash_file(void *helper, char *file_path);
  */
 char *svc_commit(void *helper, char *message);
 
+/** @brief Sets number of threads used by commit.
+ *
+ *  Commit hashes and stores files on up to n_threads threads, and bulk adds
+ *  hash files on as many. Commit records, snapshots and staged files are
+ *  identical for any thread count. Defaults to
+ *  DEFAULT_COMMIT_THREADS (params.h). If helper is NULL or n_threads is 0,
+ *  nothing is done and -1 is returned.
+ *
+ *  @param helper : address of svc data structure returned from init.
+ *  @param n_threads : maximum number of threads, including calling thread.
+ *  @return 0 if successful, -1 otherwise.
+ */
+int svc_set_commit_threads(void *helper, size_t n_threads);
+
+/** @brief Sets minimum size of files stored in chunks.
+ *
+ *  Commit splits files of at least threshold bytes into content defined
+ *  chunks, storing each distinct chunk once, so a small change to a large
+ *  file only stores the chunks around it. Checkout rebuilds such files a
+ *  chunk at a time. A threshold of 0 disables chunking, the default set by
+ *  DEFAULT_CHUNK_THRESHOLD (params.h). If helper is NULL, nothing is done and
+ *  -1 is returned.
+ *
+ *  @param helper : address of svc data structure returned from init.
+ *  @param threshold : minimum file size in bytes, 0 to disable.
+ *  @return 0 if successful, -1 otherwise.
+ */
+int svc_set_chunk_threshold(void *helper, uint64_t threshold);
+
 /** @brief Retrieves commit address.
  *
  *  Returns internal address of commit, for use in other svc functions. If
@@ -63,12 +158,33 @@ char *svc_commit(void *helper, char *message);
  *  a valid address is returned. This address will be released during cleanup,
  *  do NOT free.
  *
+ *  Commit ids may be abbreviated to any unique prefix of at least
+ *  MIN_ID_PREFIX_LEN (params.h) characters, here and wherever a commit id is
+ *  taken. A full id always matches its own commit, even if it is a prefix of
+ *  another id. If a prefix matches several commit ids, NULL is returned, see
+ *  svc_resolve_commit. Lookups take constant time once the id index is built
+ *  by the first lookup.
+ *
  *  @param helper : address of svc data structure returned from init.
- *  @param commit_id : commit id (hex).
+ *  @param commit_id : commit id (hex), or unique prefix.
  *  @return Commit address.
  */
 void *get_commit(void *helper, char *commit_id);
 
+/** @brief Resolves abbreviated commit id.
+ *
+ *  If any argument is NULL, -1 is returned. If no commit id starts with
+ *  prefix, -2 is returned. If several distinct commit ids start with prefix,
+ *  -3 is returned. Otherwise, commit_id is set to the full commit id, and 0 is
+ *  returned. Commit id is released during cleanup, do NOT free.
+ *
+ *  @param helper : address of svc data structure returned from init.
+ *  @param prefix : commit id (hex), or prefix of commit id.
+ *  @param commit_id : address for commit id to be set.
+ *  @return 0 if successful, error code if unsuccessful.
+ */
+int svc_resolve_commit(void *helper, char *prefix, char **commit_id);
+
 /** @brief Retrieves commit ids of previous commits.
  *
  *  Returns address of array, containing all commit id's of previous commits.
@@ -76,7 +192,8 @@ void *get_commit(void *helper, char *commit_id);
  *  or it has no parent commits (first commit), n_prev is set to 0, and NULL is
  *  returned. Otherwise, n_prev is set to the allocated length of the returned
  *  array of commit id's. This array is NOT released during cleanup. Individual
- *  commit id's ARE released, however.
+ *  commit id's ARE released, however. To walk history, use svc_log_init
+ *  instead, which allocates once rather than per commit.
  *
  *  @param helper : address of svc data structure returned from init.
  *  @param commit : commit id (Hex).
@@ -85,11 +202,87 @@ void *get_commit(void *helper, char *commit_id);
  */
 char **get_prev_commits(void *helper, void *commit, int *n_prev);
 
+/** @brief Starts walk of the history of a commit.
+ *
+ *  Every commit reachable from commit_id through previous commits, merged
+ *  branches included, is returned once by svc_log_next, always before its
+ *  previous commits. Commits have no timestamps, so LogDate returns them in
+ *  order of creation, newest first. LogTopo returns them by decreasing
+ *  distance from the first commit, so commits of parallel branches are
+ *  interleaved by depth. If first_parent is set, only the first previous
+ *  commit of each commit is followed, skipping merged branches. The walk
+ *  allocates a bitmap of the commits reached once, plus a queue for LogTopo,
+ *  and nothing per commit. The iterator MUST be released with svc_log_free,
+ *  even if the walk is not finished.
+ *
+ *  @param helper : address of svc data structure returned from init.
+ *  @param it : address of iterator to be set.
+ *  @param commit_id : commit id (hex) or prefix, NULL for the head of the
+ *                     current branch.
+ *  @param order : order commits are returned in.
+ *  @param first_parent : 1 if only first previous commits are followed, 0
+ *                        otherwise.
+ *  @param skip : number of commits skipped before the first returned.
+ *  @param limit : maximum number of commits returned, 0 if unlimited.
+ *  @return 0 if successful, -1 if helper or it is NULL, -2 if commit doesnt
+ *          exist, -3 if commit id is ambiguous.
+ */
+int svc_log_init(void *helper, LogIter *it, char *commit_id,
+                 enum LogOrder order, int first_parent, size_t skip,
+                 size_t limit);
+
+/** @brief Returns next commit of history walk.
+ *
+ *  Returned commit is owned by helper, and released during cleanup, do NOT
+ *  free. It may be passed to get_prev_commits and print_commit.
+ *
+ *  @param it : address of iterator set by svc_log_init.
+ *  @return address of commit, NULL if the walk is finished, or the commit
+ *          cannot be read.
+ */
+void *svc_log_next(LogIter *it);
+
+/** @brief Releases history walk. If it is NULL, nothing is done.
+ *
+ *  @param it : address of iterator set by svc_log_init.
+ */
+void svc_log_free(LogIter *it);
+
+/** @brief Checks if a commit is an ancestor of another.
+ *
+ *  Ancestors are the commits reachable through previous commits, including
+ *  the second parent of merge commits. A commit is its own ancestor. The walk
+ *  uses commit generation numbers to stop at commits too old to reach the
+ *  ancestor, so it does not depend on the length of history before it.
+ *
+ *  @param helper : address of svc data structure returned from init.
+ *  @param ancestor_id : commit id (hex) of possible ancestor.
+ *  @param commit_id : commit id (hex).
+ *  @return 1 if ancestor, 0 if not, -1 if any argument is NULL, -2 if either
+ *          commit doesnt exist, -3 if either commit id is ambiguous.
+ */
+int svc_is_ancestor(void *helper, char *ancestor_id, char *commit_id);
+
+/** @brief Finds merge base of two commits.
+ *
+ *  Returns the id of a best common ancestor of the two commits, one that is
+ *  not an ancestor of any other common ancestor. If the commits have no
+ *  common ancestor, either doesnt exist, or any argument is NULL, NULL is
+ *  returned. Returned id is released during cleanup, do NOT free.
+ *
+ *  @param helper : address of svc data structure returned from init.
+ *  @param commit_a : commit id (hex).
+ *  @param commit_b : commit id (hex).
+ *  @return Commit id (hex) of merge base, NULL if unsuccessful.
+ */
+char *svc_merge_base(void *helper, char *commit_a, char *commit_b);
+
 /** @brief Prints commit data to stdout.
  *
  *  Prints commit data in the format presented below. If helper or commit_id are
  *  NULL, nothing is printed and NULL is returned. If the commit id is invalid,
- *  Invalid commit id is printed to stdout.
+ *  Invalid commit id is printed to stdout. If it is an ambiguous prefix,
+ *  Ambiguous commit id is printed to stdout. The full commit id is printed.
  *
  *  Format of output:
  *
@@ -101,6 +294,8 @@ char **get_prev_commits(void *helper, void *commit, int *n_prev);
  *      Tracked files (<number of tracked files>):
  *      [<hash of trackec file>] <file name>
  *
+ *  Hashes are printed as 16 digit hex.
+ *
  *
  *  @param helper : address of svc data structure returned from init.
  *  @param message : commit message
@@ -156,7 +351,42 @@ char **list_branches(void *helper, int *n_branches);
  *  @param file_name : NULL terminated file name.
  *  @return Hash of file is successful, error code if unsuccessful.
  */
-int svc_add(void *helper, char *file_name);
+int64_t svc_add(void *helper, char *file_name);
+
+/** @brief Stages files.
+ *
+ *  Each file is staged as by svc_add, and counted in report instead of
+ *  returning a code. Unknown files are hashed together, on the threads set by
+ *  svc_set_commit_threads, then staged in the order given. A file repeated in
+ *  file_names is staged once, later copies count as known. If helper,
+ *  file_names or report is NULL, nothing is done and -1 is returned.
+ *
+ *  @param helper : address of svc data structure returned from init.
+ *  @param file_names : array of NULL terminated file names.
+ *  @param n_files : length of file_names array.
+ *  @param report : address of report to be set.
+ *  @return 0 if successful, -1 otherwise.
+ */
+int svc_add_many(void *helper, char **file_names, size_t n_files,
+                 AddReport *report);
+
+/** @brief Stages all files under directory.
+ *
+ *  Regular files under dir_path are staged as by svc_add_many, in path order.
+ *  Paths matching the patterns of SVC_IGNORE_PATH (params.h), one glob per
+ *  line as in .gitignore, are skipped, along with the svc directory and
+ *  symbolic links. Ignored directories are not entered. Staged paths start
+ *  with dir_path, less any leading "./". If helper, dir_path or report is
+ *  NULL, nothing is done and -1 is returned. If the ignore file cannot be
+ *  read, nothing is done and -2 is returned. If dir_path cannot be walked,
+ *  nothing is done and -3 is returned.
+ *
+ *  @param helper : address of svc data structure returned from init.
+ *  @param dir_path : NULL terminated directory path.
+ *  @param report : address of report to be set.
+ *  @return 0 if successful, error code if unsuccessful.
+ */
+int svc_add_tree(void *helper, char *dir_path, AddReport *report);
 
 /** @brief Removes file from SVC.
  *
@@ -170,12 +400,13 @@ int svc_add(void *helper, char *file_name);
  *  @param file_name : NULL terminated file name.
  *  @return Hash of file is successful, error code if unsuccessful.
  */
-int svc_rm(void *helper, char *file_name);
+int64_t svc_rm(void *helper, char *file_name);
 
 /** @brief Resets to commit.
  *
  *  If helper or commit_id is NULL, nothing is done and -1 is returned. If commit
- *  is invalid (doesnt exist), nothing is done and -2 is returned. Otherwise,
+ *  is invalid (doesnt exist), nothing is done and -2 is returned. If commit_id
+ *  is an ambiguous prefix, nothing is done and -3 is returned. Otherwise,
  *  svc resets all files to the state captured by the commit.
  *
  *  @param helper : address of svc data structure returned from init.
@@ -192,9 +423,19 @@ int svc_reset(void *helper, char *commit_id);
  *  printed to stdout and NULL is returned. If uncommitted changes exist,
  *  Changes must be committed is printed to stdout and NULL is returned.
  *
- *  Merge will stage all files tracked by the merged branch, unknown to the
- *  current branch. File conflicts are resolved though the resolutions array.
- *  If file path in resolution is NULL, file is deleted from SVC.
+ *  Files are merged three ways, from the last common ancestor of both
+ *  branches, found through the parents of their commits. Files the merged
+ *  branch did not change since are skipped by hash, without being read, and
+ *  unchanged directories without being listed. Files changed by the merged
+ *  branch alone are taken from it: written, staged if unknown to the current
+ *  branch, or removed. Files changed by both branches are merged line by line,
+ *  changes to separate lines are kept from both. Changes of both branches to
+ *  the same or adjacent lines, and changes to files the other branch deleted,
+ *  conflict, see svc_merge_conflicts.
+ *
+ *  File conflicts are resolved though the resolutions array. If file path in
+ *  resolution is NULL, file is deleted from SVC. Files with conflicts left
+ *  unresolved keep the version of the current branch.
  *
  *  Commit with message Merged branch [<branch name>] is made, and Merge
  *  successful is printed to stdout. The commit id is returned.
@@ -207,4 +448,101 @@ int svc_reset(void *helper, char *commit_id);
  */
 char *svc_merge(void *helper, char *branch_name, resolution *resolutions, int n_resolutions);
 
+/** @brief Finds conflicts of merging branch with current branch.
+ *
+ *  Conflicts are found as by svc_merge, without changing any file, so
+ *  resolutions can be prepared for them. Conflicts are in path order, line
+ *  ranges in the order of the file.
+ *
+ *  @param helper : address of svc data structure returned from init.
+ *  @param branch_name : NULL terminated branch name.
+ *  @param n_conflicts : address for number of conflicts to be set.
+ *  @return conflicts, released with free_merge_conflicts, NULL if there are
+ *          none or the branch is not found or is the current branch.
+ */
+MergeConflict *svc_merge_conflicts(void *helper, char *branch_name,
+                                   size_t *n_conflicts);
+
+/** @brief Releases conflicts returned by svc_merge_conflicts.
+ *
+ *  @param conflicts : conflict array, may be NULL.
+ *  @param n_conflicts : number of conflicts.
+ */
+void free_merge_conflicts(MergeConflict *conflicts, size_t n_conflicts);
+
+/** @brief Diffs files of two commits.
+ *
+ *  Files are listed in path order, each as a unified diff:
+ *
+ *  diff --svc a/<path> b/<path>
+ *  --- a/<path>, or /dev/null if the file is only in commit_b
+ *  +++ b/<path>, or /dev/null if the file is only in commit_a
+ *  <hunks with DIFF_CONTEXT_LINES (params.h) lines of context>
+ *
+ *  Files with a null byte in their first DIFF_BINARY_CHECK bytes are listed
+ *  as "Binary files a/<path> and b/<path> differ" instead. Only directories
+ *  differing between the commits are read.
+ *
+ *  @param helper : address of svc data structure returned from init.
+ *  @param commit_a : commit id (Hex) diffed from, NULL for no files.
+ *  @param commit_b : commit id (Hex) diffed to.
+ *  @return null terminated diff, MUST be released, empty if there are no
+ *          changes, NULL if a commit is not found.
+ */
+char *svc_diff(void *helper, char *commit_a, char *commit_b);
+
+/** @brief Diffs files of commit with working copies of the current branch.
+ *
+ *  Diff is listed as by svc_diff, from the commit to the working copies of
+ *  files tracked or staged on the current branch. Files unknown to, or
+ *  removed from, the branch, and missing working copies, are diffed as
+ *  removed. Working copies whose stat and hash match the commit are not
+ *  read.
+ *
+ *  @param helper : address of svc data structure returned from init.
+ *  @param commit_id : commit id (Hex), NULL for the last commit of the
+ *                     current branch.
+ *  @return null terminated diff, MUST be released, empty if there are no
+ *          changes, NULL if the commit is not found.
+ */
+char *svc_diff_worktree(void *helper, char *commit_id);
+
+/** @brief Finds the commit that last changed each line of a file.
+ *
+ *  History is walked from the commit, newest first. Commits whose records
+ *  leave the file unchanged from their first parent, and commits whose file
+ *  matches a parent's by hash, pass their lines on without reading the file.
+ *  Other commits diff the file with each parent in turn, keeping the lines
+ *  found in no parent. Results are cached per commit and path, and reused
+ *  by later walks reaching a cached commit, so blaming neighbouring commits
+ *  only walks the commits between them.
+ *
+ *  @param helper : address of svc data structure returned from init.
+ *  @param commit_id : commit id (Hex), NULL for the last commit of the
+ *                     current branch.
+ *  @param file_path : path of file.
+ *  @param n_lines : address for number of lines of the file to be set.
+ *  @return origin of each line, MUST be released, NULL if the commit is not
+ *          found, does not hold the file, or the file cannot be read.
+ */
+BlameLine *svc_blame(void *helper, char *commit_id, char *file_path,
+                     size_t *n_lines);
+
+/** @brief Prints svc statistics to stdout.
+ *
+ *  If helper is NULL, nothing is printed. Statistics are printed in the
+ *  format presented below.
+ *
+ *  Format of output:
+ *
+ *  Restore backends:
+ *      <backend name>: <number of files restored>
+ *  Object codecs:
+ *      <codec name>: <n> objects, <raw bytes> -> <bytes on disk> bytes,
+ *      <n> restored
+ *
+ *  @param helper : address of svc data structure returned from init.
+ */
+void svc_print_stats(void *helper);
+
 #endif
@@ -0,0 +1,67 @@
+#include "thread_pool.h"
+
+typedef struct PoolRun {
+    pool_task task;   // task function
+    void *ctx;        // task context
+    size_t n_tasks;   // number of tasks
+    size_t next;      // next unclaimed task index, shared by workers
+} PoolRun;
+
+/** @brief Worker loop, claims and runs tasks until none remain.
+ *
+ *  @param arg : address of pool run.
+ *  @return NULL.
+ */
+static void *run_tasks(void *arg);
+
+void parallel_for(size_t n_tasks, size_t n_threads, pool_task task, void *ctx) {
+    if (!task || !n_tasks) {
+        return;
+    }
+
+    PoolRun run = {
+            .task = task,
+            .ctx = ctx,
+            .n_tasks = n_tasks,
+            .next = 0,
+    };
+
+    // no more threads than tasks, calling thread is a worker
+    if (n_threads > n_tasks) {
+        n_threads = n_tasks;
+    }
+    size_t n_workers = n_threads > 1 ? n_threads - 1 : 0;
+    pthread_t *workers = NULL;
+    size_t n_started = 0;
+    if (n_workers) {
+        workers = safe_malloc(n_workers * sizeof(pthread_t));
+        for (; n_started < n_workers; ++n_started) {
+            if (pthread_create(&workers[n_started], NULL, run_tasks, &run)) {
+                break;
+            }
+        }
+    }
+
+    run_tasks(&run);
+
+    for (size_t i = 0; i < n_started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+
+    return;
+}
+
+static void *run_tasks(void *arg) {
+    PoolRun *run = (PoolRun *) arg;
+
+    for (;;) {
+        size_t i = __atomic_fetch_add(&run->next, 1, __ATOMIC_RELAXED);
+        if (i >= run->n_tasks) {
+            break;
+        }
+        run->task(run->ctx, i);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,33 @@
+#ifndef ASSIGNMENT_2_SVC_THREAD_POOL_H
+#define ASSIGNMENT_2_SVC_THREAD_POOL_H
+
+#include "../memory/memory.h"
+#include <pthread.h>
+#include <stddef.h>
+
+/** @brief Task run by the pool.
+ *
+ *  Called once for each task index. Tasks may run concurrently, and in any
+ *  order, so each must only write state owned by its index.
+ *
+ *  @param ctx : caller context, shared by all tasks.
+ *  @param i : task index.
+ */
+typedef void (*pool_task)(void *ctx, size_t i);
+
+/** @brief Runs n_tasks tasks across a pool of worker threads.
+ *
+ *  Runs task(ctx, i) for every i in [0, n_tasks), and returns once all have
+ *  completed. Up to n_threads threads are used, including the calling thread.
+ *  Tasks are handed out one at a time, so uneven tasks balance across threads.
+ *  If n_threads is 0 or 1, or thread creation fails, remaining tasks run on
+ *  the calling thread, in order.
+ *
+ *  @param n_tasks : number of tasks.
+ *  @param n_threads : maximum number of threads.
+ *  @param task : task function.
+ *  @param ctx : context passed to every task.
+ */
+void parallel_for(size_t n_tasks, size_t n_threads, pool_task task, void *ctx);
+
+#endif //ASSIGNMENT_2_SVC_THREAD_POOL_H
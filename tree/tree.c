@@ -0,0 +1,337 @@
+#include "tree.h"
+
+typedef struct DiffState {
+    tree_diff_fn fn;  // called for each differing file
+    void *ctx;        // context passed to fn
+    char *path;       // path of entry being visited
+    size_t len_path;  // capacity of path
+} DiffState;
+
+/** @brief Compares entries in tree order.
+ *
+ *  @param a : name of entry.
+ *  @param a_len : length of name.
+ *  @param a_dir : 1 if entry is a directory.
+ *  @param b : name of entry.
+ *  @param b_len : length of name.
+ *  @param b_dir : 1 if entry is a directory.
+ *  @return negative, 0 or positive, as a orders before, with, or after b.
+ */
+static int compare_entry(const char *a, size_t a_len, int a_dir,
+                         const char *b, size_t b_len, int b_dir);
+
+/** @brief Returns path of changed file.
+ *
+ *  @param change : address of snapshot pair.
+ *  @return null terminated path.
+ */
+static const char *change_path(SnapshotPair *change);
+
+/** @brief Writes tree of directory with changes applied, and the trees of
+ *  its changed subdirectories.
+ *
+ *  @param dir : hash of directory tree, 0 if directory is new.
+ *  @param changes : changes under directory, in path order.
+ *  @param n_changes : number of changes.
+ *  @param prefix_len : length of directory path, with its last '/'.
+ *  @param hash : address for hash of tree to be set, 0 if left empty.
+ *  @return 0 if successful, -1 otherwise.
+ */
+static int write_dir(Hash dir, SnapshotPair *changes, size_t n_changes,
+                     size_t prefix_len, Hash *hash);
+
+/** @brief Stores entries as a tree object.
+ *
+ *  @param entries : entries, in tree order.
+ *  @param n_entries : number of entries.
+ *  @param base : hash of previous tree of directory, 0 if none.
+ *  @param hash : address for hash of tree to be set.
+ *  @return 0 if successful, -1 otherwise.
+ */
+static int store_tree(TreeEntry *entries, size_t n_entries, Hash base,
+                      Hash *hash);
+
+/** @brief Reports files differing between two directory trees.
+ *
+ *  @param d : address of diff state, path set to the directory path.
+ *  @param from : hash of directory tree, 0 if empty.
+ *  @param to : hash of directory tree, 0 if empty.
+ *  @param len : length of directory path, with its last '/'.
+ *  @return 0 if successful, -1 if a tree cannot be read.
+ */
+static int diff_dir(DiffState *d, Hash from, Hash to, size_t len);
+
+int read_tree(Hash hash, Tree *t) {
+    t->entries = NULL;
+    t->n_entries = 0;
+    t->data = NULL;
+    if (!hash) {
+        return 0;
+    }
+
+    size_t len = 0;
+    t->data = read_object(hash, &len);
+    if (!t->data) {
+        return -1;
+    }
+    const unsigned char *p = (const unsigned char *) t->data;
+    const unsigned char *end = p + len;
+    if (len < TREE_HEADER_SIZE || memcmp(p, TREE_MAGIC, 4) != 0) {
+        free_tree(t);
+        return -1;
+    }
+
+    // every entry takes at least its header
+    size_t n = get_le32(p + 4);
+    if (n > (len - TREE_HEADER_SIZE) / TREE_ENTRY_HEADER_SIZE) {
+        free_tree(t);
+        return -1;
+    }
+    t->entries = safe_malloc((n + 1) * sizeof(TreeEntry));
+    p += TREE_HEADER_SIZE;
+    for (; t->n_entries < n; ++t->n_entries) {
+        TreeEntry *e = &t->entries[t->n_entries];
+        if ((size_t) (end - p) < TREE_ENTRY_HEADER_SIZE) {
+            free_tree(t);
+            return -1;
+        }
+        e->hash = get_le64(p);
+        uint32_t kind = get_le32(p + 8);
+        e->name_len = get_le32(p + 12);
+        p += TREE_ENTRY_HEADER_SIZE;
+        if (kind > TreeDir || !e->name_len ||
+            (size_t) (end - p) < e->name_len) {
+            free_tree(t);
+            return -1;
+        }
+        e->kind = (enum TreeEntryKind) kind;
+        e->name = (const char *) p;
+        p += e->name_len;
+    }
+
+    return 0;
+}
+
+void free_tree(Tree *t) {
+    if (!t) {
+        return;
+    }
+
+    free(t->entries);
+    free(t->data);
+    t->entries = NULL;
+    t->n_entries = 0;
+    t->data = NULL;
+    return;
+}
+
+int write_tree(Hash base, SnapshotPair *changes, size_t n_changes,
+               Hash *root) {
+    if (!root || (!changes && n_changes)) {
+        return -1;
+    }
+
+    if (write_dir(base, changes, n_changes, 0, root) == -1) {
+        return -1;
+    }
+
+    // root is kept even if empty, so commits always have a tree
+    return *root ? 0 : store_tree(NULL, 0, 0, root);
+}
+
+int diff_trees(Hash from, Hash to, tree_diff_fn fn, void *ctx) {
+    if (!fn) {
+        return -1;
+    }
+
+    DiffState d = {fn, ctx, safe_malloc(NAME_MAX + 2), NAME_MAX + 2};
+    int ret = diff_dir(&d, from, to, 0);
+    free(d.path);
+    return ret;
+}
+
+static int compare_entry(const char *a, size_t a_len, int a_dir,
+                         const char *b, size_t b_len, int b_dir) {
+    size_t len = a_len < b_len ? a_len : b_len;
+    int cmp = memcmp(a, b, len);
+    if (cmp) {
+        return cmp;
+    }
+
+    // directories order as if their names ended in '/', as in paths
+    unsigned char ca = len < a_len ? (unsigned char) a[len] :
+                       a_dir ? '/' : '\0';
+    unsigned char cb = len < b_len ? (unsigned char) b[len] :
+                       b_dir ? '/' : '\0';
+    if (ca != cb || (len == a_len && len == b_len)) {
+        return (int) ca - (int) cb;
+    }
+    return a_len < b_len ? -1 : a_len > b_len;
+}
+
+static const char *change_path(SnapshotPair *change) {
+    return change->to ? change->to->name : change->from->name;
+}
+
+static int write_dir(Hash dir, SnapshotPair *changes, size_t n_changes,
+                     size_t prefix_len, Hash *hash) {
+    Tree t;
+    if (read_tree(dir, &t) == -1) {
+        return -1;
+    }
+
+    // merge join of entries and changes, at most one entry each
+    TreeEntry *out = safe_malloc((t.n_entries + n_changes + 1) *
+                                 sizeof(TreeEntry));
+    size_t n_out = 0;
+    size_t i = 0;
+    size_t j = 0;
+    int ret = 0;
+    while (ret == 0 && (i < t.n_entries || j < n_changes)) {
+        // name of next change in this directory
+        const char *name = NULL;
+        size_t len = 0;
+        int is_dir = 0;
+        if (j < n_changes) {
+            name = change_path(&changes[j]) + prefix_len;
+            const char *slash = strchr(name, '/');
+            is_dir = slash != NULL;
+            len = is_dir ? (size_t) (slash - name) : strlen(name);
+        }
+        int cmp = j == n_changes ? -1 : i == t.n_entries ? 1 :
+                  compare_entry(t.entries[i].name, t.entries[i].name_len,
+                                t.entries[i].kind == TreeDir,
+                                name, len, is_dir);
+        if (cmp < 0) {
+            out[n_out++] = t.entries[i++];
+            continue;
+        }
+        Hash old = cmp == 0 ? t.entries[i++].hash : 0;
+
+        if (!is_dir) {
+            // file added, changed or removed, once, or the name is repeated
+            if (j + 1 < n_changes &&
+                !strcmp(change_path(&changes[j]),
+                        change_path(&changes[j + 1]))) {
+                errno = EINVAL;
+                ret = -1;
+                break;
+            }
+            if (changes[j].to) {
+                out[n_out++] = (TreeEntry) {name, (uint32_t) len, TreeFile,
+                                            changes[j].to->hash};
+            }
+            j++;
+            continue;
+        }
+
+        // changes under a subdirectory are adjacent in path order
+        size_t k = j + 1;
+        while (k < n_changes) {
+            const char *next = change_path(&changes[k]) + prefix_len;
+            if (strncmp(next, name, len) != 0 || next[len] != '/') {
+                break;
+            }
+            k++;
+        }
+        Hash sub = 0;
+        ret = write_dir(old, changes + j, k - j, prefix_len + len + 1, &sub);
+        if (sub) {
+            out[n_out++] = (TreeEntry) {name, (uint32_t) len, TreeDir, sub};
+        }
+        j = k;
+    }
+
+    *hash = 0;
+    if (ret == 0 && n_out) {
+        ret = store_tree(out, n_out, dir, hash);
+    }
+    free(out);
+    free_tree(&t);
+    return ret;
+}
+
+static int store_tree(TreeEntry *entries, size_t n_entries, Hash base,
+                      Hash *hash) {
+    size_t len = TREE_HEADER_SIZE;
+    for (size_t i = 0; i < n_entries; ++i) {
+        len += TREE_ENTRY_HEADER_SIZE + entries[i].name_len;
+    }
+
+    unsigned char *data = safe_malloc(len);
+    memcpy(data, TREE_MAGIC, 4);
+    put_le32(data + 4, (uint32_t) n_entries);
+    unsigned char *p = data + TREE_HEADER_SIZE;
+    for (size_t i = 0; i < n_entries; ++i) {
+        put_le64(p, entries[i].hash);
+        put_le32(p + 8, entries[i].kind);
+        put_le32(p + 12, entries[i].name_len);
+        memcpy(p + TREE_ENTRY_HEADER_SIZE, entries[i].name,
+               entries[i].name_len);
+        p += TREE_ENTRY_HEADER_SIZE + entries[i].name_len;
+    }
+
+    // large directories are stored as deltas against their last tree
+    *hash = hash_bytes(data, len);
+    int ret = write_object(*hash, (char *) data, len, DEFAULT_OBJECT_CODEC,
+                           base ? &base : NULL);
+    free(data);
+    return ret;
+}
+
+static int diff_dir(DiffState *d, Hash from, Hash to, size_t len) {
+    if (from == to) {
+        return 0;
+    }
+
+    Tree a;
+    Tree b;
+    if (read_tree(from, &a) == -1) {
+        return -1;
+    }
+    if (read_tree(to, &b) == -1) {
+        free_tree(&a);
+        return -1;
+    }
+
+    size_t i = 0;
+    size_t j = 0;
+    int ret = 0;
+    while (ret == 0 && (i < a.n_entries || j < b.n_entries)) {
+        TreeEntry *ea = i < a.n_entries ? &a.entries[i] : NULL;
+        TreeEntry *eb = j < b.n_entries ? &b.entries[j] : NULL;
+        int cmp = !ea ? 1 : !eb ? -1 :
+                  compare_entry(ea->name, ea->name_len, ea->kind == TreeDir,
+                                eb->name, eb->name_len, eb->kind == TreeDir);
+        TreeEntry *e = cmp <= 0 ? ea : eb;
+        const Hash *from_hash = cmp <= 0 ? &ea->hash : NULL;
+        const Hash *to_hash = cmp >= 0 ? &eb->hash : NULL;
+        i += cmp <= 0;
+        j += cmp >= 0;
+
+        // equal subtrees are skipped unread
+        if (from_hash && to_hash && *from_hash == *to_hash) {
+            continue;
+        }
+
+        // path of entry, in place after directory path
+        size_t entry_len = len + e->name_len;
+        if (entry_len + 2 > d->len_path) {
+            d->len_path = entry_len + NAME_MAX + 2;
+            d->path = safe_realloc(d->path, d->len_path);
+        }
+        memcpy(d->path + len, e->name, e->name_len);
+        if (e->kind == TreeDir) {
+            d->path[entry_len] = '/';
+            ret = diff_dir(d, from_hash ? *from_hash : 0,
+                           to_hash ? *to_hash : 0, entry_len + 1);
+        } else {
+            d->path[entry_len] = '\0';
+            d->fn(d->ctx, d->path, from_hash, to_hash);
+        }
+    }
+
+    free_tree(&a);
+    free_tree(&b);
+    return ret;
+}
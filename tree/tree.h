@@ -0,0 +1,102 @@
+#ifndef ASSIGNMENT_2_SVC_TREE_H
+#define ASSIGNMENT_2_SVC_TREE_H
+
+#include "../params.h"
+#include "../memory/memory.h"
+#include "../hash/hash.h"
+#include "../object/object.h"
+#include "../snapshot/snapshot.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+#define TREE_MAGIC "SVCT"
+#define TREE_HEADER_SIZE 8
+#define TREE_ENTRY_HEADER_SIZE 16
+
+enum TreeEntryKind {TreeFile = 0, TreeDir = 1};
+
+typedef struct TreeEntry {
+    const char *name;         // name in directory, not null terminated
+    uint32_t name_len;        // length of name
+    enum TreeEntryKind kind;  // file or directory
+    Hash hash;                // hash of file contents, or of directory tree
+} TreeEntry;
+
+typedef struct Tree {
+    TreeEntry *entries;  // entries, in tree order
+    size_t n_entries;    // number of entries
+    char *data;          // tree object contents, names point into it
+} Tree;
+
+/** @brief Receives a file differing between two trees.
+ *
+ *  @param ctx : caller context.
+ *  @param path : null terminated path, only valid for the call.
+ *  @param from : address of hash in from tree, NULL if only in to.
+ *  @param to : address of hash in to tree, NULL if only in from.
+ */
+typedef void (*tree_diff_fn)(void *ctx, char *path, const Hash *from,
+                             const Hash *to);
+
+/** @brief Reads tree object.
+ *
+ *  Entries are in tree order, by name, with names of directories compared
+ *  as if they ended in '/', so walking trees depth first visits files in
+ *  path order. MUST be released with free_tree.
+ *
+ *  @param hash : hash of tree object, 0 for an empty tree.
+ *  @param t : address of tree to be set.
+ *  @return 0 if successful, -1 if the object is missing or corrupt.
+ */
+int read_tree(Hash hash, Tree *t);
+
+/** @brief Releases tree.
+ *
+ *  @param t : address of tree.
+ */
+void free_tree(Tree *t);
+
+/** @brief Writes tree objects of base with changes applied.
+ *
+ *  Each directory is stored as a tree object listing its files and
+ *  subdirectories with their hashes, and named by the hash of its contents,
+ *  so equal directories have equal hashes whatever the history that led to
+ *  them. Only directories with changes under them are read and written, the
+ *  others keep their hash from base. Directories left empty are dropped.
+ *
+ *  Format of tree object:
+ *
+ *  "SVCT" <n entries:u32> (<hash:u64> <kind:u32> <name len:u32> <name>)*
+ *
+ *  Objects are written in the current batch, if any, see begin_object_batch.
+ *
+ *  @param base : hash of root tree changes apply to, 0 if none.
+ *  @param changes : changed files in path order, each path once, from set
+ *                   to NULL for added files and to set to NULL for removed
+ *                   files, as returned by pair_snapshots.
+ *  @param n_changes : number of changes.
+ *  @param root : address for hash of new root tree to be set.
+ *  @return 0 if successful, -1 if a tree cannot be read or written, or a
+ *          path is changed more than once.
+ */
+int write_tree(Hash base, SnapshotPair *changes, size_t n_changes,
+               Hash *root);
+
+/** @brief Finds files differing between two trees.
+ *
+ *  Directories with equal hashes in both trees are skipped without being
+ *  read, so the cost depends on the directories changed, not on the number
+ *  of files. Files are passed to fn in path order.
+ *
+ *  @param from : hash of root tree, 0 for an empty tree.
+ *  @param to : hash of root tree, 0 for an empty tree.
+ *  @param fn : called for each differing file.
+ *  @param ctx : context passed to fn.
+ *  @return 0 if successful, -1 if a tree cannot be read.
+ */
+int diff_trees(Hash from, Hash to, tree_diff_fn fn, void *ctx);
+
+#endif //ASSIGNMENT_2_SVC_TREE_H